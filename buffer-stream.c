@@ -0,0 +1,322 @@
+/**
+ * buffer-stream.c
+ *   Streams of chunks of a drawable, read and written through GEGL
+ *   buffers.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <string.h>             // For memcpy
+
+#include "buffer-stream.h"
+#include "mipmap.h"
+#include "tile-pool.h"
+
+/**
+ * Besides GEGL buffers, we need the per-item iterator API, which
+ * arrived with GEGL 0.4.14 (GIMP 2.10.10).
+ */
+#define HAVE_BUFFER_STREAMS \
+  (HAVE_GEGL_BUFFERS && GIMP_CHECK_VERSION (2, 10, 10))
+
+#if HAVE_BUFFER_STREAMS
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * Information on one stream.
+ */
+struct BufferStream
+  {
+    int drawable;               // The drawable we're working on
+    GeglRectangle rect;         // The part of the drawable
+    GeglBuffer *source;         // Where the pixels come from
+    GeglBuffer *target;         // Where they go (the shadow)
+    const Babl *format;         // The format the client sees
+    int bpp;                    // Bytes per pixel in that format
+    GeglBufferIterator *iterator;       // NULL at the end
+  };
+typedef struct BufferStream BufferStream;
+
+
+
+// +---------+---------------------------------------------------------
+// | Globals |
+// +---------+
+
+/**
+ * All of the currently active buffer streams.
+ */
+static BufferStream *buffer_streams[MAX_BUFFER_STREAMS];
+
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Find an unused stream id.  Returns -1 if there are none.
+ */
+static int
+next_buffer_stream_id (void)
+{
+  int id;
+  for (id = 0; id < MAX_BUFFER_STREAMS; id++)
+    if (buffer_streams[id] == NULL)
+      return id;
+  return -1;
+} // next_buffer_stream_id
+
+/**
+ * Start work on the current chunk, if there is one, by copying the
+ * source pixels into the target, in case the client leaves them
+ * alone.
+ */
+static void
+buffer_stream_start_chunk (BufferStream *stream)
+{
+  GeglBufferIterator *it = stream->iterator;
+  if (it == NULL)
+    return;
+  memcpy (it->items[1].data, it->items[0].data,
+          (gsize) it->length * stream->bpp);
+} // buffer_stream_start_chunk
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+gboolean
+buffer_streams_supported (void)
+{
+  return TRUE;
+} // buffer_streams_supported
+
+int
+buffer_stream_new (int drawable, int x, int y, int width, int height,
+                   const char *format)
+{
+  // Validate
+  if ((x < 0) || (y < 0) || (width <= 0) || (height <= 0)
+      || (x + width > gimp_drawable_width (drawable))
+      || (y + height > gimp_drawable_height (drawable)))
+    return -1;
+  if ((format != NULL) && (*format != '\0') 
+      && (! babl_format_exists (format)))
+    return -1;
+  int id = next_buffer_stream_id ();
+  if (id < 0)
+    return -1;
+
+  // Fill in the basic data
+  BufferStream *stream = g_try_new0 (BufferStream, 1);
+  if (stream == NULL)
+    return -1;
+  stream->drawable = drawable;
+  stream->rect.x = x;
+  stream->rect.y = y;
+  stream->rect.width = width;
+  stream->rect.height = height;
+  stream->source = gimp_drawable_get_buffer (drawable);
+  stream->target = gimp_drawable_get_shadow_buffer (drawable);
+  if ((stream->source == NULL) || (stream->target == NULL))
+    {
+      if (stream->source != NULL)
+        g_object_unref (stream->source);
+      if (stream->target != NULL)
+        g_object_unref (stream->target);
+      g_free (stream);
+      return -1;
+    } // if we could not get the buffers
+  stream->format = ((format != NULL) && (*format != '\0'))
+                   ? babl_format (format)
+                   : gegl_buffer_get_format (stream->source);
+  stream->bpp = babl_format_get_bytes_per_pixel (stream->format);
+
+  // Set up the iterator, which converts to and from the client's
+  // format as it goes
+  stream->iterator =
+    gegl_buffer_iterator_new (stream->source, &(stream->rect), 0,
+                              stream->format,
+                              GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
+  gegl_buffer_iterator_add (stream->iterator, stream->target,
+                            &(stream->rect), 0, stream->format,
+                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  if (! gegl_buffer_iterator_next (stream->iterator))
+    stream->iterator = NULL;
+  buffer_stream_start_chunk (stream);
+
+  // And we're done
+  buffer_streams[id] = stream;
+  return id;
+} // buffer_stream_new
+
+gboolean
+buffer_stream_is_valid (int id)
+{
+  return (id >= 0) && (id < MAX_BUFFER_STREAMS)
+         && (buffer_streams[id] != NULL);
+} // buffer_stream_is_valid
+
+const guchar *
+buffer_stream_get (int id, int *size, int *bpp, int *rowstride,
+                   int *x, int *y, int *width, int *height)
+{
+  if (! buffer_stream_is_valid (id))
+    return NULL;
+  BufferStream *stream = buffer_streams[id];
+  GeglBufferIterator *it = stream->iterator;
+  if (it == NULL)
+    return NULL;
+
+  // The iterator hands us tightly packed rows
+  GeglRectangle *roi = &(it->items[0].roi);
+  *bpp = stream->bpp;
+  *rowstride = roi->width * stream->bpp;
+  *size = it->length * stream->bpp;
+  *x = roi->x;
+  *y = roi->y;
+  *width = roi->width;
+  *height = roi->height;
+  return it->items[0].data;
+} // buffer_stream_get
+
+int
+buffer_stream_update (int id, int size, const guchar *data)
+{
+  if (! buffer_stream_is_valid (id))
+    return -1;
+  BufferStream *stream = buffer_streams[id];
+  GeglBufferIterator *it = stream->iterator;
+  if ((it == NULL) || (size != it->length * stream->bpp))
+    return -1;
+  memcpy (it->items[1].data, data, size);
+  return 0;
+} // buffer_stream_update
+
+gboolean
+buffer_stream_advance (int id)
+{
+  if (! buffer_stream_is_valid (id))
+    return FALSE;
+  BufferStream *stream = buffer_streams[id];
+  if (stream->iterator == NULL)
+    return FALSE;
+
+  // The iterator frees itself when it runs out of chunks
+  if (! gegl_buffer_iterator_next (stream->iterator))
+    stream->iterator = NULL;
+  buffer_stream_start_chunk (stream);
+  return (stream->iterator != NULL);
+} // buffer_stream_advance
+
+void
+buffer_stream_close (int id)
+{
+  if (! buffer_stream_is_valid (id))
+    return;
+
+  // Run through the rest of the chunks, so that the unvisited pixels
+  // get copied to the shadow
+  while (buffer_stream_advance (id))
+    ;
+
+  // And update!
+  BufferStream *stream = buffer_streams[id];
+  gegl_buffer_flush (stream->target);
+  drawable_shadow_fill (stream->drawable,
+                        stream->rect.x, stream->rect.y,
+                        stream->rect.width, stream->rect.height);
+  gimp_drawable_merge_shadow (stream->drawable, TRUE);
+  gimp_drawable_update (stream->drawable,
+                        stream->rect.x, stream->rect.y,
+                        stream->rect.width, stream->rect.height);
+  mipmap_invalidate (stream->drawable, 
+                     stream->rect.x, stream->rect.y,
+                     stream->rect.width, stream->rect.height);
+  gimp_displays_flush ();
+  g_object_unref (stream->source);
+  g_object_unref (stream->target);
+  g_free (stream);
+  buffer_streams[id] = NULL;
+} // buffer_stream_close
+
+#else // ! HAVE_BUFFER_STREAMS
+
+
+
+// +----------------------------------+-------------------------------
+// | Functions (Without GEGL Buffers) |
+// +----------------------------------+
+
+gboolean
+buffer_streams_supported (void)
+{
+  return FALSE;
+} // buffer_streams_supported
+
+int
+buffer_stream_new (int drawable, int x, int y, int width, int height,
+                   const char *format)
+{
+  return -1;
+} // buffer_stream_new
+
+gboolean
+buffer_stream_is_valid (int id)
+{
+  return FALSE;
+} // buffer_stream_is_valid
+
+const guchar *
+buffer_stream_get (int id, int *size, int *bpp, int *rowstride,
+                   int *x, int *y, int *width, int *height)
+{
+  return NULL;
+} // buffer_stream_get
+
+int
+buffer_stream_update (int id, int size, const guchar *data)
+{
+  return -1;
+} // buffer_stream_update
+
+gboolean
+buffer_stream_advance (int id)
+{
+  return FALSE;
+} // buffer_stream_advance
+
+void
+buffer_stream_close (int id)
+{
+} // buffer_stream_close
+
+#endif // HAVE_BUFFER_STREAMS
@@ -0,0 +1,126 @@
+#ifndef __BUFFER_STREAM_H__
+#define __BUFFER_STREAM_H__
+
+/**
+ * buffer-stream.h
+ *   Streams of chunks of a drawable, read and written through GEGL
+ *   buffers rather than pixel regions, so that they work with high
+ *   bit-depth drawables and with any Babl format the client wants.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Buffer streams work like tile streams (see tile-stream.h), except
+  that the chunks are whatever GEGL's buffer iterator hands us, and
+  the pixels arrive in the Babl format named when the stream is
+  created (e.g., "R'G'B'A u8", "RGBA float", or "Y' u16").  GEGL
+  converts each chunk once, in its own optimized code.  The empty
+  format means the drawable's own format.
+
+  Changes go to the shadow buffer and are merged when the stream is
+  closed, so they can be undone.
+
+  GEGL buffers are only available to plug-ins from GIMP 2.10 on.
+  With older versions, buffer_streams_supported returns FALSE and
+  buffer_stream_new always fails.
+
+  // Sample usage
+  stream = buffer_stream_new (drawable, 0, 0, width, height, "RGBA float");
+  assert (stream >= 0);
+  while ((pixels = buffer_stream_get (stream, &size, &bpp, &rowstride,
+                                      &x, &y, &w, &h)) != NULL)
+    {
+      ...
+      buffer_stream_advance (stream);
+    } // while
+  buffer_stream_close (stream);
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The most buffer streams that may be open at once.
+ */
+#define MAX_BUFFER_STREAMS 64
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Determine whether this build supports buffer streams.
+ */
+gboolean buffer_streams_supported (void);
+
+/**
+ * Create a stream over a rectangle of a drawable, delivering pixels in
+ * the named Babl format.  Returns a negative number if it cannot
+ * create the stream (including when the format does not exist).
+ */
+int buffer_stream_new (int drawable, int x, int y, int width, int height,
+                       const char *format);
+
+/**
+ * Determine if id names an open buffer stream.
+ */
+gboolean buffer_stream_is_valid (int id);
+
+/**
+ * Get the pixels in the current chunk, along with the information
+ * needed to interpret them.  Returns NULL at the end of the stream.
+ */
+const guchar *buffer_stream_get (int id, int *size, int *bpp, int *rowstride,
+                                 int *x, int *y, int *width, int *height);
+
+/**
+ * Replace the pixels in the current chunk.  size must be the size
+ * given by buffer_stream_get.  Returns 0 on success and a negative
+ * number on failure.
+ */
+int buffer_stream_update (int id, int size, const guchar *data);
+
+/**
+ * Advance to the next chunk.  Returns true if there is one.
+ */
+gboolean buffer_stream_advance (int id);
+
+/**
+ * Close the stream, writing any changes back to the drawable.
+ */
+void buffer_stream_close (int id);
+
+#endif // __BUFFER_STREAM_H__
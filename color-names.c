@@ -0,0 +1,267 @@
+/**
+ * color-names.c
+ *   A table of the colors that the GIMP knows by name.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Names are found with a hash table keyed by the lowercase name.
+
+  To find the nearest name, we divide the RGB cube into GRID_SIZE^3
+  cells and keep a list of the colors in each cell.  We then search
+  outward from the cell containing the target, one shell of cells at
+  a time, stopping once no unsearched cell could hold anything closer
+  than the best color found so far.  With the ~150 named colors, that
+  usually means looking at a few cells instead of the whole palette.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+
+#include "color-names.h"
+#include "irgb.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The number of cells along each side of the RGB cube.
+ */
+#define GRID_SIZE 8
+
+/**
+ * The width of each cell.
+ */
+#define CELL_WIDTH (256 / GRID_SIZE)
+
+
+// +---------+---------------------------------------------------------
+// | Globals |
+// +---------+
+
+/**
+ * The names of the colors, in the order that the GIMP gives them.
+ */
+static const gchar **names = NULL;
+
+/**
+ * The corresponding irgb colors.
+ */
+static gint32 *colors = NULL;
+
+/**
+ * The number of named colors.
+ */
+static int ncolors = 0;
+
+/**
+ * Map from lowercase name to (index + 1).
+ */
+static GHashTable *by_name = NULL;
+
+/**
+ * For each cell of the grid, the indices of the colors in that cell,
+ * terminated by -1.
+ */
+static int *cells[GRID_SIZE][GRID_SIZE][GRID_SIZE];
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Compute the squared distance between two irgb colors.
+ */
+static int
+distance2 (gint32 c1, gint32 c2)
+{
+  int dr = IRGB_RED (c1) - IRGB_RED (c2);
+  int dg = IRGB_GREEN (c1) - IRGB_GREEN (c2);
+  int db = IRGB_BLUE (c1) - IRGB_BLUE (c2);
+  return dr*dr + dg*dg + db*db;
+} // distance2
+
+/**
+ * Build the grid of cells.
+ */
+static void
+build_grid (void)
+{
+  int counts[GRID_SIZE][GRID_SIZE][GRID_SIZE] = { { { 0 } } };
+  int i, r, g, b;
+
+  // Count the colors in each cell
+  for (i = 0; i < ncolors; i++)
+    ++counts[IRGB_RED (colors[i]) / CELL_WIDTH]
+            [IRGB_GREEN (colors[i]) / CELL_WIDTH]
+            [IRGB_BLUE (colors[i]) / CELL_WIDTH];
+
+  // Allocate the cells
+  for (r = 0; r < GRID_SIZE; r++)
+    for (g = 0; g < GRID_SIZE; g++)
+      for (b = 0; b < GRID_SIZE; b++)
+        {
+          cells[r][g][b] = g_new (int, counts[r][g][b] + 1);
+          cells[r][g][b][0] = -1;
+          counts[r][g][b] = 0;
+        } // for each cell
+
+  // And fill them in.  (Colors are added in order, so ties are broken
+  // in favor of whichever name the GIMP lists first.)
+  for (i = 0; i < ncolors; i++)
+    {
+      r = IRGB_RED (colors[i]) / CELL_WIDTH;
+      g = IRGB_GREEN (colors[i]) / CELL_WIDTH;
+      b = IRGB_BLUE (colors[i]) / CELL_WIDTH;
+      cells[r][g][b][counts[r][g][b]++] = i;
+      cells[r][g][b][counts[r][g][b]] = -1;
+    } // for each color
+} // build_grid
+
+/**
+ * Compute the distance from component c (in cell cc) to the nearest
+ * point outside the cells [cc-k .. cc+k].  Returns G_MAXINT if those
+ * cells reach both ends of the axis.
+ */
+static int
+distance_to_shell (int c, int cc, int k)
+{
+  int result = G_MAXINT;
+  if (cc - k > 0)
+    result = MIN (result, c - (cc - k) * CELL_WIDTH + 1);
+  if (cc + k < GRID_SIZE - 1)
+    result = MIN (result, (cc + k + 1) * CELL_WIDTH - c);
+  return result;
+} // distance_to_shell
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+void
+color_names_init (void)
+{
+  if (names != NULL)
+    return;
+
+  GimpRGB *rgbs;
+  ncolors = gimp_rgb_list_names (&names, &rgbs);
+  colors = g_new (gint32, MAX (ncolors, 1));
+  by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  int i;
+  for (i = 0; i < ncolors; i++)
+    {
+      guchar r, g, b;
+      gimp_rgb_get_uchar (&(rgbs[i]), &r, &g, &b);
+      colors[i] = irgb_new (r, g, b);
+      g_hash_table_insert (by_name, 
+                           g_ascii_strdown (names[i], -1),
+                           GINT_TO_POINTER (i + 1));
+    } // for each color
+  g_free (rgbs);
+
+  build_grid ();
+} // color_names_init
+
+int
+color_names_list (const gchar ***result)
+{
+  color_names_init ();
+  *result = names;
+  return ncolors;
+} // color_names_list
+
+gboolean
+color_names_lookup (const gchar *name, gint32 *color)
+{
+  color_names_init ();
+
+  gchar *key = g_strstrip (g_ascii_strdown (name, -1));
+  int index = GPOINTER_TO_INT (g_hash_table_lookup (by_name, key));
+  g_free (key);
+  if (index == 0)
+    return FALSE;
+  *color = colors[index - 1];
+  return TRUE;
+} // color_names_lookup
+
+const gchar *
+color_names_nearest (gint32 color)
+{
+  color_names_init ();
+  if (ncolors == 0)
+    return NULL;
+
+  int r = IRGB_RED (color);
+  int g = IRGB_GREEN (color);
+  int b = IRGB_BLUE (color);
+  int cr = r / CELL_WIDTH;
+  int cg = g / CELL_WIDTH;
+  int cb = b / CELL_WIDTH;
+  int best = -1;
+  int best_distance = G_MAXINT;
+  int k;
+
+  for (k = 0; k < GRID_SIZE; k++)
+    {
+      // Look at each cell in the shell at distance k
+      int ir, ig, ib;
+      for (ir = MAX (cr - k, 0); ir <= MIN (cr + k, GRID_SIZE - 1); ir++)
+        for (ig = MAX (cg - k, 0); ig <= MIN (cg + k, GRID_SIZE - 1); ig++)
+          for (ib = MAX (cb - k, 0); ib <= MIN (cb + k, GRID_SIZE - 1); ib++)
+            {
+              if ((ABS (ir - cr) != k) && (ABS (ig - cg) != k) 
+                  && (ABS (ib - cb) != k))
+                continue;
+              int *cell;
+              for (cell = cells[ir][ig][ib]; *cell >= 0; cell++)
+                {
+                  int d = distance2 (color, colors[*cell]);
+                  if ((d < best_distance) 
+                      || ((d == best_distance) && (*cell < best)))
+                    {
+                      best = *cell;
+                      best_distance = d;
+                    } // if we found something better
+                } // for each color in the cell
+            } // for each cell in the shell
+
+      // Could anything further out be closer?
+      int reach = MIN (distance_to_shell (r, cr, k),
+                       MIN (distance_to_shell (g, cg, k),
+                            distance_to_shell (b, cb, k)));
+      if ((best >= 0) 
+          && ((reach == G_MAXINT) || (best_distance < reach * reach)))
+        break;
+    } // for each shell
+
+  return names[best];
+} // color_names_nearest
@@ -0,0 +1,63 @@
+#ifndef __COLOR_NAMES_H__
+#define __COLOR_NAMES_H__
+
+/**
+ * color-names.h
+ *   A table of the colors that the GIMP knows by name, built once so
+ *   that we can look up names (and find the name nearest to a color)
+ *   without asking libgimpcolor to rebuild its list every time.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Build the table.  Safe to call more than once; the other functions
+ * call it if it hasn't been called yet.
+ */
+void color_names_init (void);
+
+/**
+ * Get the list of color names.  The list belongs to the table and
+ * should not be freed.  Returns the number of names.
+ */
+int color_names_list (const gchar ***names);
+
+/**
+ * Look up the irgb color with a given name.  Case and surrounding
+ * whitespace are ignored.  Returns TRUE and sets *color if the name
+ * is known and returns FALSE otherwise.
+ */
+gboolean color_names_lookup (const gchar *name, gint32 *color);
+
+/**
+ * Find the name of the known color closest (in RGB space) to an irgb
+ * color.  The name belongs to the table and should not be freed.
+ */
+const gchar *color_names_nearest (gint32 color);
+
+#endif // __COLOR_NAMES_H__
@@ -0,0 +1,180 @@
+/**
+ * convolve.c
+ *   Convolve a rectangle of a drawable with a kernel.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <math.h>               // For isfinite
+#include <string.h>             // For memcpy and memset
+
+#include "convolve.h"
+#include "tile-kernels.h"
+#include "tile-pool.h"
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * A kernel, ready to use.
+ */
+struct Convolution
+  {
+    int width;
+    int height;
+    gboolean separable;
+    gboolean alpha;             // Does the drawable have alpha?
+    float *weights;             // The rows (or the row, then the column)
+  };
+typedef struct Convolution Convolution;
+
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Convolve one tile.  (Runs on a worker thread.)  A separable kernel
+ * takes two passes: along the rows of the tile and the rows of halo
+ * above and below it, into floats, and then down the columns of those
+ * floats.  A general kernel sums one row pass per row of the kernel.
+ * Pixels with alpha are filtered premultiplied, so that the colors of
+ * transparent pixels do not bleed into their neighbors.
+ */
+static void
+convolve_job (const guchar *source, int source_rowstride,
+              guchar *pixels, int bpp, int rowstride,
+              int x, int y, int width, int height,
+              int halo, gpointer data)
+{
+  static const float one = 1.0f;
+  const Convolution *kernel = (const Convolution *) data;
+  int rx = kernel->width / 2;
+  int ry = kernel->height / 2;
+  gsize n = (gsize) width * bpp;
+  int r, k;
+
+  // The kernel may be narrower or shorter than the halo
+  const guchar *base = source + (halo - ry) * source_rowstride
+                       + (halo - rx) * bpp;
+  int base_rowstride = source_rowstride;
+  guchar *premultiplied = NULL;
+  if (kernel->alpha)
+    {
+      int cols = width + 2 * rx;
+      base_rowstride = cols * bpp;
+      premultiplied = g_new (guchar, (gsize) base_rowstride
+                                     * (height + 2 * ry));
+      for (r = 0; r < height + 2 * ry; r++)
+        {
+          guchar *row = premultiplied + r * base_rowstride;
+          memcpy (row, base + r * source_rowstride, base_rowstride);
+          tile_kernel_premultiply (row, bpp, cols);
+        } // for each row we read
+      base = premultiplied;
+    } // if the drawable has alpha
+
+  if (kernel->separable)
+    {
+      const float *row = kernel->weights;
+      const float *column = kernel->weights + kernel->width;
+      int rows = height + 2 * ry;
+      float *middle = g_new0 (float, n * rows);
+      for (r = 0; r < rows; r++)
+        tile_kernel_fir_u8 (base + r * base_rowstride, bpp,
+                            middle + r * n, n, row, kernel->width);
+      for (r = 0; r < height; r++)
+        tile_kernel_fir_f32 (middle + r * n, n, pixels + r * rowstride, n,
+                             column, kernel->height);
+      g_free (middle);
+    } // if the kernel is separable
+  else
+    {
+      float *sums = g_new (float, n);
+      for (r = 0; r < height; r++)
+        {
+          memset (sums, 0, n * sizeof (float));
+          for (k = 0; k < kernel->height; k++)
+            tile_kernel_fir_u8 (base + (r + k) * base_rowstride, bpp,
+                                sums, n, kernel->weights + k * kernel->width,
+                                kernel->width);
+          tile_kernel_fir_f32 (sums, 0, pixels + r * rowstride, n, &one, 1);
+        } // for each row
+      g_free (sums);
+    } // if the kernel is general
+
+  if (kernel->alpha)
+    {
+      for (r = 0; r < height; r++)
+        tile_kernel_unpremultiply (pixels + r * rowstride, bpp, width);
+      g_free (premultiplied);
+    } // if the drawable has alpha
+} // convolve_job
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+int
+drawable_convolve (int drawable, int x, int y, int width, int height,
+                   const double *kernel,
+                   int kernel_width, int kernel_height,
+                   gboolean separable)
+{
+  // Validate
+  if ((! gimp_drawable_is_valid (drawable))
+      || (kernel_width < 1) || (kernel_width > CONVOLVE_MAX_SIZE)
+      || (kernel_height < 1) || (kernel_height > CONVOLVE_MAX_SIZE)
+      || (kernel_width % 2 == 0) || (kernel_height % 2 == 0))
+    return -1;
+  int nweights = separable ? kernel_width + kernel_height
+                           : kernel_width * kernel_height;
+  int i;
+  for (i = 0; i < nweights; i++)
+    if (! isfinite (kernel[i]))
+      return -1;
+
+  // Set up the kernel
+  Convolution convolution;
+  convolution.width = kernel_width;
+  convolution.height = kernel_height;
+  convolution.separable = separable;
+  convolution.alpha = gimp_drawable_has_alpha (drawable);
+  convolution.weights = g_new (float, nweights);
+  for (i = 0; i < nweights; i++)
+    convolution.weights[i] = (float) kernel[i];
+
+  // And do the work
+  int result =
+    drawable_map_tiles_halo (drawable, x, y, width, height,
+                             MAX (kernel_width, kernel_height) / 2,
+                             convolve_job, &convolution);
+  g_free (convolution.weights);
+  return result;
+} // drawable_convolve
@@ -0,0 +1,97 @@
+#ifndef __CONVOLVE_H__
+#define __CONVOLVE_H__
+
+/**
+ * convolve.h
+ *   Convolve a rectangle of a drawable with a kernel (blur, sharpen,
+ *   edge detection, and the like) without sending any pixels to the
+ *   client.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  A kernel has odd width and height (so that it has a center pixel)
+  and is applied as given, without normalizing it, to every channel,
+  including alpha.  Each new pixel is the weighted sum of the old
+  pixels around it, clamped to [0,255] and rounded.  When the drawable
+  has alpha, the colors are premultiplied by alpha first and divided
+  by the new alpha afterwards, so that the colors of transparent
+  pixels do not bleed into their neighbors.  Past the edges of the
+  drawable, the edge pixels repeat.  Only the pixels in the rectangle
+  change, but the pixels around it are used.
+
+  A general kernel is given as kernel_height rows of kernel_width
+  weights.  A separable kernel (one that is the product of a row and
+  a column, such as a Gaussian blur) is given as the kernel_width
+  weights of the row followed by the kernel_height weights of the
+  column, and costs kernel_width + kernel_height multiplications per
+  channel rather than kernel_width * kernel_height.
+
+  The work is done a tile at a time on the worker pool (see
+  drawable_map_tiles_halo), with each tile fetched along with enough
+  of its neighbors to cover the kernel, and written back through the
+  shadow, so the convolution can be undone.  Each pass runs down whole
+  rows with the vectorized filter kernels (see tile_kernel_fir_u8).
+
+  // Sample usage: a 5x5 box blur
+  double box[] = { 0.2, 0.2, 0.2, 0.2, 0.2,  0.2, 0.2, 0.2, 0.2, 0.2 };
+  drawable_convolve (drawable, 0, 0, width, height, box, 5, 5, TRUE);
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The largest width or height of a kernel.
+ */
+#define CONVOLVE_MAX_SIZE 63
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Convolve a rectangle of a drawable with a kernel_width by
+ * kernel_height kernel, laid out as described above.  Returns 0 on
+ * success and a negative number if the drawable, rectangle, or kernel
+ * is invalid.
+ */
+int drawable_convolve (int drawable, int x, int y, int width, int height,
+                       const double *kernel,
+                       int kernel_width, int kernel_height,
+                       gboolean separable);
+
+#endif // __CONVOLVE_H__
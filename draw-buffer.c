@@ -0,0 +1,225 @@
+/**
+ * draw-buffer.c
+ *   Support for drawing a whole sequence of turtle-style commands
+ *   (move, line, set color, set brush size, stroke) in one call.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <math.h>               // For ceil and floor
+
+#include "draw-buffer.h"
+#include "irgb.h"
+#include "mipmap.h"
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The state of the pen as we work through the commands.
+ */
+struct Pen
+  {
+    int drawable;
+    double x;
+    double y;
+    GArray *stroke;             // The (x,y) pairs of the current stroke
+    int strokes;                // The number of strokes painted so far
+    gboolean ok;                // Have all of the PDB calls succeeded?
+    double brush_size;          // The current brush diameter
+    double left;                // The bounds of what we have painted
+    double top;
+    double right;
+    double bottom;
+  };
+typedef struct Pen Pen;
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Add a point to the current stroke.
+ */
+static void
+pen_add_point (Pen *pen, double x, double y)
+{
+  g_array_append_val (pen->stroke, x);
+  g_array_append_val (pen->stroke, y);
+} // pen_add_point
+
+/**
+ * Grow the painted bounds to cover the current stroke, as painted with
+ * the current brush.
+ */
+static void
+pen_cover_stroke (Pen *pen)
+{
+  // Leave a pixel to spare for antialiasing
+  double radius = pen->brush_size / 2 + 1;
+  const gdouble *points = (const gdouble *) pen->stroke->data;
+  guint i;
+  for (i = 0; i + 1 < pen->stroke->len; i += 2)
+    {
+      pen->left = MIN (pen->left, points[i] - radius);
+      pen->top = MIN (pen->top, points[i + 1] - radius);
+      pen->right = MAX (pen->right, points[i] + radius);
+      pen->bottom = MAX (pen->bottom, points[i + 1] + radius);
+    } // for each point
+} // pen_cover_stroke
+
+/**
+ * Paint the current stroke (if there is one) and start a new one.
+ */
+static void
+pen_flush (Pen *pen)
+{
+  // A stroke needs at least two points (four coordinates)
+  if (pen->stroke->len >= 4)
+    {
+      pen_cover_stroke (pen);
+      if (! gimp_paintbrush_default (pen->drawable,
+                                     pen->stroke->len,
+                                     (gdouble *) pen->stroke->data))
+        pen->ok = FALSE;
+      ++(pen->strokes);
+    } // if there is a stroke
+  g_array_set_size (pen->stroke, 0);
+} // pen_flush
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+int
+draw_commands_validate (int n, const DrawCommand *commands)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      switch (commands[i].op)
+        {
+        case DRAW_MOVE:
+        case DRAW_LINE:
+        case DRAW_COLOR:
+        case DRAW_STROKE:
+          break;
+        case DRAW_BRUSH_SIZE:
+          if (commands[i].a <= 0)
+            return i;
+          break;
+        default:
+          return i;
+        } // switch
+    } // for each command
+  return -1;
+} // draw_commands_validate
+
+int
+draw_commands_run (int drawable, int n, const DrawCommand *commands)
+{
+  if (draw_commands_validate (n, commands) >= 0)
+    return -1;
+
+  int image = gimp_drawable_get_image (drawable);
+  Pen pen;
+  pen.drawable = drawable;
+  pen.x = 0;
+  pen.y = 0;
+  pen.stroke = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  pen.strokes = 0;
+  pen.ok = TRUE;
+  pen.left = pen.top = G_MAXDOUBLE;
+  pen.right = pen.bottom = -G_MAXDOUBLE;
+
+  // Make the whole drawing a single undo step, and don't clobber the
+  // user's color and brush.
+  gimp_image_undo_group_start (image);
+  gimp_context_push ();
+  pen.brush_size = gimp_context_get_brush_size ();
+
+  int i;
+  GimpRGB color;
+  for (i = 0; (i < n) && pen.ok; i++)
+    {
+      const DrawCommand *command = &(commands[i]);
+      switch (command->op)
+        {
+        case DRAW_MOVE:
+          pen_flush (&pen);
+          pen.x = command->a;
+          pen.y = command->b;
+          break;
+
+        case DRAW_LINE:
+          // Consecutive lines extend the current stroke
+          if (pen.stroke->len == 0)
+            pen_add_point (&pen, pen.x, pen.y);
+          pen_add_point (&pen, command->a, command->b);
+          pen.x = command->a;
+          pen.y = command->b;
+          break;
+
+        case DRAW_COLOR:
+          pen_flush (&pen);
+          gimp_rgb_set_uchar (&color, 
+                              IRGB_RED ((int) command->a),
+                              IRGB_GREEN ((int) command->a),
+                              IRGB_BLUE ((int) command->a));
+          pen.ok = gimp_context_set_foreground (&color);
+          break;
+
+        case DRAW_BRUSH_SIZE:
+          pen_flush (&pen);
+          pen.ok = gimp_context_set_brush_size (command->a);
+          pen.brush_size = command->a;
+          break;
+
+        case DRAW_STROKE:
+          pen_flush (&pen);
+          break;
+        } // switch
+    } // for each command
+  if (pen.ok)
+    pen_flush (&pen);
+
+  // Clean up
+  gimp_context_pop ();
+  gimp_image_undo_group_end (image);
+  g_array_free (pen.stroke, TRUE);
+  if (pen.strokes > 0)
+    {
+      int left = (int) floor (pen.left);
+      int top = (int) floor (pen.top);
+      mipmap_invalidate (drawable, left, top,
+                         (int) ceil (pen.right) - left,
+                         (int) ceil (pen.bottom) - top);
+    } // if we painted anything
+  gimp_displays_flush ();
+
+  // And we're done
+  return pen.ok ? pen.strokes : -1;
+} // draw_commands_run
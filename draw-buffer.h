@@ -0,0 +1,104 @@
+#ifndef __DRAW_BUFFER_H__
+#define __DRAW_BUFFER_H__
+
+/**
+ * draw-buffer.h
+ *   Support for drawing a whole sequence of turtle-style commands
+ *   (move, line, set color, set brush size, stroke) in one call.
+ *   Consecutive line segments are coalesced into a single paintbrush
+ *   stroke, so a drawing of thousands of segments needs only a
+ *   handful of PDB calls.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  // Sample usage: A red square with sides of length 10.
+  DrawCommand square[] =
+    {
+      { DRAW_COLOR, 0xFF0000, 0 },
+      { DRAW_BRUSH_SIZE, 3, 0 },
+      { DRAW_MOVE, 10, 10 },
+      { DRAW_LINE, 20, 10 },
+      { DRAW_LINE, 20, 20 },
+      { DRAW_LINE, 10, 20 },
+      { DRAW_LINE, 10, 10 }
+    };
+  draw_commands_run (drawable, G_N_ELEMENTS (square), square);
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The kinds of drawing commands.
+ */
+enum DrawOp
+  {
+    DRAW_MOVE = 0,              // Move the pen to (a,b) without drawing
+    DRAW_LINE = 1,              // Draw a line from the pen to (a,b)
+    DRAW_COLOR = 2,             // Set the color to irgb color a
+    DRAW_BRUSH_SIZE = 3,        // Set the brush size to a
+    DRAW_STROKE = 4             // Finish the current stroke
+  };
+typedef enum DrawOp DrawOp;
+
+/**
+ * One drawing command.  The meaning of a and b depends on the op.
+ */
+struct DrawCommand
+  {
+    int op;
+    double a;
+    double b;
+  };
+typedef struct DrawCommand DrawCommand;
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Determine if a sequence of commands is valid.  Returns the index of
+ * the first invalid command, or -1 if they are all valid.
+ */
+int draw_commands_validate (int n, const DrawCommand *commands);
+
+/**
+ * Draw a sequence of commands on a drawable, as a single undo step.
+ * The pen starts at (0,0).  The color and brush size start out as
+ * they are in the current context, and that context is restored when
+ * we're done.  Returns the number of strokes painted or a negative
+ * number if something went wrong.
+ */
+int draw_commands_run (int drawable, int n, const DrawCommand *commands);
+
+#endif // __DRAW_BUFFER_H__
@@ -0,0 +1,235 @@
+/**
+ * irgb-test.c
+ *   Check that every vectorized batch conversion between pixels and
+ *   integer colors computes exactly the same values as its scalar
+ *   counterpart.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Like kernel-test, we include irgb.c itself, so that we can get at
+  each table of kernels rather than just the one that the dispatcher
+  picks.  Only the tables that this processor supports are tested.
+
+  Usage: irgb-test          check every kernel against scalar
+
+  (Or "make check" from the top directory.)
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../irgb.c"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The most pixels we test at once.
+ */
+#define MAX_PIXELS 1100
+
+/**
+ * The kernels we check.
+ */
+enum
+  {
+    PACK_PLANES, UNPACK_PLANES, FROM_RGBA, TO_RGBA, PIXELS_TO_INTS,
+    INTS_TO_PIXELS, NKERNELS
+  };
+
+static const char *kernel_names[NKERNELS] =
+  {
+    "pack_planes", "unpack_planes", "from_rgba", "to_rgba",
+    "pixels_to_ints", "ints_to_pixels"
+  };
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * Everything one run of a kernel reads and writes.
+ */
+struct Work
+  {
+    guchar planes[3][MAX_PIXELS + 16];
+    guchar pixels[MAX_PIXELS * 4 + 16];
+    guint32 ints[MAX_PIXELS + 16];
+  };
+typedef struct Work Work;
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Get the kernel tables that this processor supports, scalar first.
+ * Returns the number of tables.
+ */
+static int
+supported_kernels (const IrgbKernels **tables)
+{
+  int n = 0;
+  tables[n++] = &scalar_kernels;
+#ifdef HAVE_X86_SIMD
+  if (SIMD_CPU_SUPPORTS ("sse2"))
+    tables[n++] = &sse2_kernels;
+  if (SIMD_CPU_SUPPORTS ("ssse3"))
+    tables[n++] = &ssse3_kernels;
+  if (SIMD_CPU_SUPPORTS ("avx2"))
+    tables[n++] = &avx2_kernels;
+#endif
+  return n;
+} // supported_kernels
+
+/**
+ * Fill the inputs (and the outputs, so that stray writes show up)
+ * with random bytes.
+ */
+static void
+randomize (Work *work)
+{
+  guchar *bytes = (guchar *) work;
+  gsize i;
+  for (i = 0; i < sizeof (Work); i++)
+    bytes[i] = rand ();
+} // randomize
+
+/**
+ * Run one kernel from a table over n pixels, starting offset pixels
+ * into the buffers.  bpp and format only matter to the kernels that
+ * take them.
+ */
+static void
+run_kernel (const IrgbKernels *kernels, int kernel, int bpp,
+            IrgbFormat format, gsize n, int offset, Work *work)
+{
+  guchar *r = work->planes[0] + offset;
+  guchar *g = work->planes[1] + offset;
+  guchar *b = work->planes[2] + offset;
+  guchar *pixels = work->pixels + offset;
+  guint32 *ints = work->ints + offset;
+  switch (kernel)
+    {
+      case PACK_PLANES:
+        kernels->pack_planes (r, g, b, (gint32 *) ints, n);
+        break;
+      case UNPACK_PLANES:
+        kernels->unpack_planes ((const gint32 *) ints, r, g, b, n);
+        break;
+      case FROM_RGBA:
+        kernels->from_rgba (pixels, (gint32 *) ints, n);
+        break;
+      case TO_RGBA:
+        kernels->to_rgba ((const gint32 *) ints, pixels, n);
+        break;
+      case PIXELS_TO_INTS:
+        kernels->pixels_to_ints (pixels, bpp, ints, n, format);
+        break;
+      case INTS_TO_PIXELS:
+        kernels->ints_to_pixels (ints, format, pixels, bpp, n);
+        break;
+    } // switch
+} // run_kernel
+
+/**
+ * Compare one kernel of a vector table with the scalar kernel over
+ * many sizes and alignments.  Returns the number of mismatches.
+ */
+static int
+check_kernel (const IrgbKernels *kernels, int kernel, int bpp,
+              IrgbFormat format)
+{
+  static Work expected, actual;
+  static const gsize sizes[] =
+    { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+      100, 1000, MAX_PIXELS };
+  int failures = 0;
+  int i, offset;
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    for (offset = 0; offset < 3; offset++)
+      {
+        gsize n = sizes[i];
+        randomize (&expected);
+        memcpy (&actual, &expected, sizeof (Work));
+        run_kernel (&scalar_kernels, kernel, bpp, format, n, offset,
+                    &expected);
+        run_kernel (kernels, kernel, bpp, format, n, offset, &actual);
+        if (memcmp (&expected, &actual, sizeof (Work)) != 0)
+          {
+            printf ("FAIL: %s %s, bpp %d, format %d, %lu pixels, "
+                    "offset %d\n",
+                    kernels->name, kernel_names[kernel], bpp, format,
+                    (unsigned long) n, offset);
+            ++failures;
+          } // if the results differ
+      } // for each size and offset
+  return failures;
+} // check_kernel
+
+
+// +------+------------------------------------------------------------
+// | Main |
+// +------+
+
+int
+main (int argc, char *argv[])
+{
+  const IrgbKernels *tables[4];
+  int ntables = supported_kernels (tables);
+  int failures = 0;
+  int t, kernel, bpp, format;
+
+  for (t = 1; t < ntables; t++)
+    {
+      for (kernel = 0; kernel < NKERNELS; kernel++)
+        {
+          // Only the conversions to and from pixels care about the
+          // bpp and format
+          if ((kernel != PIXELS_TO_INTS) && (kernel != INTS_TO_PIXELS))
+            {
+              failures += check_kernel (tables[t], kernel, 4,
+                                        IRGB_FORMAT_IRGB);
+              continue;
+            } // if the kernel works on one layout
+          for (bpp = 1; bpp <= 4; bpp++)
+            for (format = IRGB_FORMAT_IRGB; format <= IRGB_FORMAT_RGBA32;
+                 format++)
+              failures += check_kernel (tables[t], kernel, bpp, format);
+        } // for each kernel
+      printf ("checked %s kernels\n", tables[t]->name);
+    } // for each vector table
+  printf ("%d failures\n", failures);
+
+  return (failures == 0) ? 0 : 1;
+} // main
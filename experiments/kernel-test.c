@@ -0,0 +1,358 @@
+/**
+ * kernel-test.c
+ *   Check that every vectorized tile kernel computes exactly the same
+ *   bytes as its scalar counterpart, and time each kernel.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  We include tile-kernels.c itself, so that we can get at each table
+  of kernels (scalar, SSE2, SSSE3, AVX2) rather than just the one
+  that the dispatcher picks.  Only the tables that this processor
+  supports are tested.
+
+  Usage: kernel-test          check every kernel against scalar
+         kernel-test bench    also report each kernel's throughput
+
+  (Or "make check" and "make bench" from the top directory.)
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../tile-kernels.c"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The most pixels we test at once.
+ */
+#define MAX_PIXELS 4200
+
+/**
+ * The pixels in each benchmark pass (a 64x64 tile).
+ */
+#define BENCH_PIXELS (64 * 64)
+
+/**
+ * The taps for the filter kernels.
+ */
+#define TAPS 5
+
+/**
+ * The kernels we check.
+ */
+enum
+  {
+    INVERT, AFFINE, CLAMP, SWIZZLE, PREMULTIPLY, UNPREMULTIPLY,
+    BLEND_OVER, MATCH, FIR_U8, FIR_F32, RESAMPLE_F32, DEINTERLEAVE,
+    INTERLEAVE, NKERNELS
+  };
+
+static const char *kernel_names[NKERNELS] =
+  {
+    "invert", "affine", "clamp", "swizzle", "premultiply",
+    "unpremultiply", "blend_over", "match", "fir_u8", "fir_f32",
+    "resample_f32", "deinterleave", "interleave"
+  };
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The parameters to the kernels, shared by the scalar and vector runs.
+ */
+struct Params
+  {
+    int scales[4];
+    int offsets[4];
+    guchar lo[4];
+    guchar hi[4];
+    int map[4];
+    float weights[TAPS];
+    int starts[MAX_PIXELS];     // For resampling
+    float resample_weights[MAX_PIXELS * TAPS];
+  };
+typedef struct Params Params;
+
+/**
+ * Everything one run of a kernel reads and writes.
+ */
+struct Work
+  {
+    guchar pixels[MAX_PIXELS * 4 + 64];
+    guchar source[MAX_PIXELS * 4 + 64];
+    float floats[MAX_PIXELS * 4 + TAPS * 4];
+    float sums[MAX_PIXELS * 4];
+    guint64 match_sums[4];
+    gssize first;
+    gssize last;
+    gsize count;
+  };
+typedef struct Work Work;
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Get the kernel tables that this processor supports, scalar first.
+ * Returns the number of tables.
+ */
+static int
+supported_kernels (const TileKernels **tables)
+{
+  int n = 0;
+  tables[n++] = &scalar_kernels;
+#ifdef HAVE_X86_SIMD
+  if (SIMD_CPU_SUPPORTS ("sse2"))
+    tables[n++] = &sse2_kernels;
+  if (SIMD_CPU_SUPPORTS ("ssse3"))
+    tables[n++] = &ssse3_kernels;
+  if (SIMD_CPU_SUPPORTS ("avx2"))
+    tables[n++] = &avx2_kernels;
+#endif
+  return n;
+} // supported_kernels
+
+/**
+ * Fill in random parameters and inputs.  Some pixels are made fully
+ * transparent or fully opaque, since those are special cases for the
+ * alpha kernels.
+ */
+static void
+randomize (Params *params, Work *work, int bpp)
+{
+  int c, i;
+  for (c = 0; c < 4; c++)
+    {
+      params->scales[c] = rand () % 600;
+      params->offsets[c] = rand () % 300 - 150;
+      params->lo[c] = rand () % 128;
+      params->hi[c] = 128 + rand () % 128;
+      params->map[c] = rand () % bpp;
+    } // for each channel
+  for (i = 0; i < TAPS; i++)
+    params->weights[i] = (rand () % 2001 - 1000) / 1500.0f;
+  for (i = 0; i < MAX_PIXELS; i++)
+    params->starts[i] = rand () % (MAX_PIXELS + 1);
+  for (i = 0; i < MAX_PIXELS * TAPS; i++)
+    params->resample_weights[i] = (rand () % 2001 - 1000) / 1500.0f;
+  for (i = 0; i < sizeof (work->pixels); i++)
+    {
+      work->pixels[i] = rand ();
+      work->source[i] = rand ();
+    } // for each byte
+  if (has_alpha (bpp))
+    for (i = 0; i < MAX_PIXELS; i += 7)
+      work->pixels[i * bpp + bpp - 1] = (i % 2) ? 0 : 255;
+  for (i = 0; i < sizeof (work->floats) / sizeof (float); i++)
+    work->floats[i] = (rand () % 40000 - 10000) / 97.0f;
+  memset (work->sums, 0, sizeof (work->sums));
+} // randomize
+
+/**
+ * Run one kernel from a table over n pixels of bpp bytes, starting
+ * offset bytes into the buffers.
+ */
+static void
+run_kernel (const TileKernels *kernels, int kernel, int bpp, gsize n,
+            int offset, const Params *params, Work *work)
+{
+  guchar *pixels = work->pixels + offset;
+  switch (kernel)
+    {
+      case INVERT:
+        kernels->invert (pixels, bpp, n);
+        break;
+      case AFFINE:
+        kernels->affine (pixels, bpp, n, params->scales, params->offsets);
+        break;
+      case CLAMP:
+        kernels->clamp (pixels, bpp, n, params->lo, params->hi);
+        break;
+      case SWIZZLE:
+        kernels->swizzle (pixels, bpp, n, params->map);
+        break;
+      case PREMULTIPLY:
+        kernels->premultiply (pixels, bpp, n);
+        break;
+      case UNPREMULTIPLY:
+        kernels->unpremultiply (pixels, bpp, n);
+        break;
+      case BLEND_OVER:
+        kernels->blend_over (work->source + offset, pixels, bpp, n);
+        break;
+      case MATCH:
+        memset (work->match_sums, 0, sizeof (work->match_sums));
+        work->count = kernels->match (pixels, bpp, n, params->lo, params->hi,
+                                      work->match_sums,
+                                      &work->first, &work->last);
+        break;
+      case FIR_U8:
+        kernels->fir_u8 (pixels, bpp, work->sums, n * bpp,
+                         params->weights, TAPS);
+        break;
+      case FIR_F32:
+        kernels->fir_f32 (work->floats, bpp, pixels, n * bpp,
+                          params->weights, TAPS);
+        break;
+      case RESAMPLE_F32:
+        kernels->resample_f32 (work->floats, bpp, pixels, n,
+                               params->starts, params->resample_weights,
+                               TAPS);
+        break;
+      case DEINTERLEAVE:
+        kernels->deinterleave (work->source + offset, bpp, work->pixels, n, n);
+        break;
+      case INTERLEAVE:
+        kernels->interleave (work->source + offset, n, bpp, work->pixels, n);
+        break;
+    } // switch
+} // run_kernel
+
+/**
+ * Compare one kernel of a vector table with the scalar kernel over
+ * many sizes and alignments.  Returns the number of mismatches.
+ */
+static int
+check_kernel (const TileKernels *kernels, int kernel, int bpp)
+{
+  static Work expected, actual;
+  static Params params;
+  static const gsize sizes[] =
+    { 0, 1, 2, 3, 5, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+      100, 127, 128, 129, 1000, MAX_PIXELS - TAPS };
+  int failures = 0;
+  int i, offset;
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    for (offset = 0; offset < 3; offset++)
+      {
+        gsize n = sizes[i];
+        randomize (&params, &expected, bpp);
+        memcpy (&actual, &expected, sizeof (Work));
+        run_kernel (&scalar_kernels, kernel, bpp, n, offset,
+                    &params, &expected);
+        run_kernel (kernels, kernel, bpp, n, offset, &params, &actual);
+        gboolean same =
+          (memcmp (expected.pixels, actual.pixels,
+                   sizeof (expected.pixels)) == 0)
+          && (memcmp (expected.sums, actual.sums,
+                      sizeof (expected.sums)) == 0);
+        if (kernel == MATCH)
+          same = same && (expected.count == actual.count)
+                 && (expected.first == actual.first)
+                 && (expected.last == actual.last)
+                 && (memcmp (expected.match_sums, actual.match_sums,
+                             sizeof (expected.match_sums)) == 0);
+        if (! same)
+          {
+            printf ("FAIL: %s %s, bpp %d, %lu pixels, offset %d\n",
+                    kernels->name, kernel_names[kernel], bpp,
+                    (unsigned long) n, offset);
+            ++failures;
+          } // if the results differ
+      } // for each size and offset
+  return failures;
+} // check_kernel
+
+/**
+ * Time one kernel of a table over a tile's worth of pixels, and
+ * report the throughput in millions of pixels per second.
+ */
+static void
+bench_kernel (const TileKernels *kernels, int kernel, int bpp)
+{
+  static Work work;
+  static Params params;
+  int passes = 0;
+  randomize (&params, &work, bpp);
+  gint64 start = g_get_monotonic_time ();
+  gint64 elapsed;
+  do
+    {
+      int i;
+      for (i = 0; i < 100; i++)
+        run_kernel (kernels, kernel, bpp, BENCH_PIXELS, 0, &params, &work);
+      passes += 100;
+      elapsed = g_get_monotonic_time () - start;
+    } // do
+  while (elapsed < 100000);
+  printf ("  %-14s bpp %d: %8.1f Mpixels/s\n", kernel_names[kernel], bpp,
+          (double) passes * BENCH_PIXELS / elapsed);
+} // bench_kernel
+
+
+// +------+------------------------------------------------------------
+// | Main |
+// +------+
+
+int
+main (int argc, char *argv[])
+{
+  const TileKernels *tables[4];
+  int ntables = supported_kernels (tables);
+  gboolean bench = (argc > 1) && (strcmp (argv[1], "bench") == 0);
+  int failures = 0;
+  int t, kernel, bpp;
+
+  // Check every vector kernel against the scalar one
+  for (t = 1; t < ntables; t++)
+    {
+      for (kernel = 0; kernel < NKERNELS; kernel++)
+        for (bpp = 1; bpp <= 4; bpp++)
+          failures += check_kernel (tables[t], kernel, bpp);
+      printf ("checked %s kernels\n", tables[t]->name);
+    } // for each vector table
+  printf ("%d failures\n", failures);
+
+  // Time them all
+  if (bench)
+    for (t = 0; t < ntables; t++)
+      {
+        printf ("%s:\n", tables[t]->name);
+        for (kernel = 0; kernel < NKERNELS; kernel++)
+          for (bpp = 1; bpp <= 4; bpp++)
+            {
+              // The alpha kernels do nothing without alpha
+              if (((kernel == PREMULTIPLY) || (kernel == UNPREMULTIPLY)
+                   || (kernel == BLEND_OVER))
+                  && ! has_alpha (bpp))
+                continue;
+              bench_kernel (tables[t], kernel, bpp);
+            } // for each bpp
+      } // for each table
+
+  return (failures == 0) ? 0 : 1;
+} // main
@@ -0,0 +1,515 @@
+/**
+ * pixel-vm-test.c
+ *   Check that pixel programs compute what pixel-vm.h says they do,
+ *   and that the validator rejects every malformed instruction.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Programs can only get values out through STORE, which clamps, so
+  to see a whole register we append a few instructions that split
+  register 0 into four bytes and store one in each channel of an
+  RGBA pixel.  Those instructions use registers 10 through 15, so the
+  programs under test stick to registers 0 through 9.
+
+  Every program runs over more than PIXEL_VM_LANES pixels, so that
+  both full and partial batches are checked.
+
+  Usage: pixel-vm-test        run every check
+
+  (Or "make check" from the top directory.)
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../pixel-vm.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The number of pixels we run each program over.
+ */
+#define PIXELS (2 * PIXEL_VM_LANES + 5)
+
+/**
+ * The most instructions in one of our programs.
+ */
+#define MAX_CODE 8
+
+
+// +--------+----------------------------------------------------------
+// | Macros |
+// +--------+
+
+/**
+ * One instruction, without the PIXEL_OP_ prefix.
+ */
+#define I(OP,DST,A,B,C) { PIXEL_OP_##OP, DST, A, B, C }
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * A program and the value it should leave in register 0.
+ */
+struct ValueCase
+  {
+    const char *name;
+    int n;
+    PixelInstruction code[MAX_CODE];
+    gint32 expected;
+  };
+typedef struct ValueCase ValueCase;
+
+/**
+ * A program and what it should do to a pixel.
+ */
+struct PixelCase
+  {
+    const char *name;
+    int bpp;
+    guchar pixel[4];
+    int n;
+    PixelInstruction code[MAX_CODE];
+    guchar expected[4];
+  };
+typedef struct PixelCase PixelCase;
+
+/**
+ * An invalid program and the index the validator should report.
+ */
+struct InvalidCase
+  {
+    const char *name;
+    int n;
+    PixelInstruction code[MAX_CODE];
+    int expected;
+  };
+typedef struct InvalidCase InvalidCase;
+
+
+// +-------+-----------------------------------------------------------
+// | Cases |
+// +-------+
+
+static const ValueCase value_cases[] =
+  {
+    { "const", 1, { I (CONST, 0, 123456789, 0, 0) }, 123456789 },
+    { "negative const", 1, { I (CONST, 0, -42, 0, 0) }, -42 },
+    { "registers start at zero", 0, { }, 0 },
+    { "load red", 1, { I (LOAD, 0, 0, 0, 0) }, 10 },
+    { "load green", 1, { I (LOAD, 0, 1, 0, 0) }, 20 },
+    { "load blue", 1, { I (LOAD, 0, 2, 0, 0) }, 30 },
+    { "load alpha", 1, { I (LOAD, 0, 3, 0, 0) }, 40 },
+    { "y", 1, { I (Y, 0, 0, 0, 0) }, 7 },
+    { "add", 3,
+      { I (CONST, 1, 2, 0, 0), I (CONST, 2, -5, 0, 0),
+        I (ADD, 0, 1, 2, 0) }, -3 },
+    { "add wraps", 3,
+      { I (CONST, 1, G_MAXINT32, 0, 0), I (CONST, 2, 1, 0, 0),
+        I (ADD, 0, 1, 2, 0) }, G_MININT32 },
+    { "sub", 3,
+      { I (CONST, 1, 2, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (SUB, 0, 1, 2, 0) }, -3 },
+    { "sub wraps", 3,
+      { I (CONST, 1, G_MININT32, 0, 0), I (CONST, 2, 1, 0, 0),
+        I (SUB, 0, 1, 2, 0) }, G_MAXINT32 },
+    { "mul", 3,
+      { I (CONST, 1, -7, 0, 0), I (CONST, 2, 6, 0, 0),
+        I (MUL, 0, 1, 2, 0) }, -42 },
+    { "mul wraps", 3,
+      { I (CONST, 1, 65537, 0, 0), I (CONST, 2, 65536, 0, 0),
+        I (MUL, 0, 1, 2, 0) }, 65536 },
+    { "div", 3,
+      { I (CONST, 1, 7, 0, 0), I (CONST, 2, 2, 0, 0),
+        I (DIV, 0, 1, 2, 0) }, 3 },
+    { "div rounds toward zero", 3,
+      { I (CONST, 1, -7, 0, 0), I (CONST, 2, 2, 0, 0),
+        I (DIV, 0, 1, 2, 0) }, -3 },
+    { "div by -1", 3,
+      { I (CONST, 1, 9, 0, 0), I (CONST, 2, -1, 0, 0),
+        I (DIV, 0, 1, 2, 0) }, -9 },
+    { "div by 0", 3,
+      { I (CONST, 1, 7, 0, 0), I (CONST, 2, 0, 0, 0),
+        I (DIV, 0, 1, 2, 0) }, 0 },
+    { "div of G_MININT32 by -1", 3,
+      { I (CONST, 1, G_MININT32, 0, 0), I (CONST, 2, -1, 0, 0),
+        I (DIV, 0, 1, 2, 0) }, G_MININT32 },
+    { "min", 3,
+      { I (CONST, 1, -3, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (MIN, 0, 1, 2, 0) }, -3 },
+    { "max", 3,
+      { I (CONST, 1, -3, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (MAX, 0, 1, 2, 0) }, 5 },
+    { "lt true", 3,
+      { I (CONST, 1, -3, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (LT, 0, 1, 2, 0) }, 1 },
+    { "lt false", 3,
+      { I (CONST, 1, 5, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (LT, 0, 1, 2, 0) }, 0 },
+    { "eq true", 3,
+      { I (CONST, 1, 5, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (EQ, 0, 1, 2, 0) }, 1 },
+    { "eq false", 3,
+      { I (CONST, 1, 4, 0, 0), I (CONST, 2, 5, 0, 0),
+        I (EQ, 0, 1, 2, 0) }, 0 },
+    { "select nonzero", 4,
+      { I (CONST, 1, -1, 0, 0), I (CONST, 2, 11, 0, 0),
+        I (CONST, 3, 22, 0, 0), I (SELECT, 0, 1, 2, 3) }, 11 },
+    { "select zero", 4,
+      { I (CONST, 1, 0, 0, 0), I (CONST, 2, 11, 0, 0),
+        I (CONST, 3, 22, 0, 0), I (SELECT, 0, 1, 2, 3) }, 22 },
+    { "shr", 3,
+      { I (CONST, 1, 256, 0, 0), I (CONST, 2, 3, 0, 0),
+        I (SHR, 0, 1, 2, 0) }, 32 },
+    { "shr is arithmetic", 3,
+      { I (CONST, 1, -16, 0, 0), I (CONST, 2, 2, 0, 0),
+        I (SHR, 0, 1, 2, 0) }, -4 },
+    { "shr by 32", 3,
+      { I (CONST, 1, 256, 0, 0), I (CONST, 2, 32, 0, 0),
+        I (SHR, 0, 1, 2, 0) }, 256 },
+    { "shr by 33", 3,
+      { I (CONST, 1, 256, 0, 0), I (CONST, 2, 33, 0, 0),
+        I (SHR, 0, 1, 2, 0) }, 128 },
+    { "shr by -1", 3,
+      { I (CONST, 1, G_MININT32, 0, 0), I (CONST, 2, -1, 0, 0),
+        I (SHR, 0, 1, 2, 0) }, -1 },
+    { "store leaves registers alone", 3,
+      { I (CONST, 0, 300, 0, 0), I (STORE, 0, 0, 0, 0),
+        I (STORE, 3, 0, 0, 0) }, 300 },
+  };
+
+static const PixelCase pixel_cases[] =
+  {
+    { "gray loads", 1, { 77 }, 4,
+      { I (LOAD, 0, 1, 0, 0), I (STORE, 0, 0, 0, 0), I (STORE, 1, 0, 0, 0),
+        I (STORE, 2, 0, 0, 0) }, { 77 } },
+    { "gray without alpha loads opaque", 1, { 77 }, 4,
+      { I (LOAD, 0, 3, 0, 0), I (STORE, 0, 0, 0, 0), I (STORE, 1, 0, 0, 0),
+        I (STORE, 2, 0, 0, 0) }, { 255 } },
+    { "gray alpha loads", 2, { 77, 9 }, 4,
+      { I (LOAD, 0, 3, 0, 0), I (STORE, 0, 0, 0, 0), I (STORE, 1, 0, 0, 0),
+        I (STORE, 2, 0, 0, 0) }, { 9, 9 } },
+    { "rgb without alpha loads opaque", 3, { 1, 2, 3 }, 2,
+      { I (LOAD, 0, 3, 0, 0), I (STORE, 1, 0, 0, 0) }, { 1, 255, 3 } },
+    { "gray stores luminance", 1, { 50 }, 2,
+      { I (CONST, 0, 255, 0, 0), I (STORE, 0, 0, 0, 0) }, { 93 } },
+    { "gray alpha stores alpha", 2, { 10, 20 }, 2,
+      { I (CONST, 0, 99, 0, 0), I (STORE, 3, 0, 0, 0) }, { 10, 99 } },
+    { "gray alpha stores luminance", 2, { 10, 20 }, 4,
+      { I (CONST, 0, 200, 0, 0), I (STORE, 0, 0, 0, 0),
+        I (STORE, 1, 0, 0, 0), I (STORE, 2, 0, 0, 0) }, { 200, 20 } },
+    { "rgb ignores stored alpha", 3, { 1, 2, 3 }, 2,
+      { I (CONST, 0, 0, 0, 0), I (STORE, 3, 0, 0, 0) }, { 1, 2, 3 } },
+    { "rgba stores", 4, { 1, 2, 3, 4 }, 3,
+      { I (CONST, 0, 99, 0, 0), I (STORE, 1, 0, 0, 0),
+        I (STORE, 3, 0, 0, 0) }, { 1, 99, 3, 99 } },
+    { "store clamps", 4, { 1, 2, 3, 4 }, 4,
+      { I (CONST, 0, -5, 0, 0), I (CONST, 1, 300, 0, 0),
+        I (STORE, 0, 0, 0, 0), I (STORE, 2, 1, 0, 0) }, { 0, 2, 255, 4 } },
+    { "loads see the original pixel", 4, { 1, 2, 3, 4 }, 4,
+      { I (CONST, 0, 99, 0, 0), I (STORE, 0, 0, 0, 0),
+        I (LOAD, 1, 0, 0, 0), I (STORE, 1, 1, 0, 0) }, { 99, 1, 3, 4 } },
+    { "no stores", 3, { 1, 2, 3 }, 1,
+      { I (CONST, 0, 99, 0, 0) }, { 1, 2, 3 } },
+  };
+
+static const InvalidCase invalid_cases[] =
+  {
+    { "negative op", 1, { { -1, 0, 0, 0, 0 } }, 0 },
+    { "unknown op", 1, { { PIXEL_OP_COUNT, 0, 0, 0, 0 } }, 0 },
+    { "const dst", 1, { I (CONST, PIXEL_VM_REGISTERS, 0, 0, 0) }, 0 },
+    { "x dst", 1, { I (X, -1, 0, 0, 0) }, 0 },
+    { "y dst", 1, { I (Y, PIXEL_VM_REGISTERS, 0, 0, 0) }, 0 },
+    { "load dst", 1, { I (LOAD, -1, 0, 0, 0) }, 0 },
+    { "load channel", 1, { I (LOAD, 0, 4, 0, 0) }, 0 },
+    { "add a", 1, { I (ADD, 0, PIXEL_VM_REGISTERS, 0, 0) }, 0 },
+    { "sub b", 1, { I (SUB, 0, 0, -1, 0) }, 0 },
+    { "mul dst", 1, { I (MUL, PIXEL_VM_REGISTERS, 0, 0, 0) }, 0 },
+    { "div b", 1, { I (DIV, 0, 0, PIXEL_VM_REGISTERS, 0) }, 0 },
+    { "min a", 1, { I (MIN, 0, -1, 0, 0) }, 0 },
+    { "max b", 1, { I (MAX, 0, 0, PIXEL_VM_REGISTERS, 0) }, 0 },
+    { "lt dst", 1, { I (LT, -1, 0, 0, 0) }, 0 },
+    { "eq a", 1, { I (EQ, 0, PIXEL_VM_REGISTERS, 0, 0) }, 0 },
+    { "shr b", 1, { I (SHR, 0, 0, -1, 0) }, 0 },
+    { "select c", 1, { I (SELECT, 0, 0, 0, PIXEL_VM_REGISTERS) }, 0 },
+    { "store channel", 1, { I (STORE, 4, 0, 0, 0) }, 0 },
+    { "store register", 1, { I (STORE, 0, PIXEL_VM_REGISTERS, 0, 0) }, 0 },
+    { "second instruction", 3,
+      { I (CONST, 15, 0, 0, 0), I (LOAD, 0, 15, 0, 0),
+        I (STORE, 99, 0, 0, 0) }, 1 },
+  };
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Run the n instructions in code over PIXELS copies of an RGBA pixel,
+ * starting at column x of row y, and put the final value of register
+ * 0 for each pixel in values.  Returns FALSE if the program is
+ * rejected.
+ */
+static gboolean
+evaluate (int n, const PixelInstruction *code, int x, int y,
+          gint32 *values)
+{
+  // Split register 0 into bytes, low byte first: b = v - (v >> 8) * 256
+  static const PixelInstruction split[] =
+    {
+      I (CONST, 15, 8, 0, 0), I (CONST, 14, 256, 0, 0),
+      I (CONST, 12, 0, 0, 0), I (ADD, 13, 0, 12, 0),
+      I (SHR, 11, 13, 15, 0), I (MUL, 10, 11, 14, 0),
+      I (SUB, 10, 13, 10, 0), I (STORE, 0, 10, 0, 0),
+      I (ADD, 13, 11, 12, 0),
+      I (SHR, 11, 13, 15, 0), I (MUL, 10, 11, 14, 0),
+      I (SUB, 10, 13, 10, 0), I (STORE, 1, 10, 0, 0),
+      I (ADD, 13, 11, 12, 0),
+      I (SHR, 11, 13, 15, 0), I (MUL, 10, 11, 14, 0),
+      I (SUB, 10, 13, 10, 0), I (STORE, 2, 10, 0, 0),
+      I (ADD, 13, 11, 12, 0),
+      I (SHR, 11, 13, 15, 0), I (MUL, 10, 11, 14, 0),
+      I (SUB, 10, 13, 10, 0), I (STORE, 3, 10, 0, 0)
+    };
+  PixelInstruction program_code[MAX_CODE + G_N_ELEMENTS (split)];
+  guchar pixels[PIXELS * 4];
+  PixelProgram *program;
+  int i;
+
+  memcpy (program_code, code, n * sizeof (PixelInstruction));
+  memcpy (program_code + n, split, sizeof (split));
+  program = pixel_program_new (n + G_N_ELEMENTS (split), program_code);
+  if (program == NULL)
+    return FALSE;
+
+  for (i = 0; i < PIXELS; i++)
+    {
+      pixels[4*i] = 10;
+      pixels[4*i + 1] = 20;
+      pixels[4*i + 2] = 30;
+      pixels[4*i + 3] = 40;
+    } // for each pixel
+  pixel_program_run (program, pixels, pixels, 4, PIXELS, x, y);
+  pixel_program_free (program);
+
+  for (i = 0; i < PIXELS; i++)
+    values[i] = (gint32) (pixels[4*i] | (pixels[4*i + 1] << 8)
+                          | (pixels[4*i + 2] << 16)
+                          | ((guint32) pixels[4*i + 3] << 24));
+  return TRUE;
+} // evaluate
+
+/**
+ * Check that a program leaves the expected value in register 0 of
+ * every pixel.  Returns the number of failures.
+ */
+static int
+check_value (const ValueCase *test)
+{
+  gint32 values[PIXELS];
+  int i;
+
+  if (! evaluate (test->n, test->code, 5, 7, values))
+    {
+      printf ("FAIL: %s: rejected\n", test->name);
+      return 1;
+    } // if the program was rejected
+  for (i = 0; i < PIXELS; i++)
+    if (values[i] != test->expected)
+      {
+        printf ("FAIL: %s: pixel %d got %d, expected %d\n",
+                test->name, i, values[i], test->expected);
+        return 1;
+      } // if the value is wrong
+  return 0;
+} // check_value
+
+/**
+ * Check that X counts columns from the start of the row, across
+ * batches.  Returns the number of failures.
+ */
+static int
+check_x (void)
+{
+  static const PixelInstruction code[] = { I (X, 0, 0, 0, 0) };
+  gint32 values[PIXELS];
+  int i;
+
+  evaluate (1, code, 5, 7, values);
+  for (i = 0; i < PIXELS; i++)
+    if (values[i] != 5 + i)
+      {
+        printf ("FAIL: x: pixel %d got %d, expected %d\n",
+                i, values[i], 5 + i);
+        return 1;
+      } // if the column is wrong
+  return 0;
+} // check_x
+
+/**
+ * Check that a program does the expected thing to every pixel, both
+ * in place and from one buffer to another.  Returns the number of
+ * failures.
+ */
+static int
+check_pixels (const PixelCase *test)
+{
+  guchar src[PIXELS * 4];
+  guchar dst[PIXELS * 4];
+  PixelProgram *program = pixel_program_new (test->n, test->code);
+  int bpp = test->bpp;
+  int failures = 0;
+  int in_place, i;
+
+  if (program == NULL)
+    {
+      printf ("FAIL: %s: rejected\n", test->name);
+      return 1;
+    } // if the program was rejected
+
+  for (in_place = 0; in_place < 2; in_place++)
+    {
+      guchar *out = in_place ? src : dst;
+      for (i = 0; i < PIXELS; i++)
+        memcpy (src + i * bpp, test->pixel, bpp);
+      memset (dst, 0xAA, sizeof (dst));
+      pixel_program_run (program, src, out, bpp, PIXELS, 0, 0);
+      for (i = 0; i < PIXELS; i++)
+        if (memcmp (out + i * bpp, test->expected, bpp) != 0)
+          {
+            printf ("FAIL: %s%s: pixel %d\n", test->name,
+                    in_place ? " (in place)" : "", i);
+            ++failures;
+            break;
+          } // if the pixel is wrong
+    } // for each kind of run
+
+  pixel_program_free (program);
+  return failures;
+} // check_pixels
+
+/**
+ * Check that the validator rejects a program at the expected
+ * instruction, and that no program gets built from it.  Returns the
+ * number of failures.
+ */
+static int
+check_invalid (const InvalidCase *test)
+{
+  int index = pixel_program_validate (test->n, test->code);
+  PixelProgram *program = pixel_program_new (test->n, test->code);
+  int failures = 0;
+
+  if (index != test->expected)
+    {
+      printf ("FAIL: validate %s: got %d, expected %d\n",
+              test->name, index, test->expected);
+      ++failures;
+    } // if the wrong instruction was reported
+  if (program != NULL)
+    {
+      printf ("FAIL: validate %s: built a program\n", test->name);
+      pixel_program_free (program);
+      ++failures;
+    } // if the program was built anyway
+  return failures;
+} // check_invalid
+
+/**
+ * Check the limits on program length and the largest registers and
+ * channels.  Returns the number of failures.
+ */
+static int
+check_limits (void)
+{
+  static PixelInstruction code[PIXEL_VM_MAX_INSTRUCTIONS + 1];
+  static const PixelInstruction edges[] =
+    {
+      I (LOAD, PIXEL_VM_REGISTERS - 1, 3, 0, 0),
+      I (SELECT, PIXEL_VM_REGISTERS - 1, PIXEL_VM_REGISTERS - 1,
+         PIXEL_VM_REGISTERS - 1, PIXEL_VM_REGISTERS - 1),
+      I (STORE, 3, PIXEL_VM_REGISTERS - 1, 0, 0)
+    };
+  int failures = 0;
+  int n;
+
+  // code is all CONST 0 0, which is valid
+  n = PIXEL_VM_MAX_INSTRUCTIONS;
+  if (pixel_program_validate (n, code) != -1)
+    {
+      printf ("FAIL: validate: rejected %d instructions\n", n);
+      ++failures;
+    } // if the longest program was rejected
+  n = PIXEL_VM_MAX_INSTRUCTIONS + 1;
+  if (pixel_program_validate (n, code) != n)
+    {
+      printf ("FAIL: validate: accepted %d instructions\n", n);
+      ++failures;
+    } // if a too-long program was accepted
+  if (pixel_program_new (-1, code) != NULL)
+    {
+      printf ("FAIL: validate: built a program of -1 instructions\n");
+      ++failures;
+    } // if a negative length was accepted
+  if (pixel_program_validate (G_N_ELEMENTS (edges), edges) != -1)
+    {
+      printf ("FAIL: validate: rejected the last register or channel\n");
+      ++failures;
+    } // if the edges were rejected
+  return failures;
+} // check_limits
+
+
+// +------+------------------------------------------------------------
+// | Main |
+// +------+
+
+int
+main (int argc, char *argv[])
+{
+  int failures = 0;
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (value_cases); i++)
+    failures += check_value (&value_cases[i]);
+  failures += check_x ();
+  for (i = 0; i < G_N_ELEMENTS (pixel_cases); i++)
+    failures += check_pixels (&pixel_cases[i]);
+  for (i = 0; i < G_N_ELEMENTS (invalid_cases); i++)
+    failures += check_invalid (&invalid_cases[i]);
+  failures += check_limits ();
+  printf ("%d failures\n", failures);
+
+  return (failures == 0) ? 0 : 1;
+} // main
@@ -3,6 +3,10 @@
  *   GIMP plugin to extract components of an integer-encoded RGB
  *   color.
  *
+ *   The D-Bus server provides the same operations natively (as
+ *   ggimp_irgb_red, ggimp_irgb_green, and ggimp_irgb_blue) without
+ *   starting a plug-in, so this plug-in is kept only for compatibility.
+ *
  * Copyright (c) 2013 Samuel A. Rebelsky
  *
  * This program is free software: you can redistribute it and/or modify
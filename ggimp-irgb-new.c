@@ -2,6 +2,10 @@
  * ggimp-irgb-new.c
  *   PDB function to create new integer-encoded RGB color.
  *
+ *   The D-Bus server provides the same operation natively (as
+ *   ggimp_irgb_new) without starting a plug-in, so this plug-in is
+ *   kept only for compatibility.
+ *
  * Copyright (c) 2013 Samuel A. Rebelsky
  *
  * This program is free software: you can redistribute it and/or modify
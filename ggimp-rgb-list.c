@@ -2,6 +2,10 @@
  * ggimp-rgb-list.c
  *   PDB function to list all the color names that GIMP knows about.
  *
+ *   The D-Bus server provides the same operation natively (as
+ *   ggimp_rgb_list) without starting a plug-in, so this plug-in is
+ *   kept only for compatibility.
+ *
  * Copyright (c) 2013 Mark Lewis, Samuel A. Rebelsky, and Christine Tran.
  *
  * This program is free software: you can redistribute it and/or modify
@@ -3,6 +3,10 @@
  *   PDB function to get the rgb color corresponding to a name of a color
  *   known in GIMP
  *
+ *   The D-Bus server provides the same operation natively (as
+ *   ggimp_rgb_parse) without starting a plug-in, so this plug-in is
+ *   kept only for compatibility.
+ *
  * Copyright (c) 2013 Mark Lewis and Christine Tran.
  *
  * This program is free software: you can redistribute it and/or modify
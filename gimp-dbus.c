@@ -40,6 +40,15 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "buffer-stream.h"
+#include "color-names.h"
+#include "convolve.h"
+#include "draw-buffer.h"
+#include "irgb.h"
+#include "mipmap.h"
+#include "region-stats.h"
+#include "resample.h"
+#include "tile-pool.h"
 #include "tile-stream.h"
 
 
@@ -72,6 +81,11 @@
  */
 #define GIMP_DBUS_INTERFACE_ADDITIONAL "edu.grinnell.cs.glimmer.gimpplus"
 
+/**
+ * The largest array that D-Bus will carry in a message.
+ */
+#define GIMP_DBUS_MAX_ARRAY_SIZE (64 * 1024 * 1024)
+
 /**
  * Where we put this service in the menu.
  */
@@ -287,15 +301,316 @@ g_dbus_arg_new (gchar                *name,
 static const gchar alt_introspection_xml[] = 
   "<node>"
   "  <interface name='" GIMP_DBUS_INTERFACE_ADDITIONAL "'>"
+  "    <method name='apply_lut'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='ay' name='tables' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='buffer_stream_advance'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='continues' direction='out'/>"
+  "    </method>"
+  "    <method name='buffer_stream_close'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "    </method>"
+  "    <method name='buffer_stream_get'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='size' direction='out'/>"
+  "      <arg type='ay' name='data' direction='out'/>"
+  "      <arg type='i' name='bpp' direction='out'/>"
+  "      <arg type='i' name='rowstride' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='buffer_stream_new'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='s' name='format' direction='in'/>"
+  "      <arg type='i' name='stream' direction='out'/>"
+  "    </method>"
+  "    <method name='buffer_stream_update'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='ay' name='data' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='convolve'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='ad' name='kernel' direction='in'/>"
+  "      <arg type='i' name='kernel_width' direction='in'/>"
+  "      <arg type='i' name='kernel_height' direction='in'/>"
+  "      <arg type='b' name='separable' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='draw_commands'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='a(idd)' name='commands' direction='in'/>"
+  "      <arg type='i' name='strokes' direction='out'/>"
+  "    </method>"
   "    <method name='ggimp_about'>"
   "      <arg type='s' name='result' direction='out'/>"
   "    </method>"
+  "    <method name='ggimp_irgb_blue'>"
+  "      <arg type='i' name='color' direction='in'/>"
+  "      <arg type='i' name='blue' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_from_rgba'>"
+  "      <arg type='ay' name='rgba' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_green'>"
+  "      <arg type='i' name='color' direction='in'/>"
+  "      <arg type='i' name='green' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_new'>"
+  "      <arg type='i' name='red' direction='in'/>"
+  "      <arg type='i' name='green' direction='in'/>"
+  "      <arg type='i' name='blue' direction='in'/>"
+  "      <arg type='i' name='color' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_pack'>"
+  "      <arg type='ay' name='red' direction='in'/>"
+  "      <arg type='ay' name='green' direction='in'/>"
+  "      <arg type='ay' name='blue' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_red'>"
+  "      <arg type='i' name='color' direction='in'/>"
+  "      <arg type='i' name='red' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_to_rgba'>"
+  "      <arg type='ai' name='colors' direction='in'/>"
+  "      <arg type='ay' name='rgba' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_irgb_unpack'>"
+  "      <arg type='ai' name='colors' direction='in'/>"
+  "      <arg type='ay' name='red' direction='out'/>"
+  "      <arg type='ay' name='green' direction='out'/>"
+  "      <arg type='ay' name='blue' direction='out'/>"
+  "    </method>"
   "    <method name='ggimp_quit'>"
   "    </method>"
+  "    <method name='ggimp_rgb_list'>"
+  "      <arg type='i' name='ncolors' direction='out'/>"
+  "      <arg type='as' name='colors' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_rgb_nearest_name_batch'>"
+  "      <arg type='ai' name='colors' direction='in'/>"
+  "      <arg type='as' name='color_names' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_rgb_parse'>"
+  "      <arg type='s' name='color_name' direction='in'/>"
+  "      <arg type='i' name='color' direction='out'/>"
+  "    </method>"
+  "    <method name='ggimp_rgb_parse_batch'>"
+  "      <arg type='as' name='color_names' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='out'/>"
+  "    </method>"
   "    <method name='ggimp_rgb_red'>"
   "      <arg type='i' name='color' direction='in'/>"
   "      <arg type='i' name='red' direction='out'/>"
   "    </method>"
+  "    <method name='pixel_map'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='a(iiiii)' name='program' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='pixels_get'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='ai' name='xs' direction='in'/>"
+  "      <arg type='ai' name='ys' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='out'/>"
+  "    </method>"
+  "    <method name='pixels_set'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='ai' name='xs' direction='in'/>"
+  "      <arg type='ai' name='ys' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='in'/>"
+  "      <arg type='i' name='count' direction='out'/>"
+  "    </method>"
+  "    <method name='region_get'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='size' direction='out'/>"
+  "      <arg type='ay' name='data' direction='out'/>"
+  "      <arg type='i' name='bpp' direction='out'/>"
+  "      <arg type='i' name='rowstride' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='region_get_layout'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='layout' direction='in'/>"
+  "      <arg type='i' name='size' direction='out'/>"
+  "      <arg type='ay' name='data' direction='out'/>"
+  "      <arg type='i' name='bpp' direction='out'/>"
+  "      <arg type='i' name='rowstride' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='region_match'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='ay' name='lo' direction='in'/>"
+  "      <arg type='ay' name='hi' direction='in'/>"
+  "      <arg type='i' name='alpha_min' direction='in'/>"
+  "      <arg type='t' name='count' direction='out'/>"
+  "      <arg type='at' name='sums' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='region_put'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='size' direction='in'/>"
+  "      <arg type='ay' name='data' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='region_put_layout'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='layout' direction='in'/>"
+  "      <arg type='i' name='size' direction='in'/>"
+  "      <arg type='ay' name='data' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='region_resample'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='out_width' direction='in'/>"
+  "      <arg type='i' name='out_height' direction='in'/>"
+  "      <arg type='i' name='filter' direction='in'/>"
+  "      <arg type='i' name='size' direction='out'/>"
+  "      <arg type='ay' name='data' direction='out'/>"
+  "      <arg type='i' name='bpp' direction='out'/>"
+  "      <arg type='i' name='rowstride' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='region_set_chunk_size'>"
+  "      <arg type='i' name='size' direction='in'/>"
+  "      <arg type='i' name='actual' direction='out'/>"
+  "    </method>"
+  "    <method name='region_stats'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='channels' direction='in'/>"
+  "      <arg type='ai' name='channel_ids' direction='out'/>"
+  "      <arg type='t' name='count' direction='out'/>"
+  "      <arg type='at' name='histograms' direction='out'/>"
+  "      <arg type='at' name='sums' direction='out'/>"
+  "      <arg type='at' name='sum_squares' direction='out'/>"
+  "      <arg type='ai' name='mins' direction='out'/>"
+  "      <arg type='ai' name='maxes' direction='out'/>"
+  "    </method>"
+  "    <method name='region_stats_sampled'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "      <arg type='i' name='channels' direction='in'/>"
+  "      <arg type='i' name='budget' direction='in'/>"
+  "      <arg type='i' name='seed' direction='in'/>"
+  "      <arg type='ai' name='channel_ids' direction='out'/>"
+  "      <arg type='t' name='count' direction='out'/>"
+  "      <arg type='at' name='histograms' direction='out'/>"
+  "      <arg type='at' name='sums' direction='out'/>"
+  "      <arg type='at' name='sum_squares' direction='out'/>"
+  "      <arg type='ai' name='mins' direction='out'/>"
+  "      <arg type='ai' name='maxes' direction='out'/>"
+  "      <arg type='t' name='population' direction='out'/>"
+  "      <arg type='ad' name='means' direction='out'/>"
+  "      <arg type='ad' name='mean_errors' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_get'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='tx' direction='in'/>"
+  "      <arg type='i' name='ty' direction='in'/>"
+  "      <arg type='i' name='size' direction='out'/>"
+  "      <arg type='ay' name='data' direction='out'/>"
+  "      <arg type='i' name='bpp' direction='out'/>"
+  "      <arg type='i' name='rowstride' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_get_lod'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='level' direction='in'/>"
+  "      <arg type='i' name='tx' direction='in'/>"
+  "      <arg type='i' name='ty' direction='in'/>"
+  "      <arg type='i' name='size' direction='out'/>"
+  "      <arg type='ay' name='data' direction='out'/>"
+  "      <arg type='i' name='bpp' direction='out'/>"
+  "      <arg type='i' name='rowstride' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_lod_invalidate'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "      <arg type='i' name='width' direction='in'/>"
+  "      <arg type='i' name='height' direction='in'/>"
+  "    </method>"
+  "    <method name='tile_put'>"
+  "      <arg type='i' name='drawable' direction='in'/>"
+  "      <arg type='i' name='tx' direction='in'/>"
+  "      <arg type='i' name='ty' direction='in'/>"
+  "      <arg type='i' name='size' direction='in'/>"
+  "      <arg type='ay' name='data' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
   "    <method name='tile_stream_advance'>"
   "      <arg type='i' name='stream' direction='in'/>"
   "      <arg type='i' name='continues' direction='out'/>"
@@ -314,6 +629,14 @@ static const gchar alt_introspection_xml[] =
   "      <arg type='i' name='width' direction='out'/>"
   "      <arg type='i' name='height' direction='out'/>"
   "    </method>"
+  "    <method name='tile_stream_get_packed'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='out'/>"
+  "      <arg type='i' name='x' direction='out'/>"
+  "      <arg type='i' name='y' direction='out'/>"
+  "      <arg type='i' name='width' direction='out'/>"
+  "      <arg type='i' name='height' direction='out'/>"
+  "    </method>"
   "    <method name='tile_stream_is_valid'>"
   "      <arg type='i' name='stream' direction='in'/>"
   "      <arg type='i' name='valid' direction='out'/>"
@@ -323,12 +646,43 @@ static const gchar alt_introspection_xml[] =
   "      <arg type='i' name='drawable' direction='in'/>"
   "      <arg type='i' name='stream' direction='out'/>"
   "    </method>"
+  "    <method name='tile_stream_set_format'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='format' direction='in'/>"
+  "      <arg type='i' name='actual' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_stream_set_channels'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='channels' direction='in'/>"
+  "      <arg type='i' name='actual' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_stream_set_halo'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='halo' direction='in'/>"
+  "      <arg type='i' name='mode' direction='in'/>"
+  "      <arg type='i' name='actual' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_stream_set_layout'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='layout' direction='in'/>"
+  "      <arg type='i' name='actual' direction='out'/>"
+  "    </method>"
+  "    <method name='tile_stream_set_lookahead'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='i' name='lookahead' direction='in'/>"
+  "      <arg type='i' name='actual' direction='out'/>"
+  "    </method>"
   "    <method name='tile_update'>"
   "      <arg type='i' name='stream' direction='in'/>"
   "      <arg type='i' name='size' direction='in'/>"
   "      <arg type='ay' name='data' direction='in'/>"
   "      <arg type='i' name='success' direction='out'/>"
   "    </method>"
+  "    <method name='tile_update_packed'>"
+  "      <arg type='i' name='stream' direction='in'/>"
+  "      <arg type='ai' name='colors' direction='in'/>"
+  "      <arg type='i' name='success' direction='out'/>"
+  "    </method>"
   "  </interface>"
   "</node>";
 
@@ -394,113 +748,1391 @@ DBus does the checking for us.
   GVariant *child = g_variant_get_child_value (parameters, 0);
   if (g_variant_get_type (child) != != G_VARIANT_TYPE_INT32)
     {
-      report_invalid_parameter (invocation, "FUN", 0, "integer", 
-                                          child);
-    }
- */
+      report_invalid_parameter (invocation, "FUN", 0, "integer", 
+                                          child);
+    }
+ */
+
+/**
+ * Return an error about a particular parameter.
+ */
+static void
+report_invalid_parameter (GDBusMethodInvocation *invocation,
+                                    const gchar *method_name,
+                                    int paramnum,
+                                    const gchar *paramtype,
+                                    GVariant *param)
+{
+  SIGNAL_ARGUMENT_ERROR (
+    invocation,
+    "%s expects %s for parameter %d, received %s",
+     method_name, paramtype, paramnum, g_variant_get_type_string);
+} // report_invalid_parameter
+
+/**
+ * Return an error about the number of parameters.
+ */
+static void
+report_invalid_paramcount (GDBusMethodInvocation *invocation,
+                                     const gchar *method_name,
+                                     int expected,
+                                     int actual)
+{
+  if (expected == 1)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation,
+                             "%s expects 1 parameter, received %d",
+                             method_name, actual);
+    } // if we expected one parameter
+  else
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation,
+                             "%s expects %d parameters, received %d",
+                             method_name, expected, actual);
+    } // if we expected multiple parameters
+} // report_invalid_paramcount
+
+/**
+ * Make sure that a tile stream sent to a handler is valid.  If not,
+ * return an error (which should stop the handler).
+ */
+static int
+handler_validate_tile_stream (int stream, GDBusMethodInvocation *invocation)
+{
+  if (! tile_stream_is_valid (stream))
+    {
+      LOG ("tile-stream-get: Invalid tile stream: %d", stream);
+      SIGNAL_ERROR (invocation, "could not create stream");
+      return 0;
+    } // if tile stream is invalid
+  return 1;
+} // handler_validate_tile_stream
+
+/**
+ * Make sure that a buffer stream sent to a handler is valid.  If not,
+ * return an error (which should stop the handler).
+ */
+static int
+handler_validate_buffer_stream (int stream, GDBusMethodInvocation *invocation)
+{
+  if (! buffer_stream_is_valid (stream))
+    {
+      LOG ("Invalid buffer stream: %d", stream);
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid buffer stream: %d", stream);
+      return 0;
+    } // if the buffer stream is invalid
+  return 1;
+} // handler_validate_buffer_stream
+
+/**
+ * Make sure that a drawable sent to a handler is valid.  If not,
+ * return an error (which should stop the handler).
+ */
+static int
+handler_validate_drawable (int drawable, GDBusMethodInvocation *invocation)
+{
+  if (! gimp_drawable_is_valid (drawable))
+    {
+      LOG ("Invalid drawable: %d", drawable);
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid drawable: %d", drawable);
+      return 0;
+    } // if the drawable is invalid
+  return 1;
+} // handler_validate_drawable
+
+
+// +-----------------+-------------------------------------------------
+// | Handler Helpers |
+// +-----------------+
+
+/**
+ * Return the pixels of a tile (or other rectangle) to the client,
+ * along with the information the client needs to interpret them.
+ */
+static void
+handler_return_tile (GDBusMethodInvocation *invocation,
+                     guchar *data, int size, int bpp, int rowstride,
+                     int x, int y, int width, int height)
+{
+  // Grab the bytes
+  GVariant *bytes = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                               data,
+                                               size,
+                                               sizeof (guint8));
+  // Build the return value
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_TUPLE);
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (size));
+  g_variant_builder_add_value (&builder, bytes);
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (bpp));
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (rowstride));
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (x));
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (y));
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (width));
+  g_variant_builder_add_value (&builder, g_variant_new_int32 (height));
+
+  // And we're done
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_builder_end (&builder));
+} // handler_return_tile
+
+
+// +---------------------------------+---------------------------------
+// | Methods for Alternate Interface |
+// +---------------------------------+
+
+void
+ggimp_dbus_handle_apply_lut (const gchar *method_name,
+                             GDBusMethodInvocation *invocation,
+                             GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable, x, y, width, height;
+  GVariant *wrapped_tables;
+  g_variant_get (parameters, "(iiiii@ay)", 
+                 &drawable, &x, &y, &width, &height, &wrapped_tables);
+  gsize size;
+  const guchar *tables = 
+    g_variant_get_fixed_array (wrapped_tables, &size, sizeof (guchar));
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    {
+      g_variant_unref (wrapped_tables);
+      return;
+    } // if the drawable is invalid
+  int bpp = gimp_drawable_bpp (drawable);
+  if ((size == 0) || (size % 256 != 0) || (size / 256 > bpp))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "expected between 1 and %d tables of 256 bytes, "
+                             "received %lu bytes",
+                             bpp, (unsigned long) size);
+      g_variant_unref (wrapped_tables);
+      return;
+    } // if the tables are malformed
+
+  // Do the work
+  int result = drawable_apply_lut (drawable, x, y, width, height,
+                                   size / 256, tables);
+  g_variant_unref (wrapped_tables);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not apply tables to (%d,%d) %dx%d",
+                             x, y, width, height);
+      return;
+    } // if we failed
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_apply_lut
+
+void
+ggimp_dbus_handle_buffer_stream_advance (const gchar *method_name,
+                                         GDBusMethodInvocation *invocation,
+                                         GVariant *parameters)
+{
+  // Grab the parameters
+  int stream;
+  g_variant_get (parameters, "(i)", &stream);
+  // Validate
+  if (! handler_validate_buffer_stream (stream, invocation))
+    return;
+  // Advance and return
+  GVariant *result = g_variant_new ("(i)", buffer_stream_advance (stream));
+  g_dbus_method_invocation_return_value (invocation, result);
+} // ggimp_dbus_handle_buffer_stream_advance
+
+void
+ggimp_dbus_handle_buffer_stream_close (const gchar *method_name,
+                                       GDBusMethodInvocation *invocation,
+                                       GVariant *parameters)
+{
+  // Grab the parameters
+  int stream;
+  g_variant_get (parameters, "(i)", &stream);
+  // Validate
+  if (! handler_validate_buffer_stream (stream, invocation))
+    return;
+  // Close and return
+  buffer_stream_close (stream);
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("()"));
+} // ggimp_dbus_handle_buffer_stream_close
+
+void
+ggimp_dbus_handle_buffer_stream_get (const gchar *method_name,
+                                     GDBusMethodInvocation *invocation,
+                                     GVariant *parameters)
+{
+  // Grab the parameters
+  int stream;
+  g_variant_get (parameters, "(i)", &stream);
+  // Validate
+  if (! handler_validate_buffer_stream (stream, invocation))
+    return;
+
+  // Get the chunk
+  int size, bpp, rowstride, x, y, width, height;
+  const guchar *data = buffer_stream_get (stream, &size, &bpp, &rowstride,
+                                          &x, &y, &width, &height);
+  if (data == NULL)
+    {
+      SIGNAL_ERROR (invocation, "no more chunks in stream %d", stream);
+      return;
+    } // if we're at the end
+
+  // And return the pixels
+  handler_return_tile (invocation, (guchar *) data, size, bpp, rowstride,
+                       x, y, width, height);
+} // ggimp_dbus_handle_buffer_stream_get
+
+void
+ggimp_dbus_handle_buffer_stream_new (const gchar *method_name,
+                                     GDBusMethodInvocation *invocation,
+                                     GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable, x, y, width, height;
+  const gchar *format;
+  g_variant_get (parameters, "(iiiii&s)", 
+                 &drawable, &x, &y, &width, &height, &format);
+  // Validate
+  if (! buffer_streams_supported ())
+    {
+      SIGNAL_ERROR (invocation, "buffer streams require GIMP 2.10");
+      return;
+    } // if we can't do buffer streams
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+
+  // Build the stream
+  int stream = buffer_stream_new (drawable, x, y, width, height, format);
+  if (stream < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not stream (%d,%d) %dx%d as '%s'",
+                             x, y, width, height, format);
+      return;
+    } // if we failed
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", stream));
+} // ggimp_dbus_handle_buffer_stream_new
+
+void
+ggimp_dbus_handle_buffer_stream_update (const gchar *method_name,
+                                        GDBusMethodInvocation *invocation,
+                                        GVariant *parameters)
+{
+  // Grab the parameters
+  int stream;
+  GVariant *wrapped_data;
+  g_variant_get (parameters, "(i@ay)", &stream, &wrapped_data);
+  gsize size;
+  const guchar *data = 
+    g_variant_get_fixed_array (wrapped_data, &size, sizeof (guchar));
+  // Validate
+  if (! handler_validate_buffer_stream (stream, invocation))
+    {
+      g_variant_unref (wrapped_data);
+      return;
+    } // if the stream is invalid
+  // Update and return
+  int result = buffer_stream_update (stream, size, data);
+  g_variant_unref (wrapped_data);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not update stream %d with %lu bytes",
+                             stream, (unsigned long) size);
+      return;
+    } // if we failed
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_buffer_stream_update
+
+void
+ggimp_dbus_handle_convolve (const gchar *method_name,
+                            GDBusMethodInvocation *invocation,
+                            GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable, x, y, width, height, kernel_width, kernel_height;
+  gboolean separable;
+  GVariant *wrapped_kernel;
+  g_variant_get (parameters, "(iiiii@adiib)", 
+                 &drawable, &x, &y, &width, &height, &wrapped_kernel,
+                 &kernel_width, &kernel_height, &separable);
+  gsize size;
+  const double *kernel = 
+    g_variant_get_fixed_array (wrapped_kernel, &size, sizeof (double));
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    {
+      g_variant_unref (wrapped_kernel);
+      return;
+    } // if the drawable is invalid
+  if ((kernel_width < 1) || (kernel_width > CONVOLVE_MAX_SIZE)
+      || (kernel_height < 1) || (kernel_height > CONVOLVE_MAX_SIZE)
+      || (kernel_width % 2 == 0) || (kernel_height % 2 == 0))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "expected an odd kernel size of at most %d, "
+                             "received %dx%d",
+                             CONVOLVE_MAX_SIZE, kernel_width, kernel_height);
+      g_variant_unref (wrapped_kernel);
+      return;
+    } // if the kernel size is invalid
+  gsize expected = separable ? kernel_width + kernel_height
+                             : kernel_width * kernel_height;
+  if (size != expected)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "expected %lu weights, received %lu",
+                             (unsigned long) expected, (unsigned long) size);
+      g_variant_unref (wrapped_kernel);
+      return;
+    } // if the kernel is malformed
+
+  // Do the work
+  int result = drawable_convolve (drawable, x, y, width, height, kernel,
+                                  kernel_width, kernel_height, separable);
+  g_variant_unref (wrapped_kernel);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not convolve (%d,%d) %dx%d",
+                             x, y, width, height);
+      return;
+    } // if we failed
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", 1));
+} // ggimp_dbus_handle_convolve
+
+void
+ggimp_dbus_handle_draw_commands (const gchar *method_name,
+                                 GDBusMethodInvocation *invocation,
+                                 GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable;
+  GVariant *wrapped_commands;
+  g_variant_get (parameters, "(i@a(idd))", &drawable, &wrapped_commands);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    {
+      g_variant_unref (wrapped_commands);
+      return;
+    } // if the drawable is invalid
+
+  // Unpack the commands
+  int n = g_variant_n_children (wrapped_commands);
+  DrawCommand *commands = g_try_new (DrawCommand, MAX (n, 1));
+  if (commands == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %d commands", n);
+      g_variant_unref (wrapped_commands);
+      return;
+    } // if we could not allocate the commands
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      g_variant_get_child (wrapped_commands, i, "(idd)", 
+                           &(commands[i].op), 
+                           &(commands[i].a), 
+                           &(commands[i].b));
+    } // for each command
+  g_variant_unref (wrapped_commands);
+  int bad = draw_commands_validate (n, commands);
+  if (bad >= 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid drawing command %d", bad);
+      g_free (commands);
+      return;
+    } // if there's an invalid command
+
+  // Draw
+  int strokes = draw_commands_run (drawable, n, commands);
+  g_free (commands);
+  if (strokes < 0)
+    {
+      SIGNAL_ERROR (invocation, "drawing failed");
+      return;
+    } // if drawing failed
+
+  // And return
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", strokes));
+} // ggimp_dbus_handle_draw_commands
+
+void
+ggimp_dbus_handle_about (const gchar *method_name,
+                         GDBusMethodInvocation *invocation,
+                         GVariant *parameters)
+{
+  GVariant *result = g_variant_new ("(s)", GIMP_DBUS_ABOUT);
+  g_dbus_method_invocation_return_value (invocation, result);
+} // ggimp_dbus_handle_about
+
+void
+ggimp_dbus_handle_default (const gchar *method_name,
+                           GDBusMethodInvocation *invocation,
+                           GVariant *parameters)
+{
+  SIGNAL_ARGUMENT_ERROR (invocation, "Invalid method: '%s'", method_name);
+} // ggimp_dbus_handle_default
+
+void
+ggimp_dbus_handle_irgb_component (const gchar *method_name,
+                                  GDBusMethodInvocation *invocation,
+                                  GVariant *parameters)
+{
+  // Grab the parameter
+  int color = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  // Extract the component named by the method
+  int component;
+  if (g_strcmp0 (method_name, "ggimp_irgb_red") == 0)
+    component = IRGB_RED (color);
+  else if (g_strcmp0 (method_name, "ggimp_irgb_green") == 0)
+    component = IRGB_GREEN (color);
+  else
+    component = IRGB_BLUE (color);
+  // And return it
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", component));
+} // ggimp_dbus_handle_irgb_component
+
+void
+ggimp_dbus_handle_irgb_new (const gchar *method_name,
+                            GDBusMethodInvocation *invocation,
+                            GVariant *parameters)
+{
+  // Grab the parameters
+  int r = g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  int g = g_variant_get_int32 (g_variant_get_child_value (parameters, 1));
+  int b = g_variant_get_int32 (g_variant_get_child_value (parameters, 2));
+  // Build the color and return it
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", 
+                                                        irgb_new (r, g, b)));
+} // ggimp_dbus_handle_irgb_new
+
+void
+ggimp_dbus_handle_irgb_from_rgba (const gchar *method_name,
+                                  GDBusMethodInvocation *invocation,
+                                  GVariant *parameters)
+{
+  // Grab the parameter
+  gsize nbytes;
+  const guchar *rgba = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0),
+                               &nbytes, sizeof (guchar));
+  if (nbytes % 4 != 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "expected 4 bytes per pixel, received %lu bytes",
+                             (unsigned long) nbytes);
+      return;
+    } // if we don't have whole pixels
+  gsize n = nbytes / 4;
+
+  // Convert
+  gint32 *colors = g_try_new (gint32, MAX (n, 1));
+  if (colors == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %lu colors",
+                    (unsigned long) n);
+      return;
+    } // if we could not allocate the colors
+  irgb_from_rgba (rgba, colors, n);
+
+  // And return
+  GVariant *result = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                colors, n, sizeof (gint32));
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&result, 1));
+  g_free (colors);
+} // ggimp_dbus_handle_irgb_from_rgba
+
+void
+ggimp_dbus_handle_irgb_pack (const gchar *method_name,
+                             GDBusMethodInvocation *invocation,
+                             GVariant *parameters)
+{
+  // Grab the parameters
+  gsize nr, ng, nb;
+  const guchar *r = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0),
+                               &nr, sizeof (guchar));
+  const guchar *g = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 1),
+                               &ng, sizeof (guchar));
+  const guchar *b = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 2),
+                               &nb, sizeof (guchar));
+  if ((nr != ng) || (nr != nb))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "received %lu red, %lu green, and %lu blue values",
+                             (unsigned long) nr, (unsigned long) ng,
+                             (unsigned long) nb);
+      return;
+    } // if the planes don't match up
+  if (nr * sizeof (gint32) > GIMP_DBUS_MAX_ARRAY_SIZE)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "too many colors to send back");
+      return;
+    } // if the result would be too large
+
+  // Convert
+  gint32 *colors = g_try_new (gint32, MAX (nr, 1));
+  if (colors == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %lu colors",
+                    (unsigned long) nr);
+      return;
+    } // if we could not allocate the colors
+  irgb_pack_planes (r, g, b, colors, nr);
+
+  // And return
+  GVariant *result = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                colors, nr, sizeof (gint32));
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&result, 1));
+  g_free (colors);
+} // ggimp_dbus_handle_irgb_pack
+
+void
+ggimp_dbus_handle_irgb_to_rgba (const gchar *method_name,
+                                GDBusMethodInvocation *invocation,
+                                GVariant *parameters)
+{
+  // Grab the parameter
+  gsize n;
+  const gint32 *colors = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0),
+                               &n, sizeof (gint32));
+
+  // Convert
+  guchar *rgba = g_try_malloc (MAX (4 * n, 1));
+  if (rgba == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %lu pixels",
+                    (unsigned long) n);
+      return;
+    } // if we could not allocate the pixels
+  irgb_to_rgba (colors, rgba, n);
+
+  // And return
+  GVariant *result = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                rgba, 4 * n, sizeof (guchar));
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&result, 1));
+  g_free (rgba);
+} // ggimp_dbus_handle_irgb_to_rgba
+
+void
+ggimp_dbus_handle_irgb_unpack (const gchar *method_name,
+                               GDBusMethodInvocation *invocation,
+                               GVariant *parameters)
+{
+  // Grab the parameter
+  gsize n;
+  const gint32 *colors = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0),
+                               &n, sizeof (gint32));
+
+  // Convert.  (We put all three planes in one allocation.)
+  guchar *planes = g_try_malloc (MAX (3 * n, 1));
+  if (planes == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %lu pixels",
+                    (unsigned long) n);
+      return;
+    } // if we could not allocate the planes
+  irgb_unpack_planes (colors, planes, planes + n, planes + 2 * n, n);
+
+  // And return
+  GVariant *result[3];
+  int i;
+  for (i = 0; i < 3; i++)
+    result[i] = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                           planes + i * n, n, sizeof (guchar));
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (result, 3));
+  g_free (planes);
+} // ggimp_dbus_handle_irgb_unpack
+
+void
+ggimp_dbus_handle_quit (const gchar *method_name,
+                        GDBusMethodInvocation *invocation,
+                        GVariant *parameters)
+{
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("()"));
+  g_main_loop_quit (loop);
+} // ggimp_dbus_handle_quit
+
+void
+ggimp_dbus_handle_rgb_red (const gchar *method_name,
+                           GDBusMethodInvocation *invocation,
+                           GVariant *parameters)
+{
+  // Grab the parameter
+  GVariant *param = g_variant_get_child_value (parameters, 0);
+  // Grab the integer
+  int color = g_variant_get_int32 (param);
+  // Extract the red component
+  int red = (color >> 16) & 255;
+  // Convert it back to a GVariant
+  GVariant *result = g_variant_new ("(i)", red);
+  // And return it
+  g_dbus_method_invocation_return_value (invocation, result);
+} // gimp_gbus_handle_rgb_red
+
+void
+ggimp_dbus_handle_rgb_list (const gchar *method_name,
+                            GDBusMethodInvocation *invocation,
+                            GVariant *parameters)
+{
+  const gchar **names;
+  int ncolors = color_names_list (&names);
+  GVariant *result = g_variant_new ("(i@as)", 
+                                    ncolors,
+                                    g_variant_new_strv (names, ncolors));
+  g_dbus_method_invocation_return_value (invocation, result);
+} // ggimp_dbus_handle_rgb_list
+
+void
+ggimp_dbus_handle_rgb_nearest_name_batch (const gchar *method_name,
+                                          GDBusMethodInvocation *invocation,
+                                          GVariant *parameters)
+{
+  // Grab the parameter
+  gsize n;
+  const gint32 *colors = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 0),
+                               &n, sizeof (gint32));
+  // Look up the names
+  const gchar **names = g_try_new (const gchar *, MAX (n, 1));
+  if (names == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %lu names",
+                    (unsigned long) n);
+      return;
+    } // if we could not allocate the names
+  gsize i;
+  for (i = 0; i < n; i++)
+    names[i] = color_names_nearest (colors[i]);
+  // And return them
+  GVariant *result = g_variant_new_strv (names, n);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&result, 1));
+  g_free (names);
+} // ggimp_dbus_handle_rgb_nearest_name_batch
+
+/**
+ * Convert a color name to an irgb color.  Returns -1 if the name is
+ * unknown.
+ */
+static gint32
+rgb_parse (const gchar *name)
+{
+  gint32 color;
+  GimpRGB rgb;
+  guchar r, g, b;
+
+  // Most names are in the table
+  if (color_names_lookup (name, &color))
+    return color;
+
+  // libgimpcolor may understand some other forms
+  if (! gimp_rgb_parse_name (&rgb, name, -1))
+    return -1;
+  gimp_rgb_get_uchar (&rgb, &r, &g, &b);
+  return irgb_new (r, g, b);
+} // rgb_parse
+
+void
+ggimp_dbus_handle_rgb_parse (const gchar *method_name,
+                             GDBusMethodInvocation *invocation,
+                             GVariant *parameters)
+{
+  // Grab the parameter
+  const gchar *name = 
+    g_variant_get_string (g_variant_get_child_value (parameters, 0), NULL);
+  // Look up the color
+  gint32 color = rgb_parse (name);
+  if (color < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "unknown color: '%s'", name);
+      return;
+    } // if we could not parse the name
+  // And return it
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", color));
+} // ggimp_dbus_handle_rgb_parse
+
+void
+ggimp_dbus_handle_rgb_parse_batch (const gchar *method_name,
+                                   GDBusMethodInvocation *invocation,
+                                   GVariant *parameters)
+{
+  // Grab the parameter
+  gsize n;
+  const gchar **names = 
+    g_variant_get_strv (g_variant_get_child_value (parameters, 0), &n);
+  // Look up the colors.  Unknown names give -1.
+  gint32 *colors = g_try_new (gint32, MAX (n, 1));
+  if (colors == NULL)
+    {
+      g_free (names);
+      SIGNAL_ERROR (invocation, "could not allocate %lu colors",
+                    (unsigned long) n);
+      return;
+    } // if we could not allocate the colors
+  gsize i;
+  for (i = 0; i < n; i++)
+    colors[i] = rgb_parse (names[i]);
+  // And return them
+  GVariant *result = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                colors, n, sizeof (gint32));
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&result, 1));
+  g_free (colors);
+  g_free (names);
+} // ggimp_dbus_handle_rgb_parse_batch
+
+void
+ggimp_dbus_handle_pixel_map (const gchar *method_name,
+                             GDBusMethodInvocation *invocation,
+                             GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable, x, y, width, height;
+  GVariant *wrapped_code;
+  g_variant_get (parameters, "(iiiii@a(iiiii))", 
+                 &drawable, &x, &y, &width, &height, &wrapped_code);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    {
+      g_variant_unref (wrapped_code);
+      return;
+    } // if the drawable is invalid
+  int n = g_variant_n_children (wrapped_code);
+  if (n > PIXEL_VM_MAX_INSTRUCTIONS)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "programs may have at most %d instructions, "
+                             "received %d",
+                             PIXEL_VM_MAX_INSTRUCTIONS, n);
+      g_variant_unref (wrapped_code);
+      return;
+    } // if the program is too long
+
+  // Unpack the instructions
+  PixelInstruction *code = g_new (PixelInstruction, MAX (n, 1));
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      g_variant_get_child (wrapped_code, i, "(iiiii)", 
+                           &(code[i].op), 
+                           &(code[i].dst), 
+                           &(code[i].a),
+                           &(code[i].b),
+                           &(code[i].c));
+    } // for each instruction
+  g_variant_unref (wrapped_code);
+  int bad = pixel_program_validate (n, code);
+  if (bad >= 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid instruction %d", bad);
+      g_free (code);
+      return;
+    } // if there's an invalid instruction
+  PixelProgram *program = pixel_program_new (n, code);
+  g_free (code);
+
+  // Do the work
+  int result = drawable_pixel_map (drawable, x, y, width, height, program);
+  pixel_program_free (program);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not map over (%d,%d) %dx%d",
+                             x, y, width, height);
+      return;
+    } // if we failed
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_pixel_map
+
+void
+ggimp_dbus_handle_pixels_get (const gchar *method_name,
+                              GDBusMethodInvocation *invocation,
+                              GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  gsize nxs, nys;
+  const gint32 *xs = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 1),
+                               &nxs, sizeof (gint32));
+  const gint32 *ys = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 2),
+                               &nys, sizeof (gint32));
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  if (nxs != nys)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "received %lu x coordinates but %lu y coordinates",
+                             (unsigned long) nxs, (unsigned long) nys);
+      return;
+    } // if the coordinates don't match up
+  if (gimp_drawable_is_indexed (drawable))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "indexed drawables are not supported");
+      return;
+    } // if the drawable is indexed
+
+  // Get the colors
+  gint32 *colors = g_try_new (gint32, MAX (nxs, 1));
+  if (colors == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not allocate %lu colors",
+                    (unsigned long) nxs);
+      return;
+    } // if we could not allocate the colors
+  if (drawable_pixels_get (drawable, nxs, xs, ys, colors) < 0)
+    {
+      g_free (colors);
+      SIGNAL_ARGUMENT_ERROR (invocation, "pixel outside of drawable");
+      return;
+    } // if we could not get the pixels
+
+  // And return them
+  GVariant *result = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                colors, nxs, sizeof (gint32));
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&result, 1));
+  g_free (colors);
+} // ggimp_dbus_handle_pixels_get
+
+void
+ggimp_dbus_handle_pixels_set (const gchar *method_name,
+                              GDBusMethodInvocation *invocation,
+                              GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  gsize nxs, nys, ncolors;
+  const gint32 *xs = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 1),
+                               &nxs, sizeof (gint32));
+  const gint32 *ys = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 2),
+                               &nys, sizeof (gint32));
+  const gint32 *colors = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 3),
+                               &ncolors, sizeof (gint32));
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  if ((nxs != nys) || (nxs != ncolors))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "received %lu x coordinates, %lu y coordinates, "
+                             "and %lu colors",
+                             (unsigned long) nxs, (unsigned long) nys,
+                             (unsigned long) ncolors);
+      return;
+    } // if the arrays don't match up
+  if (gimp_drawable_is_indexed (drawable))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "indexed drawables are not supported");
+      return;
+    } // if the drawable is indexed
+
+  // Set the colors
+  int count = drawable_pixels_set (drawable, nxs, xs, ys, colors);
+  if (count < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "pixel outside of drawable");
+      return;
+    } // if we could not set the pixels
+
+  // And return
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", count));
+} // ggimp_dbus_handle_pixels_set
+
+void
+ggimp_dbus_handle_region_get (const gchar *method_name,
+                              GDBusMethodInvocation *invocation,
+                              GVariant *parameters)
+{
+  // Grab the parameters.  (We also handle region_get_layout, which
+  // takes one more.)
+  int drawable, x, y, width, height;
+  int layout = TILE_LAYOUT_INTERLEAVED;
+  if (strcmp (method_name, "region_get_layout") == 0)
+    g_variant_get (parameters, "(iiiiii)", 
+                   &drawable, &x, &y, &width, &height, &layout);
+  else
+    g_variant_get (parameters, "(iiiii)", 
+                   &drawable, &x, &y, &width, &height);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  if ((layout != TILE_LAYOUT_INTERLEAVED) && (layout != TILE_LAYOUT_PLANAR))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid layout %d", layout);
+      return;
+    } // if the layout is invalid
+  if ((width <= 0) || (height <= 0))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "region must be non-empty");
+      return;
+    } // if the region is empty
+  guint64 size = (guint64) width * height * gimp_drawable_bpp (drawable);
+  if (size > GIMP_DBUS_MAX_ARRAY_SIZE)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "region of %lu bytes is too large to send; "
+                             "request at most %d bytes at a time",
+                             (unsigned long) size, GIMP_DBUS_MAX_ARRAY_SIZE);
+      return;
+    } // if the region is too large
+
+  // Get the region
+  TileBuffer *region = 
+    drawable_region_get_layout (drawable, x, y, width, height, layout);
+  if (region == NULL)
+    {
+      LOG ("region_get: Failed to get region.\n");
+      SIGNAL_ERROR (invocation, "could not get region");
+      return;
+    } // if the region is null
+
+  // And return it
+  handler_return_tile (invocation, region->data, 
+                       (int) tile_buffer_size (region),
+                       region->bpp, region->rowstride,
+                       region->x, region->y, region->width, region->height);
+  tile_buffer_free (region);
+} // ggimp_dbus_handle_region_get
+
+void
+ggimp_dbus_handle_region_match (const gchar *method_name,
+                                GDBusMethodInvocation *invocation,
+                                GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable, x, y, width, height, alpha_min;
+  GVariant *wrapped_lo, *wrapped_hi;
+  g_variant_get (parameters, "(iiiii@ay@ayi)", 
+                 &drawable, &x, &y, &width, &height, 
+                 &wrapped_lo, &wrapped_hi, &alpha_min);
+  gsize lo_size, hi_size;
+  const guchar *lo = 
+    g_variant_get_fixed_array (wrapped_lo, &lo_size, sizeof (guchar));
+  const guchar *hi = 
+    g_variant_get_fixed_array (wrapped_hi, &hi_size, sizeof (guchar));
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    {
+      g_variant_unref (wrapped_lo);
+      g_variant_unref (wrapped_hi);
+      return;
+    } // if the drawable is invalid
+  int colors = gimp_drawable_is_rgb (drawable) ? 3 : 1;
+  if (((lo_size != 0) && (lo_size != colors))
+      || ((hi_size != 0) && (hi_size != colors)))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "expected 0 or %d bounds, received %lu and %lu",
+                             colors, (unsigned long) lo_size, 
+                             (unsigned long) hi_size);
+      g_variant_unref (wrapped_lo);
+      g_variant_unref (wrapped_hi);
+      return;
+    } // if the bounds are malformed
+
+  // Do the work
+  RegionMatch match;
+  int status = drawable_region_match (drawable, x, y, width, height,
+                                      (lo_size == 0) ? NULL : lo, 
+                                      (hi_size == 0) ? NULL : hi,
+                                      alpha_min, &match);
+  g_variant_unref (wrapped_lo);
+  g_variant_unref (wrapped_hi);
+  if (status < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not match pixels in (%d,%d) %dx%d",
+                             x, y, width, height);
+      return;
+    } // if we failed
+
+  // And return the results
+  GVariant *result[6];
+  result[0] = g_variant_new_uint64 (match.count);
+  result[1] = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                         match.sums, match.nchannels, 
+                                         sizeof (guint64));
+  result[2] = g_variant_new_int32 (match.x);
+  result[3] = g_variant_new_int32 (match.y);
+  result[4] = g_variant_new_int32 (match.width);
+  result[5] = g_variant_new_int32 (match.height);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (result, 6));
+} // ggimp_dbus_handle_region_match
+
+void
+ggimp_dbus_handle_region_put (const gchar *method_name,
+                              GDBusMethodInvocation *invocation,
+                              GVariant *parameters)
+{
+  // Grab the parameters.  (We also handle region_put_layout, which
+  // takes a layout before the size.)
+  int drawable, x, y, width, height, size;
+  int layout = TILE_LAYOUT_INTERLEAVED;
+  GVariant *wrapped_data;
+  if (strcmp (method_name, "region_put_layout") == 0)
+    g_variant_get (parameters, "(iiiiiii@ay)", 
+                   &drawable, &x, &y, &width, &height, &layout, 
+                   &size, &wrapped_data);
+  else
+    g_variant_get (parameters, "(iiiiii@ay)", 
+                   &drawable, &x, &y, &width, &height, &size, &wrapped_data);
+  gsize realsize;
+  guint8 *data = (guint8 *) g_variant_get_fixed_array (wrapped_data,
+                                                       &realsize,
+                                                       sizeof (guint8));
+  if ((size < 0) || (size > realsize))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "size > number of bytes");
+      g_variant_unref (wrapped_data);
+      return;
+    }
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    {
+      g_variant_unref (wrapped_data);
+      return;
+    } // if the drawable is invalid
+
+  // Call the underlying function
+  int result = drawable_region_put_layout (drawable, x, y, width, height, 
+                                           layout, size, data);
+  g_variant_unref (wrapped_data);
+  // And return
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_region_put
+
+void
+ggimp_dbus_handle_region_resample (const gchar *method_name,
+                                   GDBusMethodInvocation *invocation,
+                                   GVariant *parameters)
+{
+  // Grab the parameters
+  int drawable, x, y, width, height, out_width, out_height, filter;
+  g_variant_get (parameters, "(iiiiiiii)", 
+                 &drawable, &x, &y, &width, &height, 
+                 &out_width, &out_height, &filter);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  if ((filter != RESAMPLE_BOX) && (filter != RESAMPLE_BILINEAR)
+      && (filter != RESAMPLE_LANCZOS))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid filter %d", filter);
+      return;
+    } // if the filter is invalid
+  if ((width <= 0) || (height <= 0))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "region must be non-empty");
+      return;
+    } // if the region is empty
+  if ((out_width < 1) || (out_width > RESAMPLE_MAX_SIZE)
+      || (out_height < 1) || (out_height > RESAMPLE_MAX_SIZE))
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "output size must be between 1 and %d", 
+                             RESAMPLE_MAX_SIZE);
+      return;
+    } // if the output size is invalid
+  guint64 size = 
+    (guint64) out_width * out_height * gimp_drawable_bpp (drawable);
+  if (size > GIMP_DBUS_MAX_ARRAY_SIZE)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "result of %lu bytes is too large to send; "
+                             "request at most %d bytes at a time",
+                             (unsigned long) size, GIMP_DBUS_MAX_ARRAY_SIZE);
+      return;
+    } // if the result is too large
+
+  // Scale the region
+  TileBuffer *region = 
+    drawable_region_resample (drawable, x, y, width, height, 
+                              out_width, out_height, filter);
+  if (region == NULL)
+    {
+      LOG ("region_resample: Failed to resample region.\n");
+      SIGNAL_ERROR (invocation, "could not resample region");
+      return;
+    } // if the region is null
 
-/**
- * Return an error about a particular parameter.
- */
-static void
-report_invalid_parameter (GDBusMethodInvocation *invocation,
-                                    const gchar *method_name,
-                                    int paramnum,
-                                    const gchar *paramtype,
-                                    GVariant *param)
-{
-  SIGNAL_ARGUMENT_ERROR (
-    invocation,
-    "%s expects %s for parameter %d, received %s",
-     method_name, paramtype, paramnum, g_variant_get_type_string);
-} // report_invalid_parameter
+  // And return it
+  handler_return_tile (invocation, region->data, 
+                       (int) tile_buffer_size (region),
+                       region->bpp, region->rowstride,
+                       region->x, region->y, region->width, region->height);
+  tile_buffer_free (region);
+} // ggimp_dbus_handle_region_resample
 
-/**
- * Return an error about the number of parameters.
- */
-static void
-report_invalid_paramcount (GDBusMethodInvocation *invocation,
-                                     const gchar *method_name,
-                                     int expected,
-                                     int actual)
+void
+ggimp_dbus_handle_region_set_chunk_size (const gchar *method_name,
+                                         GDBusMethodInvocation *invocation,
+                                         GVariant *parameters)
 {
-  if (expected == 1)
+  // Grab the parameters
+  int size = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  // Validate
+  if (size <= 0)
     {
-      SIGNAL_ARGUMENT_ERROR (invocation,
-                             "%s expects 1 parameter, received %d",
-                             method_name, actual);
-    } // if we expected one parameter
+      SIGNAL_ARGUMENT_ERROR (invocation, "chunk size must be positive");
+      return;
+    } // if the size is not positive
+  // Update and return
+  GVariant *result = 
+    g_variant_new ("(i)", (int) region_set_chunk_size (size));
+  g_dbus_method_invocation_return_value (invocation, result);
+} // ggimp_dbus_handle_region_set_chunk_size
+
+void
+ggimp_dbus_handle_region_stats (const gchar *method_name,
+                                GDBusMethodInvocation *invocation,
+                                GVariant *parameters)
+{
+  // Grab the parameters.  (We also handle region_stats_sampled, which
+  // takes two more.)
+  int drawable, x, y, width, height, channels;
+  int budget = 0, seed = 0;
+  gboolean sampled = (strcmp (method_name, "region_stats_sampled") == 0);
+  if (sampled)
+    g_variant_get (parameters, "(iiiiiiii)", 
+                   &drawable, &x, &y, &width, &height, &channels,
+                   &budget, &seed);
   else
+    g_variant_get (parameters, "(iiiiii)", 
+                   &drawable, &x, &y, &width, &height, &channels);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  if (sampled && (budget <= 0))
     {
-      SIGNAL_ARGUMENT_ERROR (invocation,
-                             "%s expects %d parameters, received %d",
-                             method_name, expected, actual);
-    } // if we expected multiple parameters
-} // report_invalid_paramcount
+      SIGNAL_ARGUMENT_ERROR (invocation, "budget must be positive");
+      return;
+    } // if the budget is invalid
+
+  // Do the work
+  RegionStats *stats = g_new (RegionStats, 1);
+  int status = sampled
+    ? drawable_region_stats_sampled (drawable, x, y, width, height, 
+                                     channels, budget, (guint32) seed, 
+                                     stats)
+    : drawable_region_stats (drawable, x, y, width, height, 
+                             channels, stats);
+  if (status < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not compute statistics for channels %d "
+                             "of (%d,%d) %dx%d",
+                             channels, x, y, width, height);
+      g_free (stats);
+      return;
+    } // if we failed
+
+  // Flatten the results
+  int n = stats->nchannels;
+  gint32 ids[STATS_MAX_CHANNELS], mins[STATS_MAX_CHANNELS], 
+         maxes[STATS_MAX_CHANNELS];
+  guint64 sums[STATS_MAX_CHANNELS], sum_squares[STATS_MAX_CHANNELS];
+  double means[STATS_MAX_CHANNELS], mean_errors[STATS_MAX_CHANNELS];
+  guint64 *histograms = g_new (guint64, MAX (1, n * 256));
+  int k;
+  for (k = 0; k < n; k++)
+    {
+      ChannelStats *channel = stats->channels + k;
+      ids[k] = channel->channel;
+      mins[k] = channel->min;
+      maxes[k] = channel->max;
+      sums[k] = channel->sum;
+      sum_squares[k] = channel->sum_squares;
+      means[k] = channel->mean;
+      mean_errors[k] = channel->mean_error;
+      memcpy (histograms + k * 256, channel->histogram, 
+              256 * sizeof (guint64));
+    } // for each channel
+
+  // And return them
+  GVariant *result[10];
+  result[0] = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                         ids, n, sizeof (gint32));
+  result[1] = g_variant_new_uint64 (stats->count);
+  result[2] = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                         histograms, n * 256, 
+                                         sizeof (guint64));
+  result[3] = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                         sums, n, sizeof (guint64));
+  result[4] = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                         sum_squares, n, sizeof (guint64));
+  result[5] = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                         mins, n, sizeof (gint32));
+  result[6] = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                         maxes, n, sizeof (gint32));
+  if (sampled)
+    {
+      result[7] = g_variant_new_uint64 (stats->population);
+      result[8] = g_variant_new_fixed_array (G_VARIANT_TYPE_DOUBLE,
+                                             means, n, sizeof (double));
+      result[9] = g_variant_new_fixed_array (G_VARIANT_TYPE_DOUBLE,
+                                             mean_errors, n, 
+                                             sizeof (double));
+    } // if sampled
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (result, 
+                                                              sampled ? 10 
+                                                                      : 7));
+  g_free (histograms);
+  g_free (stats);
+} // ggimp_dbus_handle_region_stats
 
-/**
- * Make sure that a tile stream sent to a handler is valid.  If not,
- * return an error (which should stop the handler).
- */
-static int
-handler_validate_tile_stream (int stream, GDBusMethodInvocation *invocation)
+void
+ggimp_dbus_handle_tile_get (const gchar *method_name,
+                            GDBusMethodInvocation *invocation,
+                            GVariant *parameters)
 {
-  if (! tile_stream_is_valid (stream))
+  // Grab the parameters
+  int drawable = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  int tx = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 1));
+  int ty = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 2));
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+
+  // Get the tile
+  TileBuffer *tile = drawable_tile_get (drawable, tx, ty);
+  if (tile == NULL)
     {
-      LOG ("tile-stream-get: Invalid tile stream: %d", stream);
-      SIGNAL_ERROR (invocation, "could not create stream");
-      return 0;
-    } // if tile stream is invalid
-  return 1;
-} // handler_validate_tile_stream
+      LOG ("tile_get: Failed to get tile (%d,%d).\n", tx, ty);
+      SIGNAL_ERROR (invocation, "could not get tile (%d,%d)", tx, ty);
+      return;
+    } // if the tile is null
 
-
-// +---------------------------------+---------------------------------
-// | Methods for Alternate Interface |
-// +---------------------------------+
+  // And return it
+  handler_return_tile (invocation, tile->data, 
+                       tile->rowstride * tile->height,
+                       tile->bpp, tile->rowstride,
+                       tile->x, tile->y, tile->width, tile->height);
+  tile_buffer_free (tile);
+} // ggimp_dbus_handle_tile_get
 
 void
-ggimp_dbus_handle_about (const gchar *method_name,
-                         GDBusMethodInvocation *invocation,
-                         GVariant *parameters)
+ggimp_dbus_handle_tile_get_lod (const gchar *method_name,
+                                GDBusMethodInvocation *invocation,
+                                GVariant *parameters)
 {
-  GVariant *result = g_variant_new ("(s)", GIMP_DBUS_ABOUT);
-  g_dbus_method_invocation_return_value (invocation, result);
-} // ggimp_dbus_handle_about
+  // Grab the parameters
+  int drawable, level, tx, ty;
+  g_variant_get (parameters, "(iiii)", &drawable, &level, &tx, &ty);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  if (level < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid level %d", level);
+      return;
+    } // if the level is invalid
 
-void
-ggimp_dbus_handle_default (const gchar *method_name,
-                           GDBusMethodInvocation *invocation,
-                           GVariant *parameters)
-{
-  SIGNAL_ARGUMENT_ERROR (invocation, "Invalid method: '%s'", method_name);
-} // ggimp_dbus_handle_default
+  // Get the tile
+  TileBuffer *tile = drawable_tile_get_lod (drawable, level, tx, ty);
+  if (tile == NULL)
+    {
+      LOG ("tile_get_lod: Failed to get tile (%d,%d) at level %d.\n", 
+           tx, ty, level);
+      SIGNAL_ERROR (invocation, "could not get tile (%d,%d) at level %d", 
+                    tx, ty, level);
+      return;
+    } // if the tile is null
+
+  // And return it
+  handler_return_tile (invocation, tile->data, 
+                       tile->rowstride * tile->height,
+                       tile->bpp, tile->rowstride,
+                       tile->x, tile->y, tile->width, tile->height);
+  tile_buffer_free (tile);
+} // ggimp_dbus_handle_tile_get_lod
 
 void
-ggimp_dbus_handle_quit (const gchar *method_name,
-                        GDBusMethodInvocation *invocation,
-                        GVariant *parameters)
+ggimp_dbus_handle_tile_lod_invalidate (const gchar *method_name,
+                                       GDBusMethodInvocation *invocation,
+                                       GVariant *parameters)
 {
+  // Grab the parameters
+  int drawable, x, y, width, height;
+  g_variant_get (parameters, "(iiiii)", &drawable, &x, &y, &width, &height);
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+  // Drop the tiles and return
+  mipmap_invalidate (drawable, x, y, width, height);
   g_dbus_method_invocation_return_value (invocation, g_variant_new ("()"));
-  g_main_loop_quit (loop);
-} // ggimp_dbus_handle_quit
+} // ggimp_dbus_handle_tile_lod_invalidate
 
 void
-ggimp_dbus_handle_rgb_red (const gchar *method_name,
-                           GDBusMethodInvocation *invocation,
-                           GVariant *parameters)
+ggimp_dbus_handle_tile_put (const gchar *method_name,
+                            GDBusMethodInvocation *invocation,
+                            GVariant *parameters)
 {
-  // Grab the parameter
-  GVariant *param = g_variant_get_child_value (parameters, 0);
-  // Grab the integer
-  int color = g_variant_get_int32 (param);
-  // Extract the red component
-  int red = (color >> 16) & 255;
-  // Convert it back to a GVariant
-  GVariant *result = g_variant_new ("(i)", red);
-  // And return it
-  g_dbus_method_invocation_return_value (invocation, result);
-} // gimp_gbus_handle_rgb_red
+  // Grab the parameters
+  int drawable = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  int tx = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 1));
+  int ty = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 2));
+  int size =
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 3));
+  gsize realsize;
+  GVariant *wrapped_data = g_variant_get_child_value (parameters, 4);
+  guint8 *data = (guint8 *) g_variant_get_fixed_array (wrapped_data,
+                                                       &realsize,
+                                                       sizeof (guint8));
+  if (size > realsize)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "size > number of bytes");
+      return;
+    }
+  // Validate
+  if (! handler_validate_drawable (drawable, invocation))
+    return;
+
+  // Call the underlying function
+  int result = drawable_tile_put (drawable, tx, ty, size, data);
+  // And return
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_tile_put
 
 void
 ggimp_dbus_handle_tile_stream_advance (const gchar *method_name,
@@ -547,7 +2179,7 @@ ggimp_dbus_handle_tile_stream_get (const gchar *method_name,
     return;
 
   // Get the region
-  GimpPixelRgn *rgn = tile_stream_get (stream);
+  GimpPixelRgn *rgn = tile_stream_get_padded (stream);
   if (rgn == NULL)
     {
       LOG ("tile-stream-get: Failed to get tile.\n");
@@ -555,29 +2187,56 @@ ggimp_dbus_handle_tile_stream_get (const gchar *method_name,
       return; 
     } // if the region is null
 
-  // Grab the bytes
-  int size = rgn->rowstride * rgn->h;
-  GVariant *bytes = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
-                                               rgn->data,
-                                               size,
-                                               sizeof (guint8));
-  // Build the return value
-  GVariantBuilder builder;
-  g_variant_builder_init (&builder, G_VARIANT_TYPE_TUPLE);
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (size));
-  g_variant_builder_add_value (&builder, bytes);
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (rgn->bpp));
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (rgn->rowstride));
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (rgn->x));
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (rgn->y));
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (rgn->w));
-  g_variant_builder_add_value (&builder, g_variant_new_int32 (rgn->h));
+  // Get the bytes the client asked for (all or some of the channels,
+  // interleaved or planar)
+  int size, bpp, rowstride;
+  const guchar *data = tile_stream_get_bytes (stream, &size, &bpp, &rowstride);
+  if (data == NULL)
+    {
+      SIGNAL_ERROR (invocation, "could not extract tile data");
+      return;
+    } // if we could not get the bytes
 
-  // And we're done
-  g_dbus_method_invocation_return_value (invocation, 
-                                         g_variant_builder_end (&builder));
+  // And return the pixels
+  handler_return_tile (invocation, (guchar *) data, size, bpp, rowstride,
+                       rgn->x, rgn->y, rgn->w, rgn->h);
 } // ggimp_dbus_handle_tile_stream_get
 
+void
+ggimp_dbus_handle_tile_stream_get_packed (const gchar *method_name,
+                                          GDBusMethodInvocation *invocation,
+                                          GVariant *parameters)
+{
+  // Grab the parameters
+  int stream = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+
+  // Get the packed pixels
+  int n;
+  const guint32 *colors = tile_stream_get_packed (stream, &n);
+  if (colors == NULL)
+    {
+      LOG ("tile-stream-get-packed: Failed to get tile.\n");
+      SIGNAL_ERROR (invocation, "could not get tile");
+      return; 
+    } // if there are no colors
+
+  // And return them
+  GimpPixelRgn *rgn = tile_stream_get_padded (stream);
+  GVariant *result[5];
+  result[0] = g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                         colors, n, sizeof (gint32));
+  result[1] = g_variant_new_int32 (rgn->x);
+  result[2] = g_variant_new_int32 (rgn->y);
+  result[3] = g_variant_new_int32 (rgn->w);
+  result[4] = g_variant_new_int32 (rgn->h);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (result, 5));
+} // ggimp_dbus_handle_tile_stream_get_packed
+
 void
 ggimp_dbus_handle_tile_stream_is_valid (const gchar *method_name,
                                         GDBusMethodInvocation *invocation,
@@ -644,6 +2303,119 @@ ggimp_dbus_handle_tile_stream_new (const gchar *method_name,
   g_dbus_method_invocation_return_value (invocation, result);
 } // ggimp_dbus_handle_tile_stream_new
 
+void
+ggimp_dbus_handle_tile_stream_set_format (const gchar *method_name,
+                                          GDBusMethodInvocation *invocation,
+                                          GVariant *parameters)
+{
+  // Grab the parameters
+  int stream, format;
+  g_variant_get (parameters, "(ii)", &stream, &format);
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+  // Update and return
+  int result = tile_stream_set_format (stream, format);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid format %d", format);
+      return;
+    } // if the format is invalid
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_tile_stream_set_format
+
+void
+ggimp_dbus_handle_tile_stream_set_channels (const gchar *method_name,
+                                            GDBusMethodInvocation *invocation,
+                                            GVariant *parameters)
+{
+  // Grab the parameters
+  int stream, channels;
+  g_variant_get (parameters, "(ii)", &stream, &channels);
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+  // Update and return
+  int result = tile_stream_set_channels (stream, channels);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid channel mask %d", channels);
+      return;
+    } // if the mask is invalid
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_tile_stream_set_channels
+
+void
+ggimp_dbus_handle_tile_stream_set_halo (const gchar *method_name,
+                                        GDBusMethodInvocation *invocation,
+                                        GVariant *parameters)
+{
+  // Grab the parameters
+  int stream, halo, mode;
+  g_variant_get (parameters, "(iii)", &stream, &halo, &mode);
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+  // Update and return
+  int result = tile_stream_set_halo (stream, halo, mode);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid halo %d or mode %d", 
+                             halo, mode);
+      return;
+    } // if the halo is invalid
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_tile_stream_set_halo
+
+void
+ggimp_dbus_handle_tile_stream_set_layout (const gchar *method_name,
+                                          GDBusMethodInvocation *invocation,
+                                          GVariant *parameters)
+{
+  // Grab the parameters
+  int stream, layout;
+  g_variant_get (parameters, "(ii)", &stream, &layout);
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+  // Update and return
+  int result = tile_stream_set_layout (stream, layout);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "invalid layout %d", layout);
+      return;
+    } // if the layout is invalid
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_tile_stream_set_layout
+
+void
+ggimp_dbus_handle_tile_stream_set_lookahead (const gchar *method_name,
+                                             GDBusMethodInvocation *invocation,
+                                             GVariant *parameters)
+{
+  // Grab the parameters
+  int stream = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  int lookahead = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 1));
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+  if (lookahead < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, "lookahead must be non-negative");
+      return;
+    } // if the lookahead is negative
+  // Update and return
+  GVariant *result = 
+    g_variant_new ("(i)", tile_stream_set_lookahead (stream, lookahead));
+  g_dbus_method_invocation_return_value (invocation, result);
+} // ggimp_dbus_handle_tile_stream_set_lookahead
+
 void
 ggimp_dbus_handle_tile_update (const gchar *method_name,
                                GDBusMethodInvocation *invocation,
@@ -662,19 +2434,54 @@ ggimp_dbus_handle_tile_update (const gchar *method_name,
   if (size > realsize)
     {
       SIGNAL_ARGUMENT_ERROR (invocation, "size > number of bytes");
+      g_variant_unref (wrapped_data);
       return;
     }
   // Validate
   if (! handler_validate_tile_stream (stream, invocation))
-    return;
+    {
+      g_variant_unref (wrapped_data);
+      return;
+    } // if the stream is invalid
 
   // Call the underlying function
-  int result = tile_update (stream, size, data);
+  int result = tile_update_bytes (stream, size, data);
+  g_variant_unref (wrapped_data);
   // And return
   g_dbus_method_invocation_return_value (invocation, 
                                          g_variant_new ("(i)", result));
 } // ggimp_dbus_handle_tile_update
 
+void
+ggimp_dbus_handle_tile_update_packed (const gchar *method_name,
+                                      GDBusMethodInvocation *invocation,
+                                      GVariant *parameters)
+{
+  // Grab the parameters
+  int stream = 
+    g_variant_get_int32 (g_variant_get_child_value (parameters, 0));
+  gsize n;
+  const guint32 *colors = 
+    g_variant_get_fixed_array (g_variant_get_child_value (parameters, 1),
+                               &n, sizeof (gint32));
+  // Validate
+  if (! handler_validate_tile_stream (stream, invocation))
+    return;
+
+  // Call the underlying function
+  int result = tile_update_packed (stream, (int) MIN (n, G_MAXINT), colors);
+  if (result < 0)
+    {
+      SIGNAL_ARGUMENT_ERROR (invocation, 
+                             "could not update tile with %lu colors",
+                             (unsigned long) n);
+      return;
+    } // if the update failed
+  // And return
+  g_dbus_method_invocation_return_value (invocation, 
+                                         g_variant_new ("(i)", result));
+} // ggimp_dbus_handle_tile_update_packed
+
 
 // +------------------------+------------------------------------------
 // | Standard DBus Handlers |
@@ -692,15 +2499,68 @@ alt_handle_method_call (GDBusConnection       *connection,
 {
   static HandlerEntry alt_handlers[] =
     {
+      { "apply_lut",            ggimp_dbus_handle_apply_lut            },
+      { "buffer_stream_advance",
+                                ggimp_dbus_handle_buffer_stream_advance },
+      { "buffer_stream_close",  ggimp_dbus_handle_buffer_stream_close  },
+      { "buffer_stream_get",    ggimp_dbus_handle_buffer_stream_get    },
+      { "buffer_stream_new",    ggimp_dbus_handle_buffer_stream_new    },
+      { "buffer_stream_update", ggimp_dbus_handle_buffer_stream_update },
+      { "convolve",             ggimp_dbus_handle_convolve             },
+      { "draw_commands",        ggimp_dbus_handle_draw_commands        },
       { "ggimp_about",          ggimp_dbus_handle_about                },
+      { "ggimp_irgb_blue",      ggimp_dbus_handle_irgb_component       },
+      { "ggimp_irgb_from_rgba", ggimp_dbus_handle_irgb_from_rgba       },
+      { "ggimp_irgb_green",     ggimp_dbus_handle_irgb_component       },
+      { "ggimp_irgb_new",       ggimp_dbus_handle_irgb_new             },
+      { "ggimp_irgb_pack",      ggimp_dbus_handle_irgb_pack            },
+      { "ggimp_irgb_red",       ggimp_dbus_handle_irgb_component       },
+      { "ggimp_irgb_to_rgba",   ggimp_dbus_handle_irgb_to_rgba         },
+      { "ggimp_irgb_unpack",    ggimp_dbus_handle_irgb_unpack          },
       { "ggimp_quit",           ggimp_dbus_handle_quit                 },
+      { "ggimp_rgb_list",       ggimp_dbus_handle_rgb_list             },
+      { "ggimp_rgb_nearest_name_batch",
+                                ggimp_dbus_handle_rgb_nearest_name_batch },
+      { "ggimp_rgb_parse",      ggimp_dbus_handle_rgb_parse            },
+      { "ggimp_rgb_parse_batch",
+                                ggimp_dbus_handle_rgb_parse_batch      },
       { "ggimp_rgb_red",        ggimp_dbus_handle_rgb_red              },
+      { "pixel_map",            ggimp_dbus_handle_pixel_map            },
+      { "pixels_get",           ggimp_dbus_handle_pixels_get           },
+      { "pixels_set",           ggimp_dbus_handle_pixels_set           },
+      { "region_get",           ggimp_dbus_handle_region_get           },
+      { "region_get_layout",    ggimp_dbus_handle_region_get           },
+      { "region_match",         ggimp_dbus_handle_region_match         },
+      { "region_put",           ggimp_dbus_handle_region_put           },
+      { "region_put_layout",    ggimp_dbus_handle_region_put           },
+      { "region_resample",      ggimp_dbus_handle_region_resample      },
+      { "region_set_chunk_size",
+                                ggimp_dbus_handle_region_set_chunk_size },
+      { "region_stats",         ggimp_dbus_handle_region_stats         },
+      { "region_stats_sampled", ggimp_dbus_handle_region_stats         },
+      { "tile_get",             ggimp_dbus_handle_tile_get             },
+      { "tile_get_lod",         ggimp_dbus_handle_tile_get_lod         },
+      { "tile_lod_invalidate",  ggimp_dbus_handle_tile_lod_invalidate  },
+      { "tile_put",             ggimp_dbus_handle_tile_put             },
       { "tile_stream_advance",  ggimp_dbus_handle_tile_stream_advance  },
       { "tile_stream_close",    ggimp_dbus_handle_tile_stream_close    },
       { "tile_stream_get",      ggimp_dbus_handle_tile_stream_get      },
+      { "tile_stream_get_packed",
+                                ggimp_dbus_handle_tile_stream_get_packed },
       { "tile_stream_is_valid", ggimp_dbus_handle_tile_stream_is_valid },
       { "tile_stream_new",      ggimp_dbus_handle_tile_stream_new      },
+      { "tile_stream_set_format",
+                                ggimp_dbus_handle_tile_stream_set_format },
+      { "tile_stream_set_channels",
+                                ggimp_dbus_handle_tile_stream_set_channels },
+      { "tile_stream_set_halo",
+                                ggimp_dbus_handle_tile_stream_set_halo },
+      { "tile_stream_set_layout",
+                                ggimp_dbus_handle_tile_stream_set_layout },
+      { "tile_stream_set_lookahead",
+                                ggimp_dbus_handle_tile_stream_set_lookahead },
       { "tile_update",          ggimp_dbus_handle_tile_update          },
+      { "tile_update_packed",   ggimp_dbus_handle_tile_update_packed   },
       { NULL,                   ggimp_dbus_handle_default              }
     };
 
@@ -1565,6 +3425,9 @@ gimp_dbus_handle_pdb_method_call (GDBusConnection       *connection,
   values = gimp_run_procedure2 (proc_name, &nvalues, nparams, actuals);
   LOG ("Ran %s", proc_name);
 
+  // The procedure may have changed any drawable (even if it failed)
+  mipmap_invalidate_all ();
+
   // Check to make sure that the call succeeded.  
   if (values == NULL)
     {
@@ -1747,6 +3610,10 @@ run_server (const gchar      *name,
    
   g_type_init ();
 
+  // Build the tables that we'd rather not build on every call.
+  color_names_init ();
+  tile_pool_init ();
+
   LOG ("About to make node.");
   pdbnode = g_dbus_node_info_new (NULL, interfaces, NULL, NULL);
   LOG ("Made node.");
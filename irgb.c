@@ -0,0 +1,755 @@
+/**
+ * irgb.c
+ *   Conversions between integer-encoded RGB colors (irgb colors, as
+ *   created by ggimp-irgb-new) and the pixels stored in drawables.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+#include "irgb.h"
+#include "simd.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * Weights for computing luminance, scaled so that they sum to 256.
+ * (These approximate the Rec. 709 weights that the GIMP uses.)
+ */
+#define LUMINANCE_RED 54
+#define LUMINANCE_GREEN 183
+#define LUMINANCE_BLUE 19
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * One implementation of each of the batch functions.
+ */
+struct IrgbKernels
+  {
+    const char *name;
+    void (*pack_planes) (const guchar *r, const guchar *g, const guchar *b,
+                         gint32 *colors, gsize n);
+    void (*unpack_planes) (const gint32 *colors, 
+                           guchar *r, guchar *g, guchar *b, gsize n);
+    void (*from_rgba) (const guchar *rgba, gint32 *colors, gsize n);
+    void (*to_rgba) (const gint32 *colors, guchar *rgba, gsize n);
+    void (*pixels_to_ints) (const guchar *pixels, int bpp,
+                            guint32 *ints, gsize n, IrgbFormat format);
+    void (*ints_to_pixels) (const guint32 *ints, IrgbFormat format,
+                            guchar *pixels, int bpp, gsize n);
+  };
+typedef struct IrgbKernels IrgbKernels;
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Compute the (integer) luminance of a color given by components.
+ */
+static inline int
+luminance (int r, int g, int b)
+{
+  return (LUMINANCE_RED * r + LUMINANCE_GREEN * g + LUMINANCE_BLUE * b) >> 8;
+} // luminance
+
+gint32
+irgb_new (int r, int g, int b)
+{
+  return (CLAMP (r, 0, 255) << 16) | (CLAMP (g, 0, 255) << 8) 
+         | CLAMP (b, 0, 255);
+} // irgb_new
+
+int
+irgb_luminance (gint32 color)
+{
+  return luminance (IRGB_RED (color), IRGB_GREEN (color), IRGB_BLUE (color));
+} // irgb_luminance
+
+gint32
+irgb_from_pixel (const guchar *pixel, int bpp)
+{
+  switch (bpp)
+    {
+    case 1:
+    case 2:
+      return (pixel[0] << 16) | (pixel[0] << 8) | pixel[0];
+    default:
+      return (pixel[0] << 16) | (pixel[1] << 8) | pixel[2];
+    } // switch
+} // irgb_from_pixel
+
+void
+irgb_to_pixel (gint32 color, guchar *pixel, int bpp)
+{
+  switch (bpp)
+    {
+    case 2:
+      pixel[1] = 255;
+      // Fall through
+    case 1:
+      pixel[0] = (guchar) irgb_luminance (color);
+      break;
+    case 4:
+      pixel[3] = 255;
+      // Fall through
+    default:
+      pixel[0] = (guchar) IRGB_RED (color);
+      pixel[1] = (guchar) IRGB_GREEN (color);
+      pixel[2] = (guchar) IRGB_BLUE (color);
+      break;
+    } // switch
+} // irgb_to_pixel
+
+
+// +----------------+--------------------------------------------------
+// | Scalar Kernels |
+// +----------------+
+
+/*
+  The scalar kernels double as the reference implementations and as
+  the code that handles whatever is left over after the vector kernels
+  have processed as many full vectors as they can.
+ */
+
+static void
+pack_planes_scalar (const guchar *r, const guchar *g, const guchar *b,
+                    gint32 *colors, gsize n)
+{
+  gsize i;
+  for (i = 0; i < n; i++)
+    colors[i] = (r[i] << 16) | (g[i] << 8) | b[i];
+} // pack_planes_scalar
+
+static void
+unpack_planes_scalar (const gint32 *colors, 
+                      guchar *r, guchar *g, guchar *b, gsize n)
+{
+  gsize i;
+  for (i = 0; i < n; i++)
+    {
+      r[i] = (guchar) IRGB_RED (colors[i]);
+      g[i] = (guchar) IRGB_GREEN (colors[i]);
+      b[i] = (guchar) IRGB_BLUE (colors[i]);
+    } // for
+} // unpack_planes_scalar
+
+static void
+from_rgba_scalar (const guchar *rgba, gint32 *colors, gsize n)
+{
+  gsize i;
+  for (i = 0; i < n; i++, rgba += 4)
+    colors[i] = (rgba[0] << 16) | (rgba[1] << 8) | rgba[2];
+} // from_rgba_scalar
+
+static void
+to_rgba_scalar (const gint32 *colors, guchar *rgba, gsize n)
+{
+  gsize i;
+  for (i = 0; i < n; i++, rgba += 4)
+    {
+      rgba[0] = (guchar) IRGB_RED (colors[i]);
+      rgba[1] = (guchar) IRGB_GREEN (colors[i]);
+      rgba[2] = (guchar) IRGB_BLUE (colors[i]);
+      rgba[3] = 255;
+    } // for
+} // to_rgba_scalar
+
+/**
+ * Pack one pixel into an integer.  (Always called with constant bpp
+ * and format, so the compiler can discard the branches.)
+ */
+static inline guint32
+pixel_to_int (const guchar *pixel, const int bpp, const IrgbFormat format)
+{
+  guint32 r, g, b, a;
+  if (bpp < 3)
+    r = g = b = pixel[0];
+  else
+    {
+      r = pixel[0];
+      g = pixel[1];
+      b = pixel[2];
+    } // if the pixel is in color
+  a = ((bpp == 2) || (bpp == 4)) ? pixel[bpp - 1] : 255;
+  if (format == IRGB_FORMAT_RGBA32)
+    return (r << 24) | (g << 16) | (b << 8) | a;
+  else
+    return (r << 16) | (g << 8) | b;
+} // pixel_to_int
+
+/**
+ * Unpack an integer into one pixel.  (Always called with constant bpp
+ * and format.)
+ */
+static inline void
+int_to_pixel (guint32 v, const IrgbFormat format,
+              guchar *pixel, const int bpp)
+{
+  int r, g, b, a;
+  if (format == IRGB_FORMAT_RGBA32)
+    {
+      r = v >> 24;
+      g = (v >> 16) & 255;
+      b = (v >> 8) & 255;
+      a = v & 255;
+    }
+  else
+    {
+      r = (v >> 16) & 255;
+      g = (v >> 8) & 255;
+      b = v & 255;
+      a = 255;
+    }
+  if (bpp < 3)
+    pixel[0] = (guchar) luminance (r, g, b);
+  else
+    {
+      pixel[0] = (guchar) r;
+      pixel[1] = (guchar) g;
+      pixel[2] = (guchar) b;
+    } // if the pixel is in color
+  if ((bpp == 2) || (bpp == 4))
+    pixel[bpp - 1] = (guchar) a;
+} // int_to_pixel
+
+/**
+ * Expand a loop over all n pixels for one particular bpp and format.
+ */
+#define SPECIALIZED_LOOP(BPP, FORMAT, BODY) \
+  case (FORMAT) * 8 + (BPP): \
+    for (i = 0; i < n; i++) \
+      BODY (BPP, FORMAT); \
+    break
+
+/**
+ * Expand a loop for every combination of bpp and format, so that each
+ * loop body is compiled with constant offsets.
+ */
+#define SPECIALIZE(BODY) \
+  switch (format * 8 + bpp) \
+    { \
+      SPECIALIZED_LOOP (1, IRGB_FORMAT_IRGB, BODY); \
+      SPECIALIZED_LOOP (2, IRGB_FORMAT_IRGB, BODY); \
+      SPECIALIZED_LOOP (3, IRGB_FORMAT_IRGB, BODY); \
+      SPECIALIZED_LOOP (4, IRGB_FORMAT_IRGB, BODY); \
+      SPECIALIZED_LOOP (1, IRGB_FORMAT_RGBA32, BODY); \
+      SPECIALIZED_LOOP (2, IRGB_FORMAT_RGBA32, BODY); \
+      SPECIALIZED_LOOP (3, IRGB_FORMAT_RGBA32, BODY); \
+      SPECIALIZED_LOOP (4, IRGB_FORMAT_RGBA32, BODY); \
+    }
+
+#define PIXEL_TO_INT(BPP, FORMAT) \
+  ints[i] = pixel_to_int (pixels + (BPP) * i, BPP, FORMAT)
+
+#define INT_TO_PIXEL(BPP, FORMAT) \
+  int_to_pixel (ints[i], FORMAT, pixels + (BPP) * i, BPP)
+
+static void
+pixels_to_ints_scalar (const guchar *pixels, int bpp,
+                       guint32 *ints, gsize n, IrgbFormat format)
+{
+  gsize i;
+  SPECIALIZE (PIXEL_TO_INT);
+} // pixels_to_ints_scalar
+
+static void
+ints_to_pixels_scalar (const guint32 *ints, IrgbFormat format,
+                       guchar *pixels, int bpp, gsize n)
+{
+  gsize i;
+  SPECIALIZE (INT_TO_PIXEL);
+} // ints_to_pixels_scalar
+
+static const IrgbKernels scalar_kernels =
+  {
+    "scalar",
+    pack_planes_scalar,
+    unpack_planes_scalar,
+    from_rgba_scalar,
+    to_rgba_scalar,
+    pixels_to_ints_scalar,
+    ints_to_pixels_scalar
+  };
+
+
+#ifdef HAVE_X86_SIMD
+
+// +--------------+----------------------------------------------------
+// | SSE2 Kernels |
+// +--------------+
+
+static void TARGET_SSE2
+pack_planes_sse2 (const guchar *r, const guchar *g, const guchar *b,
+                  gint32 *colors, gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gsize i;
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      __m128i vr = _mm_loadu_si128 ((const __m128i *) (r + i));
+      __m128i vg = _mm_loadu_si128 ((const __m128i *) (g + i));
+      __m128i vb = _mm_loadu_si128 ((const __m128i *) (b + i));
+      // 16-bit (g << 8) | b and 16-bit r
+      __m128i gb_lo = _mm_unpacklo_epi8 (vb, vg);
+      __m128i gb_hi = _mm_unpackhi_epi8 (vb, vg);
+      __m128i r_lo = _mm_unpacklo_epi8 (vr, zero);
+      __m128i r_hi = _mm_unpackhi_epi8 (vr, zero);
+      // 32-bit (r << 16) | (g << 8) | b
+      __m128i *out = (__m128i *) (colors + i);
+      _mm_storeu_si128 (out, _mm_unpacklo_epi16 (gb_lo, r_lo));
+      _mm_storeu_si128 (out + 1, _mm_unpackhi_epi16 (gb_lo, r_lo));
+      _mm_storeu_si128 (out + 2, _mm_unpacklo_epi16 (gb_hi, r_hi));
+      _mm_storeu_si128 (out + 3, _mm_unpackhi_epi16 (gb_hi, r_hi));
+    } // for each group of 16
+  pack_planes_scalar (r + i, g + i, b + i, colors + i, n - i);
+} // pack_planes_sse2
+
+/**
+ * Extract one byte from each of sixteen 32-bit values.
+ */
+static inline __m128i TARGET_SSE2
+extract_bytes_sse2 (__m128i v0, __m128i v1, __m128i v2, __m128i v3,
+                    int shift)
+{
+  const __m128i mask = _mm_set1_epi32 (255);
+  v0 = _mm_and_si128 (_mm_srli_epi32 (v0, shift), mask);
+  v1 = _mm_and_si128 (_mm_srli_epi32 (v1, shift), mask);
+  v2 = _mm_and_si128 (_mm_srli_epi32 (v2, shift), mask);
+  v3 = _mm_and_si128 (_mm_srli_epi32 (v3, shift), mask);
+  return _mm_packus_epi16 (_mm_packs_epi32 (v0, v1), 
+                           _mm_packs_epi32 (v2, v3));
+} // extract_bytes_sse2
+
+static void TARGET_SSE2
+unpack_planes_sse2 (const gint32 *colors, 
+                    guchar *r, guchar *g, guchar *b, gsize n)
+{
+  gsize i;
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      const __m128i *in = (const __m128i *) (colors + i);
+      __m128i v0 = _mm_loadu_si128 (in);
+      __m128i v1 = _mm_loadu_si128 (in + 1);
+      __m128i v2 = _mm_loadu_si128 (in + 2);
+      __m128i v3 = _mm_loadu_si128 (in + 3);
+      _mm_storeu_si128 ((__m128i *) (r + i), 
+                        extract_bytes_sse2 (v0, v1, v2, v3, 16));
+      _mm_storeu_si128 ((__m128i *) (g + i), 
+                        extract_bytes_sse2 (v0, v1, v2, v3, 8));
+      _mm_storeu_si128 ((__m128i *) (b + i), 
+                        extract_bytes_sse2 (v0, v1, v2, v3, 0));
+    } // for each group of 16
+  unpack_planes_scalar (colors + i, r + i, g + i, b + i, n - i);
+} // unpack_planes_sse2
+
+/**
+ * Swap the lowest and third-lowest byte of each 32-bit value and
+ * clear (or set) the highest byte.  This takes RGBA to irgb and 
+ * irgb to RGBA.
+ */
+static inline __m128i TARGET_SSE2
+swap_red_blue_sse2 (__m128i v, __m128i alpha)
+{
+  const __m128i byte = _mm_set1_epi32 (255);
+  const __m128i green = _mm_set1_epi32 (255 << 8);
+  __m128i lo = _mm_slli_epi32 (_mm_and_si128 (v, byte), 16);
+  __m128i hi = _mm_and_si128 (_mm_srli_epi32 (v, 16), byte);
+  __m128i mid = _mm_and_si128 (v, green);
+  return _mm_or_si128 (_mm_or_si128 (lo, hi), _mm_or_si128 (mid, alpha));
+} // swap_red_blue_sse2
+
+static void TARGET_SSE2
+from_rgba_sse2 (const guchar *rgba, gint32 *colors, gsize n)
+{
+  const __m128i alpha = _mm_setzero_si128 ();
+  gsize i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (rgba + 4 * i));
+      _mm_storeu_si128 ((__m128i *) (colors + i), 
+                        swap_red_blue_sse2 (v, alpha));
+    } // for each group of 4
+  from_rgba_scalar (rgba + 4 * i, colors + i, n - i);
+} // from_rgba_sse2
+
+static void TARGET_SSE2
+to_rgba_sse2 (const gint32 *colors, guchar *rgba, gsize n)
+{
+  const __m128i alpha = _mm_set1_epi32 (0xFF000000);
+  gsize i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (colors + i));
+      _mm_storeu_si128 ((__m128i *) (rgba + 4 * i), 
+                        swap_red_blue_sse2 (v, alpha));
+    } // for each group of 4
+  to_rgba_scalar (colors + i, rgba + 4 * i, n - i);
+} // to_rgba_sse2
+
+static const IrgbKernels sse2_kernels =
+  {
+    "sse2",
+    pack_planes_sse2,
+    unpack_planes_sse2,
+    from_rgba_sse2,
+    to_rgba_sse2,
+    pixels_to_ints_scalar,
+    ints_to_pixels_scalar
+  };
+
+
+// +---------------+---------------------------------------------------
+// | SSSE3 Kernels |
+// +---------------+
+
+/*
+  Converting between pixels and packed integers is just a byte
+  shuffle, so for each bpp and format we keep a pshufb mask that turns
+  four pixels into four integers (or back again) plus a constant that
+  fills in the bytes the shuffle zeroes (the opaque alpha).  0x80
+  entries produce zero.
+ */
+
+#define Z 0x80
+
+/**
+ * Masks to turn four pixels into four integers, indexed by format
+ * and bpp.
+ */
+static const guchar pixels_to_ints_masks[3][5][16] =
+  {
+    { { 0 } },
+    { // IRGB_FORMAT_IRGB
+      { 0 },
+      { 0, 0, 0, Z, 1, 1, 1, Z, 2, 2, 2, Z, 3, 3, 3, Z },
+      { 0, 0, 0, Z, 2, 2, 2, Z, 4, 4, 4, Z, 6, 6, 6, Z },
+      { 2, 1, 0, Z, 5, 4, 3, Z, 8, 7, 6, Z, 11, 10, 9, Z },
+      { 2, 1, 0, Z, 6, 5, 4, Z, 10, 9, 8, Z, 14, 13, 12, Z }
+    },
+    { // IRGB_FORMAT_RGBA32
+      { 0 },
+      { Z, 0, 0, 0, Z, 1, 1, 1, Z, 2, 2, 2, Z, 3, 3, 3 },
+      { 1, 0, 0, 0, 3, 2, 2, 2, 5, 4, 4, 4, 7, 6, 6, 6 },
+      { Z, 2, 1, 0, Z, 5, 4, 3, Z, 8, 7, 6, Z, 11, 10, 9 },
+      { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 }
+    }
+  };
+
+/**
+ * Masks to turn four integers into four pixels, indexed by format and
+ * bpp.  Only three and four bpp are simple shuffles; gray needs the
+ * luminance.
+ */
+static const guchar ints_to_pixels_masks[3][5][16] =
+  {
+    { { 0 } },
+    { // IRGB_FORMAT_IRGB
+      { 0 }, { 0 }, { 0 },
+      { 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, Z, Z, Z, Z },
+      { 2, 1, 0, Z, 6, 5, 4, Z, 10, 9, 8, Z, 14, 13, 12, Z }
+    },
+    { // IRGB_FORMAT_RGBA32
+      { 0 }, { 0 }, { 0 },
+      { 3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, Z, Z, Z, Z },
+      { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 }
+    }
+  };
+
+#undef Z
+
+static void TARGET_SSSE3
+pixels_to_ints_ssse3 (const guchar *pixels, int bpp,
+                      guint32 *ints, gsize n, IrgbFormat format)
+{
+  __m128i mask;
+  __m128i fill;
+  gsize i;
+
+  if ((bpp < 1) || (bpp > 4))
+    return;
+  mask = _mm_loadu_si128 ((const __m128i *) pixels_to_ints_masks[format][bpp]);
+  // Pixels without alpha are opaque
+  fill = _mm_set1_epi32 (((format == IRGB_FORMAT_RGBA32) && (bpp & 1))
+                         ? 0xFF : 0);
+  // We load 16 bytes for every 4 pixels, so stop while that is safe.
+  for (i = 0; i * bpp + 16 <= n * bpp; i += 4)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (pixels + i * bpp));
+      _mm_storeu_si128 ((__m128i *) (ints + i),
+                        _mm_or_si128 (_mm_shuffle_epi8 (v, mask), fill));
+    } // for each group of 4
+  pixels_to_ints_scalar (pixels + i * bpp, bpp, ints + i, n - i, format);
+} // pixels_to_ints_ssse3
+
+static void TARGET_SSSE3
+ints_to_pixels_ssse3 (const guint32 *ints, IrgbFormat format,
+                      guchar *pixels, int bpp, gsize n)
+{
+  __m128i mask;
+  __m128i fill;
+  gsize i;
+
+  if (bpp < 3)
+    {
+      ints_to_pixels_scalar (ints, format, pixels, bpp, n);
+      return;
+    } // if the pixels are gray
+  if (bpp > 4)
+    return;
+  mask = _mm_loadu_si128 ((const __m128i *) ints_to_pixels_masks[format][bpp]);
+  fill = _mm_set1_epi32 (((format == IRGB_FORMAT_IRGB) && (bpp == 4))
+                         ? (int) 0xFF000000 : 0);
+  // We store 16 bytes for every 4 pixels (the last 4 of which are
+  // junk when bpp is 3 and get overwritten next time around), so stop
+  // while that is safe.
+  for (i = 0; i * bpp + 16 <= n * bpp; i += 4)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (ints + i));
+      _mm_storeu_si128 ((__m128i *) (pixels + i * bpp),
+                        _mm_or_si128 (_mm_shuffle_epi8 (v, mask), fill));
+    } // for each group of 4
+  ints_to_pixels_scalar (ints + i, format, pixels + i * bpp, bpp, n - i);
+} // ints_to_pixels_ssse3
+
+static const IrgbKernels ssse3_kernels =
+  {
+    "ssse3",
+    pack_planes_sse2,
+    unpack_planes_sse2,
+    from_rgba_sse2,
+    to_rgba_sse2,
+    pixels_to_ints_ssse3,
+    ints_to_pixels_ssse3
+  };
+
+
+// +--------------+----------------------------------------------------
+// | AVX2 Kernels |
+// +--------------+
+
+static void TARGET_AVX2
+pack_planes_avx2 (const guchar *r, const guchar *g, const guchar *b,
+                  gint32 *colors, gsize n)
+{
+  gsize i;
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256i vr = 
+        _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (r + i)));
+      __m256i vg = 
+        _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (g + i)));
+      __m256i vb = 
+        _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (b + i)));
+      __m256i c = _mm256_or_si256 (_mm256_slli_epi32 (vr, 16),
+                                   _mm256_or_si256 (_mm256_slli_epi32 (vg, 8),
+                                                    vb));
+      _mm256_storeu_si256 ((__m256i *) (colors + i), c);
+    } // for each group of 8
+  pack_planes_scalar (r + i, g + i, b + i, colors + i, n - i);
+} // pack_planes_avx2
+
+/**
+ * Extract one byte from each of thirty-two 32-bit values.
+ */
+static inline __m256i TARGET_AVX2
+extract_bytes_avx2 (__m256i v0, __m256i v1, __m256i v2, __m256i v3,
+                    int shift)
+{
+  const __m256i mask = _mm256_set1_epi32 (255);
+  // The packs work within 128-bit lanes, so we need to put the
+  // 32-bit groups back in order afterwards.
+  const __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+  v0 = _mm256_and_si256 (_mm256_srli_epi32 (v0, shift), mask);
+  v1 = _mm256_and_si256 (_mm256_srli_epi32 (v1, shift), mask);
+  v2 = _mm256_and_si256 (_mm256_srli_epi32 (v2, shift), mask);
+  v3 = _mm256_and_si256 (_mm256_srli_epi32 (v3, shift), mask);
+  __m256i bytes = _mm256_packus_epi16 (_mm256_packs_epi32 (v0, v1),
+                                       _mm256_packs_epi32 (v2, v3));
+  return _mm256_permutevar8x32_epi32 (bytes, order);
+} // extract_bytes_avx2
+
+static void TARGET_AVX2
+unpack_planes_avx2 (const gint32 *colors, 
+                    guchar *r, guchar *g, guchar *b, gsize n)
+{
+  gsize i;
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      const __m256i *in = (const __m256i *) (colors + i);
+      __m256i v0 = _mm256_loadu_si256 (in);
+      __m256i v1 = _mm256_loadu_si256 (in + 1);
+      __m256i v2 = _mm256_loadu_si256 (in + 2);
+      __m256i v3 = _mm256_loadu_si256 (in + 3);
+      _mm256_storeu_si256 ((__m256i *) (r + i), 
+                           extract_bytes_avx2 (v0, v1, v2, v3, 16));
+      _mm256_storeu_si256 ((__m256i *) (g + i), 
+                           extract_bytes_avx2 (v0, v1, v2, v3, 8));
+      _mm256_storeu_si256 ((__m256i *) (b + i), 
+                           extract_bytes_avx2 (v0, v1, v2, v3, 0));
+    } // for each group of 32
+  unpack_planes_sse2 (colors + i, r + i, g + i, b + i, n - i);
+} // unpack_planes_avx2
+
+/**
+ * Swap the lowest and third-lowest byte of each 32-bit value and
+ * clear (or set) the highest byte.
+ */
+static inline __m256i TARGET_AVX2
+swap_red_blue_avx2 (__m256i v, __m256i alpha)
+{
+  const __m256i byte = _mm256_set1_epi32 (255);
+  const __m256i green = _mm256_set1_epi32 (255 << 8);
+  __m256i lo = _mm256_slli_epi32 (_mm256_and_si256 (v, byte), 16);
+  __m256i hi = _mm256_and_si256 (_mm256_srli_epi32 (v, 16), byte);
+  __m256i mid = _mm256_and_si256 (v, green);
+  return _mm256_or_si256 (_mm256_or_si256 (lo, hi), 
+                          _mm256_or_si256 (mid, alpha));
+} // swap_red_blue_avx2
+
+static void TARGET_AVX2
+from_rgba_avx2 (const guchar *rgba, gint32 *colors, gsize n)
+{
+  const __m256i alpha = _mm256_setzero_si256 ();
+  gsize i;
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (rgba + 4 * i));
+      _mm256_storeu_si256 ((__m256i *) (colors + i), 
+                           swap_red_blue_avx2 (v, alpha));
+    } // for each group of 8
+  from_rgba_scalar (rgba + 4 * i, colors + i, n - i);
+} // from_rgba_avx2
+
+static void TARGET_AVX2
+to_rgba_avx2 (const gint32 *colors, guchar *rgba, gsize n)
+{
+  const __m256i alpha = _mm256_set1_epi32 (0xFF000000);
+  gsize i;
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (colors + i));
+      _mm256_storeu_si256 ((__m256i *) (rgba + 4 * i), 
+                           swap_red_blue_avx2 (v, alpha));
+    } // for each group of 8
+  to_rgba_scalar (colors + i, rgba + 4 * i, n - i);
+} // to_rgba_avx2
+
+static const IrgbKernels avx2_kernels =
+  {
+    "avx2",
+    pack_planes_avx2,
+    unpack_planes_avx2,
+    from_rgba_avx2,
+    to_rgba_avx2,
+    pixels_to_ints_ssse3,
+    ints_to_pixels_ssse3
+  };
+
+#endif // HAVE_X86_SIMD
+
+
+// +----------+--------------------------------------------------------
+// | Dispatch |
+// +----------+
+
+/**
+ * Pick the best kernels for this CPU.  (We do this once, on first
+ * use.)
+ */
+static const IrgbKernels *
+irgb_kernels (void)
+{
+  static const IrgbKernels *kernels = NULL;
+  if (kernels == NULL)
+    {
+      kernels = &scalar_kernels;
+#ifdef HAVE_X86_SIMD
+      if (SIMD_CPU_SUPPORTS ("avx2"))
+        kernels = &avx2_kernels;
+      else if (SIMD_CPU_SUPPORTS ("ssse3"))
+        kernels = &ssse3_kernels;
+      else if (SIMD_CPU_SUPPORTS ("sse2"))
+        kernels = &sse2_kernels;
+#endif
+    } // if we have not yet picked kernels
+  return kernels;
+} // irgb_kernels
+
+
+// +-----------------+-------------------------------------------------
+// | Batch Functions |
+// +-----------------+
+
+void
+irgb_pack_planes (const guchar *r, const guchar *g, const guchar *b,
+                  gint32 *colors, gsize n)
+{
+  irgb_kernels ()->pack_planes (r, g, b, colors, n);
+} // irgb_pack_planes
+
+void
+irgb_unpack_planes (const gint32 *colors, 
+                    guchar *r, guchar *g, guchar *b, gsize n)
+{
+  irgb_kernels ()->unpack_planes (colors, r, g, b, n);
+} // irgb_unpack_planes
+
+void
+irgb_from_rgba (const guchar *rgba, gint32 *colors, gsize n)
+{
+  irgb_kernels ()->from_rgba (rgba, colors, n);
+} // irgb_from_rgba
+
+void
+irgb_to_rgba (const gint32 *colors, guchar *rgba, gsize n)
+{
+  irgb_kernels ()->to_rgba (colors, rgba, n);
+} // irgb_to_rgba
+
+void
+irgb_pixels_to_ints (const guchar *pixels, int bpp,
+                     guint32 *ints, gsize n, IrgbFormat format)
+{
+  irgb_kernels ()->pixels_to_ints (pixels, bpp, ints, n, format);
+} // irgb_pixels_to_ints
+
+void
+irgb_ints_to_pixels (const guint32 *ints, IrgbFormat format,
+                     guchar *pixels, int bpp, gsize n)
+{
+  irgb_kernels ()->ints_to_pixels (ints, format, pixels, bpp, n);
+} // irgb_ints_to_pixels
+
+const char *
+irgb_kernel_name (void)
+{
+  return irgb_kernels ()->name;
+} // irgb_kernel_name
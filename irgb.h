@@ -0,0 +1,148 @@
+#ifndef __IRGB_H__
+#define __IRGB_H__
+
+/**
+ * irgb.h
+ *   Conversions between integer-encoded RGB colors (irgb colors, as
+ *   created by ggimp-irgb-new) and the pixels stored in drawables.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  An irgb color packs the red, green, and blue components of a color
+  into the low 24 bits of an integer, as (r << 16) | (g << 8) | b.
+
+  Drawables store 1 (gray), 2 (gray and alpha), 3 (rgb), or 4 (rgb and
+  alpha) bytes per pixel.  When we convert a pixel to an irgb color,
+  gray values become r = g = b and alpha is dropped.  When we convert
+  an irgb color to a pixel, gray drawables get the luminance of the
+  color and alpha is set to fully opaque.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+
+// +--------+----------------------------------------------------------
+// | Macros |
+// +--------+
+
+#define IRGB_RED(COLOR) (((COLOR) >> 16) & 255)
+#define IRGB_GREEN(COLOR) (((COLOR) >> 8) & 255)
+#define IRGB_BLUE(COLOR) ((COLOR) & 255)
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The ways in which we can pack a pixel into a 32-bit integer.
+ */
+enum IrgbFormat
+  {
+    IRGB_FORMAT_IRGB = 1,       // (r << 16) | (g << 8) | b
+    IRGB_FORMAT_RGBA32 = 2      // (r << 24) | (g << 16) | (b << 8) | a
+  };
+typedef enum IrgbFormat IrgbFormat;
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Build an irgb color from its components.  Components are clamped
+ * to the range [0..255].
+ */
+gint32 irgb_new (int r, int g, int b);
+
+/**
+ * Compute the (integer) luminance of an irgb color.
+ */
+int irgb_luminance (gint32 color);
+
+/**
+ * Convert the pixel at pixel, which has bpp bytes, to an irgb color.
+ */
+gint32 irgb_from_pixel (const guchar *pixel, int bpp);
+
+/**
+ * Store an irgb color in the bpp bytes at pixel.
+ */
+void irgb_to_pixel (gint32 color, guchar *pixel, int bpp);
+
+
+// +-----------------+-------------------------------------------------
+// | Batch Functions |
+// +-----------------+
+
+/**
+ * Pack n colors, given as separate red, green, and blue planes, into
+ * irgb colors.
+ */
+void irgb_pack_planes (const guchar *r, const guchar *g, const guchar *b,
+                       gint32 *colors, gsize n);
+
+/**
+ * Unpack n irgb colors into separate red, green, and blue planes.
+ */
+void irgb_unpack_planes (const gint32 *colors, 
+                         guchar *r, guchar *g, guchar *b, gsize n);
+
+/**
+ * Convert n RGBA pixels (4 bytes each) to irgb colors, dropping alpha.
+ */
+void irgb_from_rgba (const guchar *rgba, gint32 *colors, gsize n);
+
+/**
+ * Convert n irgb colors to opaque RGBA pixels (4 bytes each).
+ */
+void irgb_to_rgba (const gint32 *colors, guchar *rgba, gsize n);
+
+/**
+ * Pack n pixels of bpp bytes each into 32-bit integers in the given
+ * format.  Gray pixels have r = g = b, and pixels without alpha are
+ * treated as opaque.
+ */
+void irgb_pixels_to_ints (const guchar *pixels, int bpp,
+                          guint32 *ints, gsize n, IrgbFormat format);
+
+/**
+ * Unpack n 32-bit integers in the given format into pixels of bpp
+ * bytes each.  Gray pixels get the luminance of the color.  For
+ * IRGB_FORMAT_IRGB, pixels with alpha are made opaque.
+ */
+void irgb_ints_to_pixels (const guint32 *ints, IrgbFormat format,
+                          guchar *pixels, int bpp, gsize n);
+
+/**
+ * Get the name of the instruction set used by the batch functions
+ * (e.g., "avx2", "ssse3", "sse2", or "scalar").
+ */
+const char *irgb_kernel_name (void);
+
+#endif // __IRGB_H__
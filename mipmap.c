@@ -0,0 +1,460 @@
+/**
+ * mipmap.c
+ *   Serve the tiles of a drawable at reduced sizes.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <string.h>             // For memcpy
+
+#include "mipmap.h"
+#include "tile-kernels.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The most drawables whose tiles we cache at once.
+ */
+#define MAX_PYRAMIDS 8
+
+/**
+ * The most bytes of tiles we cache, over all drawables.
+ */
+#define MAX_CACHE_BYTES (64 * 1024 * 1024)
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The cached tiles of one level.  tiles has rows rows of cols
+ * entries, each NULL until the tile is made.  (NULL if we have not
+ * made any tiles of this level.)  Pixels with alpha are kept
+ * premultiplied, so that averaging weights each color by its alpha.
+ */
+struct MipmapLevel
+  {
+    int cols;
+    int rows;
+    TileBuffer **tiles;
+  };
+typedef struct MipmapLevel MipmapLevel;
+
+/**
+ * The cached tiles of one drawable.
+ */
+struct Pyramid
+  {
+    int drawable;
+    int width;                  // The drawable, as of when we started
+    int height;
+    int bpp;
+    int nlevels;
+    MipmapLevel *levels;        // levels[0] is unused
+    guint64 used;               // When we last used it
+  };
+typedef struct Pyramid Pyramid;
+
+
+// +---------+---------------------------------------------------------
+// | Globals |
+// +---------+
+
+/**
+ * The drawables whose tiles we cache.
+ */
+static Pyramid *pyramids[MAX_PYRAMIDS];
+
+/**
+ * The number of bytes in all the cached tiles.
+ */
+static gsize cache_bytes = 0;
+
+/**
+ * Counts the uses of pyramids, so that we can tell which was used
+ * least recently.
+ */
+static guint64 uses = 0;
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Get the size of level level of an extent of size pixels.
+ */
+static int
+level_size (int size, int level)
+{
+  return ((size - 1) >> level) + 1;
+} // level_size
+
+/**
+ * Allocate a tile buffer with a tight rowstride.  Returns NULL if
+ * there is not enough memory.
+ */
+static TileBuffer *
+lod_buffer_new (int x, int y, int width, int height, int bpp)
+{
+  TileBuffer *buffer = g_try_new0 (TileBuffer, 1);
+  if (buffer == NULL)
+    return NULL;
+  buffer->x = x;
+  buffer->y = y;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->bpp = bpp;
+  buffer->rowstride = width * bpp;
+  buffer->layout = TILE_LAYOUT_INTERLEAVED;
+  buffer->data = g_try_malloc ((gsize) buffer->rowstride * height);
+  if (buffer->data == NULL)
+    {
+      g_free (buffer);
+      return NULL;
+    } // if we could not allocate the data
+  return buffer;
+} // lod_buffer_new
+
+/**
+ * Drop one cached tile.
+ */
+static void
+pyramid_drop_tile (TileBuffer **slot)
+{
+  if (*slot == NULL)
+    return;
+  cache_bytes -= tile_buffer_size (*slot);
+  tile_buffer_free (*slot);
+  *slot = NULL;
+} // pyramid_drop_tile
+
+/**
+ * Drop the cached tiles of a pyramid in columns left through right
+ * and rows top through bottom of level 0 (inclusive).
+ */
+static void
+pyramid_drop_tiles (Pyramid *pyramid, int left, int top, 
+                    int right, int bottom)
+{
+  int level, c, r;
+  for (level = 1; level < pyramid->nlevels; level++)
+    {
+      MipmapLevel *lod = pyramid->levels + level;
+      if (lod->tiles == NULL)
+        continue;
+      for (r = top >> level; r <= (bottom >> level); r++)
+        for (c = left >> level; c <= (right >> level); c++)
+          pyramid_drop_tile (lod->tiles + r * lod->cols + c);
+    } // for each level
+} // pyramid_drop_tiles
+
+/**
+ * Drop all of the cached tiles of a pyramid.  (The pyramid itself
+ * stays, so any pointers into its levels stay valid.)
+ */
+static void
+pyramid_drop_all (Pyramid *pyramid)
+{
+  int level, i;
+  for (level = 1; level < pyramid->nlevels; level++)
+    {
+      MipmapLevel *lod = pyramid->levels + level;
+      if (lod->tiles != NULL)
+        for (i = 0; i < lod->rows * lod->cols; i++)
+          pyramid_drop_tile (lod->tiles + i);
+    } // for each level
+} // pyramid_drop_all
+
+/**
+ * Free a pyramid and its tiles.
+ */
+static void
+pyramid_free (Pyramid *pyramid)
+{
+  int level;
+  pyramid_drop_all (pyramid);
+  for (level = 1; level < pyramid->nlevels; level++)
+    g_free (pyramid->levels[level].tiles);
+  g_free (pyramid->levels);
+  g_free (pyramid);
+} // pyramid_free
+
+/**
+ * Find the index of the pyramid for a drawable.  Returns -1 if there
+ * is none.
+ */
+static int
+pyramid_find (int drawable)
+{
+  int i;
+  for (i = 0; i < MAX_PYRAMIDS; i++)
+    if ((pyramids[i] != NULL) && (pyramids[i]->drawable == drawable))
+      return i;
+  return -1;
+} // pyramid_find
+
+/**
+ * Get the pyramid for a drawable, creating it (and dropping the least
+ * recently used pyramid, if need be) if there is none, and starting
+ * over if the drawable has changed size or depth.  Returns NULL if
+ * the drawable is invalid or we run out of memory.
+ */
+static Pyramid *
+pyramid_get (int drawable)
+{
+  if (! gimp_drawable_is_valid (drawable))
+    return NULL;
+  int width = gimp_drawable_width (drawable);
+  int height = gimp_drawable_height (drawable);
+  int bpp = gimp_drawable_bpp (drawable);
+
+  // Do we already have one?
+  int i = pyramid_find (drawable);
+  if (i >= 0)
+    {
+      Pyramid *pyramid = pyramids[i];
+      if ((pyramid->width == width) && (pyramid->height == height)
+          && (pyramid->bpp == bpp))
+        {
+          pyramid->used = ++uses;
+          return pyramid;
+        } // if the pyramid is still good
+      pyramid_free (pyramid);
+      pyramids[i] = NULL;
+    } // if we found the drawable
+
+  // Find a place for it
+  for (i = 0; (i < MAX_PYRAMIDS) && (pyramids[i] != NULL); i++)
+    ;
+  if (i == MAX_PYRAMIDS)
+    {
+      int j;
+      i = 0;
+      for (j = 1; j < MAX_PYRAMIDS; j++)
+        if (pyramids[j]->used < pyramids[i]->used)
+          i = j;
+      pyramid_free (pyramids[i]);
+      pyramids[i] = NULL;
+    } // if there's no room
+
+  // Make it.  Level n has 2^n-pixel blocks, so the last level is the
+  // first in which one block covers the drawable.
+  Pyramid *pyramid = g_try_new0 (Pyramid, 1);
+  if (pyramid == NULL)
+    return NULL;
+  pyramid->drawable = drawable;
+  pyramid->width = width;
+  pyramid->height = height;
+  pyramid->bpp = bpp;
+  pyramid->nlevels = 1;
+  while ((level_size (width, pyramid->nlevels - 1) > 1)
+         || (level_size (height, pyramid->nlevels - 1) > 1))
+    ++(pyramid->nlevels);
+  pyramid->levels = g_try_new0 (MipmapLevel, pyramid->nlevels);
+  if (pyramid->levels == NULL)
+    {
+      g_free (pyramid);
+      return NULL;
+    } // if we could not allocate the levels
+  int level;
+  int tw = gimp_tile_width ();
+  int th = gimp_tile_height ();
+  for (level = 0; level < pyramid->nlevels; level++)
+    {
+      pyramid->levels[level].cols = (level_size (width, level) - 1) / tw + 1;
+      pyramid->levels[level].rows = (level_size (height, level) - 1) / th + 1;
+    } // for each level
+  pyramid->used = ++uses;
+  pyramids[i] = pyramid;
+  return pyramid;
+} // pyramid_get
+
+/**
+ * Make room for size more bytes of tiles, dropping the tiles of the
+ * least recently used pyramids, and then, if need be, those of
+ * pyramid itself.
+ */
+static void
+cache_make_room (Pyramid *pyramid, gsize size)
+{
+  while (cache_bytes + size > MAX_CACHE_BYTES)
+    {
+      int i;
+      int victim = -1;
+      for (i = 0; i < MAX_PYRAMIDS; i++)
+        if ((pyramids[i] != NULL) && (pyramids[i] != pyramid)
+            && ((victim < 0) || (pyramids[i]->used < pyramids[victim]->used)))
+          victim = i;
+      if (victim < 0)
+        {
+          pyramid_drop_all (pyramid);
+          return;
+        } // if only this pyramid is left
+      pyramid_free (pyramids[victim]);
+      pyramids[victim] = NULL;
+    } // while
+} // cache_make_room
+
+/**
+ * Get the tile in column tx and row ty of a level (at least 1) of a
+ * pyramid, making it if need be.  The result belongs to the cache.
+ * Returns NULL if we run out of memory.
+ */
+static const TileBuffer *
+pyramid_tile (Pyramid *pyramid, int level, int tx, int ty)
+{
+  MipmapLevel *lod = pyramid->levels + level;
+  if (lod->tiles == NULL)
+    {
+      lod->tiles = g_try_new0 (TileBuffer *, lod->rows * lod->cols);
+      if (lod->tiles == NULL)
+        return NULL;
+    } // if we have not yet made any tiles at this level
+  TileBuffer **slot = lod->tiles + ty * lod->cols + tx;
+  if (*slot != NULL)
+    return *slot;
+
+  // Make a new tile
+  int tw = gimp_tile_width ();
+  int th = gimp_tile_height ();
+  int bpp = pyramid->bpp;
+  int x = tx * tw;
+  int y = ty * th;
+  TileBuffer *tile = 
+    lod_buffer_new (x, y, 
+                    MIN (tw, level_size (pyramid->width, level) - x),
+                    MIN (th, level_size (pyramid->height, level) - y),
+                    bpp);
+  if (tile == NULL)
+    return NULL;
+
+  // Fill in each quarter from the tile below it
+  MipmapLevel *below = pyramid->levels + level - 1;
+  int i, j, r;
+  for (j = 0; j < 2; j++)
+    for (i = 0; i < 2; i++)
+      {
+        int cx = 2 * tx + i;
+        int cy = 2 * ty + j;
+        if ((cx >= below->cols) || (cy >= below->rows))
+          continue;
+        TileBuffer *fetched = NULL;
+        const TileBuffer *child;
+        if (level == 1)
+          child = fetched = drawable_tile_get (pyramid->drawable, cx, cy);
+        else
+          child = pyramid_tile (pyramid, level - 1, cx, cy);
+        if ((child == NULL) || (child->bpp != bpp))
+          {
+            tile_buffer_free (fetched);
+            tile_buffer_free (tile);
+            return NULL;
+          } // if we could not get the tile below
+        if (fetched != NULL)
+          for (r = 0; r < fetched->height; r++)
+            tile_kernel_premultiply (fetched->data + r * fetched->rowstride,
+                                     bpp, fetched->width);
+        guchar *quarter = tile->data + j * (th / 2) * tile->rowstride
+                          + i * (tw / 2) * bpp;
+        for (r = 0; r < child->height; r += 2)
+          tile_kernel_halve (child->data + r * child->rowstride,
+                             child->data 
+                               + MIN (r + 1, child->height - 1) 
+                                 * child->rowstride,
+                             quarter + (r / 2) * tile->rowstride,
+                             bpp, child->width);
+        tile_buffer_free (fetched);
+      } // for each quarter
+
+  // And keep it
+  gsize size = tile_buffer_size (tile);
+  cache_make_room (pyramid, size);
+  cache_bytes += size;
+  *slot = tile;
+  return tile;
+} // pyramid_tile
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+TileBuffer *
+drawable_tile_get_lod (int drawable, int level, int tx, int ty)
+{
+  if (level == 0)
+    return drawable_tile_get (drawable, tx, ty);
+
+  // Validate
+  Pyramid *pyramid = pyramid_get (drawable);
+  if ((pyramid == NULL) || (level < 0) || (level >= pyramid->nlevels)
+      || (tx < 0) || (tx >= pyramid->levels[level].cols)
+      || (ty < 0) || (ty >= pyramid->levels[level].rows))
+    return NULL;
+
+  // Find the tile and copy it
+  const TileBuffer *tile = pyramid_tile (pyramid, level, tx, ty);
+  if (tile == NULL)
+    return NULL;
+  TileBuffer *copy = lod_buffer_new (tile->x, tile->y, 
+                                     tile->width, tile->height, tile->bpp);
+  if (copy == NULL)
+    return NULL;
+  memcpy (copy->data, tile->data, (gsize) tile->rowstride * tile->height);
+  int r;
+  for (r = 0; r < copy->height; r++)
+    tile_kernel_unpremultiply (copy->data + r * copy->rowstride,
+                               copy->bpp, copy->width);
+  return copy;
+} // drawable_tile_get_lod
+
+void
+mipmap_invalidate (int drawable, int x, int y, int width, int height)
+{
+  int i = pyramid_find (drawable);
+  if ((i < 0) || (width <= 0) || (height <= 0))
+    return;
+  int tw = gimp_tile_width ();
+  int th = gimp_tile_height ();
+  Pyramid *pyramid = pyramids[i];
+  x = MAX (x, 0);
+  y = MAX (y, 0);
+  int right = MIN (x + width, pyramid->width) - 1;
+  int bottom = MIN (y + height, pyramid->height) - 1;
+  if ((right < x) || (bottom < y))
+    return;
+  pyramid_drop_tiles (pyramid, x / tw, y / th, right / tw, bottom / th);
+} // mipmap_invalidate
+
+void
+mipmap_invalidate_all (void)
+{
+  int i;
+  for (i = 0; i < MAX_PYRAMIDS; i++)
+    if (pyramids[i] != NULL)
+      pyramid_drop_all (pyramids[i]);
+} // mipmap_invalidate_all
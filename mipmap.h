@@ -0,0 +1,100 @@
+#ifndef __MIPMAP_H__
+#define __MIPMAP_H__
+
+/**
+ * mipmap.h
+ *   Serve the tiles of a drawable at reduced sizes (levels of detail),
+ *   from a cache that is built as the tiles are asked for, so that
+ *   zoomed-out views need not fetch the full-size pixels.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Level 0 is the drawable itself.  Each pixel of level n+1 is the
+  rounded average of a 2x2 block of pixels of level n (or of the 1x2,
+  2x1, or single pixel left at an odd edge), so level n is the
+  drawable shrunk by 2^n, rounding up, and the last level is one
+  pixel.  Colors are weighted by alpha when averaged (the cache keeps
+  its pixels premultiplied), so transparent pixels do not darken or
+  tint their neighbors; alpha itself is a plain average.
+  Each level is split into tiles of the same size as the GIMP's, so a
+  tile at level n covers the same part of the drawable as 4^n tiles
+  at level 0 and takes about 1/4^n of the bytes to send.
+
+  Tiles of levels 1 and up are made only when first asked for, from
+  the four tiles below them (which are made, or fetched from the
+  drawable, as needed), and then kept.  So the first zoomed-out view
+  of a drawable costs about as much as reading it once, and later
+  ones cost nothing but the transfer.
+
+  The cache holds a limited number of drawables and bytes, dropping
+  the least recently used drawables first.  The functions that write
+  pixels through this server drop the cached tiles that cover the
+  change (see mipmap_invalidate).  We cannot tell what a PDB
+  procedure changes, so every call through the PDB interface drops
+  all of the cached tiles (see mipmap_invalidate_all).  We cannot see
+  changes made in the GIMP itself, so clients that allow those should
+  call mipmap_invalidate (the tile_lod_invalidate method) when they
+  happen.
+
+  // Sample usage: the tile at the upper-left corner, at 1/8 size
+  TileBuffer *tile = drawable_tile_get_lod (drawable, 3, 0, 0);
+  ...
+  tile_buffer_free (tile);
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+#include "tile-stream.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Get a copy of the tile in column tx and row ty of level level of a
+ * drawable.  The tile's position and size are in the pixels of that
+ * level.  Returns NULL if there is no such tile or we run out of
+ * memory.  The caller should free the result with tile_buffer_free.
+ */
+TileBuffer *drawable_tile_get_lod (int drawable, int level, int tx, int ty);
+
+/**
+ * Note that the pixels of a rectangle of a drawable have changed, so
+ * that the cached tiles that cover it are made again when next asked
+ * for.
+ */
+void mipmap_invalidate (int drawable, int x, int y, int width, int height);
+
+/**
+ * Note that any drawable may have changed, so that every cached tile
+ * is made again when next asked for.
+ */
+void mipmap_invalidate_all (void);
+
+#endif // __MIPMAP_H__
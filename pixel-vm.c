@@ -0,0 +1,349 @@
+/**
+ * pixel-vm.c
+ *   A tiny virtual machine for per-pixel functions.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+#include <string.h>             // For memcpy and memset
+
+#include "irgb.h"
+#include "pixel-vm.h"
+
+
+
+// +--------+----------------------------------------------------------
+// | Macros |
+// +--------+
+
+/**
+ * Compute EXPR for every lane, storing the result in lane l of d.
+ * The loop bound is a constant, which lets the compiler unroll and
+ * vectorize it.
+ */
+#define EACH_LANE(EXPR) \
+  for (l = 0; l < PIXEL_VM_LANES; l++) \
+    d[l] = (EXPR)
+
+/**
+ * The registers named by the a, b, and c fields of the current
+ * instruction.
+ */
+#define REG_A (regs[instruction->a])
+#define REG_B (regs[instruction->b])
+#define REG_C (regs[instruction->c])
+
+/**
+ * Wrapping arithmetic on 32-bit integers (signed overflow is
+ * undefined in C, unsigned overflow is not).
+ */
+#define WRAP(X,OP,Y) ((gint32) ((guint32) (X) OP (guint32) (Y)))
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+struct PixelProgram
+  {
+    int n;                      // The number of instructions
+    PixelInstruction *code;     // The instructions
+    gboolean stores;            // Does the program store anything?
+  };
+
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Determine if r names a register.
+ */
+static inline gboolean
+valid_register (int r)
+{
+  return (r >= 0) && (r < PIXEL_VM_REGISTERS);
+} // valid_register
+
+/**
+ * Determine if c names a channel.
+ */
+static inline gboolean
+valid_channel (int c)
+{
+  return (c >= 0) && (c < 4);
+} // valid_channel
+
+/**
+ * Determine if an instruction is valid.
+ */
+static gboolean
+valid_instruction (const PixelInstruction *instruction)
+{
+  switch (instruction->op)
+    {
+    case PIXEL_OP_CONST:
+    case PIXEL_OP_X:
+    case PIXEL_OP_Y:
+      return valid_register (instruction->dst);
+    case PIXEL_OP_LOAD:
+      return valid_register (instruction->dst)
+             && valid_channel (instruction->a);
+    case PIXEL_OP_ADD:
+    case PIXEL_OP_SUB:
+    case PIXEL_OP_MUL:
+    case PIXEL_OP_DIV:
+    case PIXEL_OP_MIN:
+    case PIXEL_OP_MAX:
+    case PIXEL_OP_LT:
+    case PIXEL_OP_EQ:
+    case PIXEL_OP_SHR:
+      return valid_register (instruction->dst)
+             && valid_register (instruction->a)
+             && valid_register (instruction->b);
+    case PIXEL_OP_SELECT:
+      return valid_register (instruction->dst)
+             && valid_register (instruction->a)
+             && valid_register (instruction->b)
+             && valid_register (instruction->c);
+    case PIXEL_OP_STORE:
+      return valid_channel (instruction->dst)
+             && valid_register (instruction->a);
+    default:
+      return FALSE;
+    } // switch
+} // valid_instruction
+
+/**
+ * Load up to PIXEL_VM_LANES pixels into the four channel arrays.
+ * Lanes past n get zeros.
+ */
+static void
+load_pixels (const guchar *pixels, int bpp, int n,
+             gint32 channels[4][PIXEL_VM_LANES])
+{
+  int l;
+  memset (channels, 0, 4 * PIXEL_VM_LANES * sizeof (gint32));
+  for (l = 0; l < n; l++, pixels += bpp)
+    {
+      switch (bpp)
+        {
+        case 1:
+        case 2:
+          channels[0][l] = channels[1][l] = channels[2][l] = pixels[0];
+          channels[3][l] = (bpp == 2) ? pixels[1] : 255;
+          break;
+        default:
+          channels[0][l] = pixels[0];
+          channels[1][l] = pixels[1];
+          channels[2][l] = pixels[2];
+          channels[3][l] = (bpp == 4) ? pixels[3] : 255;
+          break;
+        } // switch
+    } // for
+} // load_pixels
+
+/**
+ * Store n pixels from the four channel arrays, whose values are
+ * already in [0,255].
+ */
+static void
+store_pixels (gint32 channels[4][PIXEL_VM_LANES],
+              guchar *pixels, int bpp, int n)
+{
+  int l;
+  for (l = 0; l < n; l++, pixels += bpp)
+    {
+      switch (bpp)
+        {
+        case 1:
+        case 2:
+          pixels[0] = (guchar) irgb_luminance (irgb_new (channels[0][l],
+                                                         channels[1][l],
+                                                         channels[2][l]));
+          if (bpp == 2)
+            pixels[1] = (guchar) channels[3][l];
+          break;
+        default:
+          pixels[0] = (guchar) channels[0][l];
+          pixels[1] = (guchar) channels[1][l];
+          pixels[2] = (guchar) channels[2][l];
+          if (bpp == 4)
+            pixels[3] = (guchar) channels[3][l];
+          break;
+        } // switch
+    } // for
+} // store_pixels
+
+/**
+ * Run a program over one batch of pixels.  in holds the original
+ * channels, out receives the result.
+ */
+static void
+run_batch (const PixelProgram *program,
+           gint32 in[4][PIXEL_VM_LANES], gint32 out[4][PIXEL_VM_LANES],
+           int x, int y)
+{
+  gint32 regs[PIXEL_VM_REGISTERS][PIXEL_VM_LANES];
+  const PixelInstruction *instruction = program->code;
+  const PixelInstruction *end = program->code + program->n;
+  int l;
+
+  memset (regs, 0, sizeof (regs));
+  memcpy (out, in, 4 * PIXEL_VM_LANES * sizeof (gint32));
+
+  for ( ; instruction < end; instruction++)
+    {
+      // Only the fields an operation uses are known to be registers
+      gint32 *d = (instruction->op == PIXEL_OP_STORE)
+                  ? out[instruction->dst] : regs[instruction->dst];
+
+      switch (instruction->op)
+        {
+        case PIXEL_OP_CONST:
+          EACH_LANE (instruction->a);
+          break;
+        case PIXEL_OP_LOAD:
+          memcpy (d, in[instruction->a], PIXEL_VM_LANES * sizeof (gint32));
+          break;
+        case PIXEL_OP_X:
+          EACH_LANE (x + l);
+          break;
+        case PIXEL_OP_Y:
+          EACH_LANE (y);
+          break;
+        case PIXEL_OP_ADD:
+          EACH_LANE (WRAP (REG_A[l], +, REG_B[l]));
+          break;
+        case PIXEL_OP_SUB:
+          EACH_LANE (WRAP (REG_A[l], -, REG_B[l]));
+          break;
+        case PIXEL_OP_MUL:
+          EACH_LANE (WRAP (REG_A[l], *, REG_B[l]));
+          break;
+        case PIXEL_OP_DIV:
+          // Avoid both division by zero and G_MININT32 / -1
+          EACH_LANE ((REG_B[l] == 0) ? 0
+                     : (REG_B[l] == -1) ? WRAP (0, -, REG_A[l])
+                     : REG_A[l] / REG_B[l]);
+          break;
+        case PIXEL_OP_MIN:
+          EACH_LANE (MIN (REG_A[l], REG_B[l]));
+          break;
+        case PIXEL_OP_MAX:
+          EACH_LANE (MAX (REG_A[l], REG_B[l]));
+          break;
+        case PIXEL_OP_LT:
+          EACH_LANE (REG_A[l] < REG_B[l]);
+          break;
+        case PIXEL_OP_EQ:
+          EACH_LANE (REG_A[l] == REG_B[l]);
+          break;
+        case PIXEL_OP_SELECT:
+          EACH_LANE (REG_A[l] ? REG_B[l] : REG_C[l]);
+          break;
+        case PIXEL_OP_SHR:
+          EACH_LANE (REG_A[l] >> (REG_B[l] & 31));
+          break;
+        case PIXEL_OP_STORE:
+          EACH_LANE (CLAMP (REG_A[l], 0, 255));
+          break;
+        } // switch
+    } // for
+} // run_batch
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+int
+pixel_program_validate (int n, const PixelInstruction *code)
+{
+  int i;
+  if (n > PIXEL_VM_MAX_INSTRUCTIONS)
+    return n;
+  for (i = 0; i < n; i++)
+    {
+      if (! valid_instruction (code + i))
+        return i;
+    } // for
+  return -1;
+} // pixel_program_validate
+
+PixelProgram *
+pixel_program_new (int n, const PixelInstruction *code)
+{
+  if ((n < 0) || (pixel_program_validate (n, code) >= 0))
+    return NULL;
+
+  PixelProgram *program = g_new (PixelProgram, 1);
+  program->n = n;
+  program->code = g_new (PixelInstruction, n);
+  if (n > 0)
+    memcpy (program->code, code, n * sizeof (PixelInstruction));
+  program->stores = FALSE;
+  int i;
+  for (i = 0; i < n; i++)
+    if (code[i].op == PIXEL_OP_STORE)
+      program->stores = TRUE;
+  return program;
+} // pixel_program_new
+
+void
+pixel_program_free (PixelProgram *program)
+{
+  if (program == NULL)
+    return;
+  g_free (program->code);
+  g_free (program);
+} // pixel_program_free
+
+void
+pixel_program_run (const PixelProgram *program,
+                   const guchar *src, guchar *dst, int bpp, int n,
+                   int x, int y)
+{
+  gint32 in[4][PIXEL_VM_LANES];
+  gint32 out[4][PIXEL_VM_LANES];
+  int start;
+
+  // A program that stores nothing leaves the pixels alone
+  if (! program->stores)
+    {
+      if (src != dst)
+        memcpy (dst, src, (gsize) n * bpp);
+      return;
+    } // if the program stores nothing
+
+  for (start = 0; start < n; start += PIXEL_VM_LANES)
+    {
+      int lanes = MIN (PIXEL_VM_LANES, n - start);
+      load_pixels (src + start * bpp, bpp, lanes, in);
+      run_batch (program, in, out, x + start, y);
+      store_pixels (out, dst + start * bpp, bpp, lanes);
+    } // for
+} // pixel_program_run
@@ -0,0 +1,192 @@
+#ifndef __PIXEL_VM_H__
+#define __PIXEL_VM_H__
+
+/**
+ * pixel-vm.h
+ *   A tiny virtual machine for per-pixel functions, so that clients
+ *   can map a function over a drawable without sending any pixels.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  A pixel program is a straight-line sequence of instructions over
+  PIXEL_VM_REGISTERS integer registers.  There are no jumps, so every
+  program finishes, and every register and channel number is checked
+  before the program runs, so no program can touch memory it should
+  not.
+
+  Each instruction is five integers: op, dst, a, b, and c.  Unless
+  noted otherwise, a, b, and c name registers.
+
+    CONST   dst a       dst = a (a is a value, not a register)
+    LOAD    dst a       dst = channel a of the pixel (0 red, 1 green,
+                        2 blue, 3 alpha); gray pixels have red = green
+                        = blue, and pixels without alpha have alpha 255
+    X       dst         dst = column of the pixel
+    Y       dst         dst = row of the pixel
+    ADD     dst a b     dst = a + b
+    SUB     dst a b     dst = a - b
+    MUL     dst a b     dst = a * b
+    DIV     dst a b     dst = a / b, rounded toward zero (0 if b is 0)
+    MIN     dst a b     dst = the smaller of a and b
+    MAX     dst a b     dst = the larger of a and b
+    LT      dst a b     dst = 1 if a < b, 0 otherwise
+    EQ      dst a b     dst = 1 if a = b, 0 otherwise
+    SELECT  dst a b c   dst = b if a is nonzero, c otherwise
+    SHR     dst a b     dst = a >> b (b is taken mod 32)
+    STORE   dst a       channel dst of the result = a, clamped to
+                        [0,255] (dst is a channel, as for LOAD)
+
+  Arithmetic wraps around on overflow.  Registers start at 0.
+  Channels that are never stored keep their original values.  Gray
+  pixels get the luminance of the stored red, green, and blue.
+
+  The server evaluates each instruction over PIXEL_VM_LANES pixels
+  at a time, so the inner loops are short, branch-free, and easy for
+  the compiler to vectorize.
+
+  // Sample usage: (lambda (c) (irgb (red c) 0 (blue c)))
+  PixelInstruction code[] =
+    {
+      { PIXEL_OP_CONST, 0, 0, 0, 0 },
+      { PIXEL_OP_STORE, 1, 0, 0, 0 }
+    };
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The number of registers available to a program.
+ */
+#define PIXEL_VM_REGISTERS 16
+
+/**
+ * The number of pixels we work on at once.
+ */
+#define PIXEL_VM_LANES 16
+
+/**
+ * The most instructions we accept in a program.
+ */
+#define PIXEL_VM_MAX_INSTRUCTIONS 1024
+
+/**
+ * The number of integers in an instruction.
+ */
+#define PIXEL_INSTRUCTION_SIZE 5
+
+/**
+ * The operations.
+ */
+enum PixelOp
+  {
+    PIXEL_OP_CONST = 0,
+    PIXEL_OP_LOAD = 1,
+    PIXEL_OP_X = 2,
+    PIXEL_OP_Y = 3,
+    PIXEL_OP_ADD = 4,
+    PIXEL_OP_SUB = 5,
+    PIXEL_OP_MUL = 6,
+    PIXEL_OP_DIV = 7,
+    PIXEL_OP_MIN = 8,
+    PIXEL_OP_MAX = 9,
+    PIXEL_OP_LT = 10,
+    PIXEL_OP_EQ = 11,
+    PIXEL_OP_SELECT = 12,
+    PIXEL_OP_SHR = 13,
+    PIXEL_OP_STORE = 14,
+    PIXEL_OP_COUNT
+  };
+typedef enum PixelOp PixelOp;
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * One instruction.
+ */
+struct PixelInstruction
+  {
+    int op;
+    int dst;
+    int a;
+    int b;
+    int c;
+  };
+typedef struct PixelInstruction PixelInstruction;
+
+/**
+ * A validated program, ready to run.
+ */
+typedef struct PixelProgram PixelProgram;
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Check the n instructions in code.  Returns the index of the first
+ * invalid instruction, n if the program is too long, or -1 if the
+ * program is valid.
+ */
+int pixel_program_validate (int n, const PixelInstruction *code);
+
+/**
+ * Build a program from n instructions.  Returns NULL if the program
+ * is invalid.  The caller should free the result with
+ * pixel_program_free.
+ */
+PixelProgram *pixel_program_new (int n, const PixelInstruction *code);
+
+/**
+ * Free a program.
+ */
+void pixel_program_free (PixelProgram *program);
+
+/**
+ * Run a program over n pixels of bpp bytes from src, writing the
+ * results to dst (which may be the same as src).  The pixels lie in
+ * one row, starting at column x of row y.
+ */
+void pixel_program_run (const PixelProgram *program,
+                        const guchar *src, guchar *dst, int bpp, int n,
+                        int x, int y);
+
+#endif // __PIXEL_VM_H__
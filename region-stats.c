@@ -0,0 +1,511 @@
+/**
+ * region-stats.c
+ *   Histograms and simple statistics for the channels of a rectangle
+ *   of a drawable.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <math.h>               // For sqrt
+#include <string.h>             // For memcpy and memset
+
+#include "irgb.h"
+#include "region-stats.h"
+#include "tile-kernels.h"
+#include "tile-pool.h"
+#include "tile-stream.h"
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The multiple of the standard error that gives a 95% confidence
+ * interval.
+ */
+#define Z_95 1.96
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The channels we're computing histograms for.
+ */
+struct StatsChannels
+  {
+    int n;
+    int channel[STATS_MAX_CHANNELS];
+  };
+typedef struct StatsChannels StatsChannels;
+
+/**
+ * The histograms for one tile.  (A tile has far fewer than 2^32
+ * pixels.)
+ */
+struct TileHistograms
+  {
+    guint32 histogram[STATS_MAX_CHANNELS][256];
+  };
+typedef struct TileHistograms TileHistograms;
+
+/**
+ * The predicate for drawable_region_match, as ranges for every stored
+ * channel (including alpha).
+ */
+struct MatchPredicate
+  {
+    guchar lo[4];
+    guchar hi[4];
+  };
+typedef struct MatchPredicate MatchPredicate;
+
+/**
+ * The matches in one tile.  The bounds are in drawable coordinates,
+ * with right and bottom just past the last match.
+ */
+struct TileMatch
+  {
+    guint64 count;
+    guint64 sums[4];
+    int left, top, right, bottom;
+  };
+typedef struct TileMatch TileMatch;
+
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Count the number of channels stored in each pixel of a drawable,
+ * independent of how many bytes each channel takes.
+ */
+static int
+drawable_channels (int drawable)
+{
+  int color = gimp_drawable_is_rgb (drawable) ? 3 : 1;
+  return color + (gimp_drawable_has_alpha (drawable) ? 1 : 0);
+} // drawable_channels
+
+/**
+ * Add the values of one channel of a rectangle of pixels to a
+ * histogram.  We spread the counts over four sub-histograms, so that
+ * runs of equal values (which are common) do not make each increment
+ * wait for the one before.
+ */
+static void
+histogram_channel (const guchar *pixels, int bpp, int rowstride,
+                   int width, int height, int channel, guint32 *histogram)
+{
+  guint32 sub[4][256];
+  int r, i, v;
+
+  memset (sub, 0, sizeof (sub));
+  for (r = 0; r < height; r++)
+    {
+      const guchar *p = pixels + r * rowstride + channel;
+      for (i = 0; i + 4 <= width; i += 4, p += 4 * bpp)
+        {
+          sub[0][p[0]]++;
+          sub[1][p[bpp]]++;
+          sub[2][p[2 * bpp]]++;
+          sub[3][p[3 * bpp]]++;
+        } // for each group of four pixels
+      for ( ; i < width; i++, p += bpp)
+        sub[0][p[0]]++;
+    } // for each row
+  for (v = 0; v < 256; v++)
+    histogram[v] += sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+} // histogram_channel
+
+/**
+ * Add the luminance of a rectangle of pixels to a histogram.
+ */
+static void
+histogram_luminance (const guchar *pixels, int bpp, int rowstride,
+                     int width, int height, guint32 *histogram)
+{
+  int r, i;
+  for (r = 0; r < height; r++)
+    {
+      const guchar *p = pixels + r * rowstride;
+      for (i = 0; i < width; i++, p += bpp)
+        histogram[irgb_luminance (irgb_from_pixel (p, bpp))]++;
+    } // for each row
+} // histogram_luminance
+
+/**
+ * Compute the histograms of one tile.  (Runs on a worker thread.)
+ */
+static void
+stats_job (const guchar *pixels, int bpp, int rowstride,
+           int x, int y, int width, int height,
+           gpointer partial, gpointer data)
+{
+  const StatsChannels *selected = (const StatsChannels *) data;
+  TileHistograms *tile = (TileHistograms *) partial;
+  int k;
+  for (k = 0; k < selected->n; k++)
+    {
+      if (selected->channel[k] == TILE_CHANNEL_LUMINANCE)
+        histogram_luminance (pixels, bpp, rowstride, width, height,
+                             tile->histogram[k]);
+      else
+        histogram_channel (pixels, bpp, rowstride, width, height,
+                           selected->channel[k], tile->histogram[k]);
+    } // for each channel
+} // stats_job
+
+/**
+ * Add one tile's histograms to the totals.
+ */
+static void
+stats_merge (gpointer result, gconstpointer partial, gpointer data)
+{
+  const StatsChannels *selected = (const StatsChannels *) data;
+  const TileHistograms *tile = (const TileHistograms *) partial;
+  RegionStats *stats = (RegionStats *) result;
+  int k, v;
+  for (k = 0; k < selected->n; k++)
+    for (v = 0; v < 256; v++)
+      stats->channels[k].histogram[v] += tile->histogram[k][v];
+} // stats_merge
+
+/**
+ * Fill in everything else from the histograms.
+ */
+static void
+stats_finish (RegionStats *stats)
+{
+  int k, v;
+  for (k = 0; k < stats->nchannels; k++)
+    {
+      ChannelStats *channel = stats->channels + k;
+      channel->sum = 0;
+      channel->sum_squares = 0;
+      channel->min = -1;
+      channel->max = -1;
+      for (v = 0; v < 256; v++)
+        {
+          guint64 count = channel->histogram[v];
+          if (count == 0)
+            continue;
+          if (channel->min < 0)
+            channel->min = v;
+          channel->max = v;
+          channel->sum += count * v;
+          channel->sum_squares += count * v * v;
+        } // for each value
+      channel->mean = 0;
+      channel->stddev = 0;
+      channel->mean_error = 0;
+      if (stats->count > 0)
+        {
+          double n = (double) stats->count;
+          double variance;
+          channel->mean = channel->sum / n;
+          variance = channel->sum_squares / n - channel->mean * channel->mean;
+          channel->stddev = sqrt (MAX (variance, 0.0));
+        } // if there are pixels
+    } // for each channel
+} // stats_finish
+
+/**
+ * Set up the list of channels to look at and the parts of stats that
+ * do not depend on the pixels.  Returns FALSE if the mask is invalid.
+ */
+static gboolean
+stats_start (int drawable, int channels, 
+             StatsChannels *selected, RegionStats *stats)
+{
+  int all = (1 << drawable_channels (drawable)) - 1;
+  if ((channels & ~(all | (1 << TILE_CHANNEL_LUMINANCE))) != 0)
+    return FALSE;
+  if (channels == TILE_CHANNELS_ALL)
+    channels = all;
+
+  int c;
+  selected->n = 0;
+  for (c = 0; c < STATS_MAX_CHANNELS; c++)
+    if (channels & (1 << c))
+      selected->channel[selected->n++] = c;
+
+  memset (stats, 0, sizeof (RegionStats));
+  stats->nchannels = selected->n;
+  for (c = 0; c < selected->n; c++)
+    stats->channels[c].channel = selected->channel[c];
+  return TRUE;
+} // stats_start
+
+/**
+ * Find the matches in one tile.  (Runs on a worker thread.)
+ */
+static void
+match_job (const guchar *pixels, int bpp, int rowstride,
+           int x, int y, int width, int height,
+           gpointer partial, gpointer data)
+{
+  const MatchPredicate *predicate = (const MatchPredicate *) data;
+  TileMatch *tile = (TileMatch *) partial;
+  const TileRowKernels *kernels = tile_row_kernels (bpp);
+  gssize first, last;
+  int r;
+  if (kernels == NULL)
+    return;
+  for (r = 0; r < height; r++)
+    {
+      gsize count = kernels->match (pixels + r * rowstride, width,
+                                    predicate->lo, predicate->hi,
+                                    tile->sums, &first, &last);
+      if (count == 0)
+        continue;
+      tile->count += count;
+      tile->left = MIN (tile->left, x + first);
+      tile->right = MAX (tile->right, x + last + 1);
+      tile->top = MIN (tile->top, y + r);
+      tile->bottom = y + r + 1;
+    } // for each row
+} // match_job
+
+/**
+ * Add one tile's matches to the totals.
+ */
+static void
+match_merge (gpointer result, gconstpointer partial, gpointer data)
+{
+  const TileMatch *tile = (const TileMatch *) partial;
+  TileMatch *total = (TileMatch *) result;
+  int c;
+  total->count += tile->count;
+  for (c = 0; c < 4; c++)
+    total->sums[c] += tile->sums[c];
+  total->left = MIN (total->left, tile->left);
+  total->top = MIN (total->top, tile->top);
+  total->right = MAX (total->right, tile->right);
+  total->bottom = MAX (total->bottom, tile->bottom);
+} // match_merge
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+int
+drawable_region_stats (int drawable, int x, int y, int width, int height,
+                       int channels, RegionStats *stats)
+{
+  // Validate
+  if (! gimp_drawable_is_valid (drawable))
+    return -1;
+  StatsChannels selected;
+  if (! stats_start (drawable, channels, &selected, stats))
+    return -1;
+
+  // Gather the histograms
+  TileHistograms identity;
+  memset (&identity, 0, sizeof (identity));
+  stats->count = (guint64) width * height;
+  stats->population = stats->count;
+  if (drawable_reduce_tiles (drawable, x, y, width, height,
+                             stats_job, stats_merge,
+                             sizeof (TileHistograms), &identity,
+                             stats, &selected) < 0)
+    return -1;
+
+  // And summarize them
+  stats_finish (stats);
+  return 0;
+} // drawable_region_stats
+
+int
+drawable_region_stats_sampled (int drawable, int x, int y, 
+                               int width, int height, int channels, 
+                               gint64 budget, guint32 seed,
+                               RegionStats *stats)
+{
+  // Validate
+  if ((budget <= 0) || (! gimp_drawable_is_valid (drawable))
+      || (x < 0) || (y < 0) || (width <= 0) || (height <= 0)
+      || (x + width > gimp_drawable_width (drawable))
+      || (y + height > gimp_drawable_height (drawable)))
+    return -1;
+
+  // The segments are numbered down each column of tiles in turn, so
+  // segment u is row u % height of tile column u / height.
+  int tw = gimp_tile_width ();
+  int first_column = x / tw;
+  int ncolumns = (x + width - 1) / tw - first_column + 1;
+  gint64 nsegments = (gint64) ncolumns * height;
+  gint64 n = MIN (nsegments, (budget + tw - 1) / tw);
+
+  // If we'd read (nearly) everything anyway, be exact
+  if ((n >= nsegments) || (budget >= (gint64) width * height))
+    return drawable_region_stats (drawable, x, y, width, height, 
+                                  channels, stats);
+
+  StatsChannels selected;
+  if (! stats_start (drawable, channels, &selected, stats))
+    return -1;
+  GimpDrawable *source = gimp_drawable_get (drawable);
+  if (source == NULL)
+    return -1;
+  int bpp = source->bpp;
+  guchar *row = g_try_malloc ((gsize) tw * bpp);
+  double *totals = g_try_new (double, n * selected.n);
+  int *widths = g_try_new (int, n);
+  if ((row == NULL) || (totals == NULL) || (widths == NULL))
+    {
+      g_free (row);
+      g_free (totals);
+      g_free (widths);
+      gimp_drawable_detach (source);
+      return -1;
+    } // if we could not allocate memory
+  GimpPixelRgn region;
+  gimp_pixel_rgn_init (&region, source, x, y, width, height, FALSE, FALSE);
+
+  // Pick one segment at random from each of n equal strata, and add
+  // it to the histograms
+  GRand *rand = g_rand_new_with_seed (seed);
+  double stratum = (double) nsegments / n;
+  guint32 histogram[256];
+  gint64 i;
+  int k, v;
+  for (i = 0; i < n; i++)
+    {
+      gint64 u = (gint64) ((i + g_rand_double (rand)) * stratum);
+      u = MIN (u, nsegments - 1);
+      int column = first_column + u / height;
+      int left = MAX (x, column * tw);
+      int right = MIN (x + width, (column + 1) * tw);
+      widths[i] = right - left;
+      gimp_pixel_rgn_get_row (&region, row, left, y + u % height, widths[i]);
+      stats->count += widths[i];
+      for (k = 0; k < selected.n; k++)
+        {
+          memset (histogram, 0, sizeof (histogram));
+          if (selected.channel[k] == TILE_CHANNEL_LUMINANCE)
+            histogram_luminance (row, bpp, 0, widths[i], 1, histogram);
+          else
+            histogram_channel (row, bpp, 0, widths[i], 1, 
+                               selected.channel[k], histogram);
+          double total = 0;
+          for (v = 0; v < 256; v++)
+            {
+              stats->channels[k].histogram[v] += histogram[v];
+              total += (double) histogram[v] * v;
+            } // for each value
+          totals[i * selected.n + k] = total;
+        } // for each channel
+    } // for each stratum
+  g_rand_free (rand);
+  gimp_drawable_detach (source);
+  stats->population = (guint64) width * height;
+  stats_finish (stats);
+
+  // Estimate the error in each mean from the spread of the segment
+  // totals around it (the usual variance for a ratio estimate from a
+  // sample of clusters, with the finite population correction)
+  double mean_width = (double) stats->count / n;
+  double fpc = 1.0 - (double) n / nsegments;
+  for (k = 0; k < selected.n; k++)
+    {
+      ChannelStats *channel = stats->channels + k;
+      double spread = 0;
+      for (i = 0; i < n; i++)
+        {
+          double residual = totals[i * selected.n + k] 
+                            - channel->mean * widths[i];
+          spread += residual * residual;
+        } // for each segment
+      channel->mean_error = (n < 2) 
+        ? 255.0
+        : Z_95 * sqrt (fpc * spread / (n - 1) / n) / mean_width;
+    } // for each channel
+
+  // Clean up and go
+  g_free (row);
+  g_free (totals);
+  g_free (widths);
+  return 0;
+} // drawable_region_stats_sampled
+
+int
+drawable_region_match (int drawable, int x, int y, int width, int height,
+                       const guchar *lo, const guchar *hi, int alpha_min,
+                       RegionMatch *match)
+{
+  // Validate
+  if (! gimp_drawable_is_valid (drawable))
+    return -1;
+
+  // Build the predicate
+  MatchPredicate predicate;
+  int nchannels = drawable_channels (drawable);
+  gboolean alpha = gimp_drawable_has_alpha (drawable);
+  int colors = alpha ? nchannels - 1 : nchannels;
+  int c;
+  for (c = 0; c < colors; c++)
+    {
+      predicate.lo[c] = (lo == NULL) ? 0 : lo[c];
+      predicate.hi[c] = (hi == NULL) ? 255 : hi[c];
+    } // for each color channel
+  if (alpha)
+    {
+      predicate.lo[colors] = CLAMP (alpha_min, 0, 255);
+      predicate.hi[colors] = 255;
+    } // if the drawable has alpha
+
+  // Find the matches
+  TileMatch identity, total;
+  memset (&identity, 0, sizeof (identity));
+  identity.left = identity.top = G_MAXINT;
+  identity.right = identity.bottom = G_MININT;
+  total = identity;
+  if (drawable_reduce_tiles (drawable, x, y, width, height,
+                             match_job, match_merge,
+                             sizeof (TileMatch), &identity,
+                             &total, &predicate) < 0)
+    return -1;
+
+  // And report them
+  memset (match, 0, sizeof (RegionMatch));
+  match->count = total.count;
+  match->nchannels = nchannels;
+  memcpy (match->sums, total.sums, sizeof (match->sums));
+  if (total.count > 0)
+    {
+      match->x = total.left;
+      match->y = total.top;
+      match->width = total.right - total.left;
+      match->height = total.bottom - total.top;
+    } // if there were matches
+  return 0;
+} // drawable_region_match
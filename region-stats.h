@@ -0,0 +1,191 @@
+#ifndef __REGION_STATS_H__
+#define __REGION_STATS_H__
+
+/**
+ * region-stats.h
+ *   Histograms and simple statistics for the channels of a rectangle
+ *   of a drawable, computed without sending any pixels to the client.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Channels are selected with the same masks as tile streams (see
+  tile_stream_set_channels): bit c selects channel c, the
+  TILE_CHANNEL_LUMINANCE bit selects the luminance, and
+  TILE_CHANNELS_ALL selects every stored channel.  Results come in
+  order of increasing bit.
+
+  Each tile is histogrammed on the worker pool (see tile-pool.h), and
+  the tile histograms are merged in tile order.  The sums, minima,
+  and maxima all follow from the merged histograms, so the per-pixel
+  work is just one increment per channel.
+
+  For a quick estimate on a large drawable, drawable_region_stats_sampled
+  reads only a sample of about budget pixels.  The sample is made of
+  row segments (one row of one tile).  We divide the segments of the
+  region into as many equal strata as we want samples and pick one
+  segment at random from each, so every pixel is equally likely to be
+  chosen, the sample is spread evenly over the region, and only the
+  tiles that hold chosen rows get read.  The histograms, sums, minima,
+  and maxima describe the sample (count is the sample size and
+  population the size of the region), so the client scales the
+  histograms and sums by population / count.  Each mean comes with
+  the half-width of a 95% confidence interval, computed from the
+  spread of the segment means (rows are more alike than random
+  pixels, so treating the pixels as independent would understate the
+  error).  Sample minima and maxima are only bounds: the true minimum
+  is at most the sample minimum, and the true maximum at least the
+  sample maximum.
+
+  drawable_region_match answers questions like "how many pixels are
+  pure white?" or "where are the non-transparent pixels?".  The
+  predicate gives a range for each color channel and a minimum alpha;
+  the result is the number of pixels that fall in every range, the
+  sum of each of their channels, and their bounding box.  Each row of
+  each tile is checked with a vectorized compare-and-mask kernel (see
+  tile_kernel_match).
+
+  // Sample usage
+  RegionStats stats;
+  if (drawable_region_stats (drawable, 0, 0, width, height,
+                             TILE_CHANNELS_ALL, &stats) == 0)
+    mean = (double) stats.channels[0].sum / stats.count;
+
+  // Crop to the visible pixels
+  RegionMatch match;
+  if ((drawable_region_match (drawable, 0, 0, width, height,
+                              NULL, NULL, 1, &match) == 0)
+      && (match.count > 0))
+    gimp_layer_resize (drawable, match.width, match.height,
+                       -match.x, -match.y);
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The most channels we report on (four stored channels plus the
+ * luminance).
+ */
+#define STATS_MAX_CHANNELS 5
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * Statistics for one channel.
+ */
+struct ChannelStats
+  {
+    int channel;                // The channel (a bit index in the mask)
+    guint64 histogram[256];     // The number of pixels with each value
+    guint64 sum;                // The sum of the values
+    guint64 sum_squares;        // The sum of their squares
+    int min;                    // The smallest value
+    int max;                    // The largest value
+    double mean;                // The mean value
+    double stddev;              // The standard deviation of the values
+    double mean_error;          // 95% confidence half-width for the mean
+  };
+typedef struct ChannelStats ChannelStats;
+
+/**
+ * Statistics for a region.
+ */
+struct RegionStats
+  {
+    guint64 count;              // The number of pixels examined
+    guint64 population;         // The number of pixels in the region
+    int nchannels;              // The number of channels reported
+    ChannelStats channels[STATS_MAX_CHANNELS];
+  };
+typedef struct RegionStats RegionStats;
+
+/**
+ * What we know about the pixels of a region that match a predicate.
+ */
+struct RegionMatch
+  {
+    guint64 count;              // The number of matching pixels
+    int nchannels;              // The number of channels in each pixel
+    guint64 sums[4];            // The sum of each channel over them
+    int x;                      // Their bounding box (all zero if
+    int y;                      //   there are none)
+    int width;
+    int height;
+  };
+typedef struct RegionMatch RegionMatch;
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Compute statistics for the selected channels of a rectangle of a
+ * drawable.  Returns 0 on success and a negative number if the
+ * drawable, rectangle, or mask is invalid.
+ */
+int drawable_region_stats (int drawable, int x, int y, int width, int height,
+                           int channels, RegionStats *stats);
+
+/**
+ * Estimate statistics for the selected channels of a rectangle of a
+ * drawable by reading a stratified random sample of about budget
+ * pixels.  The same seed gives the same sample.  If the budget covers
+ * the region, computes exact statistics instead.  Returns 0 on success
+ * and a negative number if the drawable, rectangle, mask, or budget is
+ * invalid.
+ */
+int drawable_region_stats_sampled (int drawable, int x, int y, 
+                                   int width, int height, int channels, 
+                                   gint64 budget, guint32 seed,
+                                   RegionStats *stats);
+
+/**
+ * Find the pixels in a rectangle of a drawable whose color channels c
+ * lie in [lo[c], hi[c]] and whose alpha is at least alpha_min.  (lo
+ * and hi have one entry per color channel; NULL means any value.
+ * Pixels of drawables without alpha are opaque.)  Returns 0 on success
+ * and a negative number if the drawable or rectangle is invalid.
+ */
+int drawable_region_match (int drawable, int x, int y, int width, int height,
+                           const guchar *lo, const guchar *hi, int alpha_min,
+                           RegionMatch *match);
+
+#endif // __REGION_STATS_H__
@@ -0,0 +1,360 @@
+/**
+ * resample.c
+ *   Scale a rectangle of a drawable to a new size.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <math.h>               // For ceil, fabs, floor, and sin
+#include <string.h>             // For memmove
+
+#include "resample.h"
+#include "tile-kernels.h"
+#include "tile-pool.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * About how many bytes of source rows to read at once.  (We read
+ * more if a single output row needs more.)
+ */
+#define BAND_BYTES (8 * 1024 * 1024)
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The weights for scaling along one axis.  Output pixel i is the
+ * weighted sum of the taps source pixels starting at starts[i], using
+ * the taps weights starting at weights[i * taps].  (Output pixels
+ * that need fewer source pixels have zeros at the ends.)
+ */
+struct ResampleAxis
+  {
+    int taps;
+    int *starts;
+    float *weights;
+  };
+typedef struct ResampleAxis ResampleAxis;
+
+/**
+ * A band of source rows and the output rows computed from it.  Shared
+ * by the tasks that compute the rows.
+ */
+struct ResampleBand
+  {
+    const ResampleAxis *horizontal;
+    const ResampleAxis *vertical;
+    const guchar *source;       // Starts at source row top
+    int top;
+    int source_width;
+    int source_rowstride;
+    int first;                  // The first output row in the band
+    gboolean alpha;             // Are the source rows premultiplied?
+    TileBuffer *result;
+  };
+typedef struct ResampleBand ResampleBand;
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Get how far a filter reaches from its center, in source pixels at
+ * full scale.  Returns 0 for an unknown filter.
+ */
+static double
+filter_support (int filter)
+{
+  switch (filter)
+    {
+      case RESAMPLE_BOX:
+        return 0.5;
+      case RESAMPLE_BILINEAR:
+        return 1.0;
+      case RESAMPLE_LANCZOS:
+        return 3.0;
+      default:
+        return 0.0;
+    } // switch
+} // filter_support
+
+/**
+ * Evaluate a filter at distance d from its center.
+ */
+static double
+filter_weight (int filter, double d)
+{
+  switch (filter)
+    {
+      case RESAMPLE_BOX:
+        return ((d > -0.5) && (d <= 0.5)) ? 1.0 : 0.0;
+      case RESAMPLE_BILINEAR:
+        d = fabs (d);
+        return (d < 1.0) ? 1.0 - d : 0.0;
+      case RESAMPLE_LANCZOS:
+        d = fabs (d);
+        if (d == 0.0)
+          return 1.0;
+        if (d >= 3.0)
+          return 0.0;
+        return 3.0 * sin (G_PI * d) * sin (G_PI * d / 3.0) 
+               / (G_PI * G_PI * d * d);
+      default:
+        return 0.0;
+    } // switch
+} // filter_weight
+
+/**
+ * Free the weights for an axis.
+ */
+static void
+axis_clear (ResampleAxis *axis)
+{
+  g_free (axis->starts);
+  g_free (axis->weights);
+} // axis_clear
+
+/**
+ * Compute the weights for scaling size source pixels to out output
+ * pixels.  Returns FALSE if we run out of memory.
+ */
+static gboolean
+axis_init (ResampleAxis *axis, int size, int out, int filter)
+{
+  double scale = (double) size / out;
+  double stretch = MAX (scale, 1.0);
+  double support = filter_support (filter) * stretch;
+  int taps = MIN (size, (int) ceil (support) * 2 + 1);
+  axis->taps = taps;
+  axis->starts = g_try_new (int, out);
+  axis->weights = g_try_new0 (float, (gsize) out * taps);
+  double *raw = g_try_new (double, taps);
+  if ((axis->starts == NULL) || (axis->weights == NULL) || (raw == NULL))
+    {
+      axis_clear (axis);
+      g_free (raw);
+      return FALSE;
+    } // if we could not allocate the weights
+
+  int i, j;
+  for (i = 0; i < out; i++)
+    {
+      // Find the source pixels under the filter
+      double center = (i + 0.5) * scale;
+      int lo = MAX (0, (int) floor (center - support + 0.5));
+      int hi = MIN (size, (int) floor (center + support + 0.5));
+      hi = MIN (hi, lo + taps);
+      double total = 0.0;
+      for (j = lo; j < hi; j++)
+        {
+          raw[j - lo] = filter_weight (filter, (j + 0.5 - center) / stretch);
+          total += raw[j - lo];
+        } // for each source pixel
+      if (total == 0.0)
+        {
+          // Fall back to the nearest pixel
+          lo = CLAMP ((int) center, 0, size - 1);
+          hi = lo + 1;
+          raw[0] = total = 1.0;
+        } // if no pixel has any weight
+
+      // Store the weights, shifting the window left if it would run
+      // past the last pixel
+      int start = MIN (lo, size - taps);
+      float *weights = axis->weights + (gsize) i * taps;
+      axis->starts[i] = start;
+      for (j = lo; j < hi; j++)
+        weights[j - start] = (float) (raw[j - lo] / total);
+    } // for each output pixel
+
+  g_free (raw);
+  return TRUE;
+} // axis_init
+
+/**
+ * Compute one output row of a band.  (Runs on a worker thread.)  The
+ * source rows of a band with alpha are premultiplied, so we divide the
+ * result by its alpha.
+ */
+static void
+resample_row (int task, gpointer data)
+{
+  const ResampleBand *band = (const ResampleBand *) data;
+  const ResampleAxis *horizontal = band->horizontal;
+  const ResampleAxis *vertical = band->vertical;
+  TileBuffer *result = band->result;
+  int bpp = result->bpp;
+  int row = band->first + task;
+  gsize n = (gsize) band->source_width * bpp;
+
+  // Down the columns, into floats
+  float *middle = g_new0 (float, n);
+  tile_kernel_fir_u8 (band->source 
+                        + (gsize) (vertical->starts[row] - band->top)
+                          * band->source_rowstride,
+                      band->source_rowstride, middle, n,
+                      vertical->weights + (gsize) row * vertical->taps,
+                      vertical->taps);
+
+  // And along the row
+  guchar *pixels = result->data + (gsize) row * result->rowstride;
+  tile_kernel_resample_f32 (middle, bpp, pixels, result->width,
+                            horizontal->starts, horizontal->weights,
+                            horizontal->taps);
+  if (band->alpha)
+    tile_kernel_unpremultiply (pixels, bpp, result->width);
+  g_free (middle);
+} // resample_row
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+TileBuffer *
+drawable_region_resample (int drawable, int x, int y, int width, int height,
+                          int out_width, int out_height, int filter)
+{
+  // Validate
+  if ((filter_support (filter) == 0.0)
+      || (out_width < 1) || (out_width > RESAMPLE_MAX_SIZE)
+      || (out_height < 1) || (out_height > RESAMPLE_MAX_SIZE)
+      || (! gimp_drawable_is_valid (drawable))
+      || (x < 0) || (y < 0) || (width <= 0) || (height <= 0)
+      || (x + width > gimp_drawable_width (drawable))
+      || (y + height > gimp_drawable_height (drawable)))
+    return NULL;
+  GimpDrawable *source = gimp_drawable_get (drawable);
+  if (source == NULL)
+    return NULL;
+  int bpp = source->bpp;
+
+  // Set up the weights, the result, and room for a band of source rows
+  ResampleAxis horizontal, vertical;
+  if (! axis_init (&horizontal, width, out_width, filter))
+    {
+      gimp_drawable_detach (source);
+      return NULL;
+    } // if we could not set up the horizontal weights
+  if (! axis_init (&vertical, height, out_height, filter))
+    {
+      axis_clear (&horizontal);
+      gimp_drawable_detach (source);
+      return NULL;
+    } // if we could not set up the vertical weights
+  int rowstride = width * bpp;
+  int band_rows = MAX (vertical.taps, BAND_BYTES / rowstride);
+  band_rows = MIN (band_rows, height);
+  guchar *rows = g_try_malloc ((gsize) band_rows * rowstride);
+  TileBuffer *result = g_try_new0 (TileBuffer, 1);
+  if (result != NULL)
+    {
+      result->width = out_width;
+      result->height = out_height;
+      result->bpp = bpp;
+      result->rowstride = out_width * bpp;
+      result->layout = TILE_LAYOUT_INTERLEAVED;
+      result->data = g_try_malloc ((gsize) result->rowstride * out_height);
+    } // if we got the result
+  if ((rows == NULL) || (result == NULL) || (result->data == NULL))
+    {
+      g_free (rows);
+      tile_buffer_free (result);
+      axis_clear (&horizontal);
+      axis_clear (&vertical);
+      gimp_drawable_detach (source);
+      return NULL;
+    } // if we could not allocate the buffers
+
+  // Work through the output a band at a time.  Each band takes as
+  // many output rows as fit in band_rows source rows.  Rows shared
+  // with the previous band are kept rather than read again.  With
+  // alpha, we premultiply the rows as we read them, so that the
+  // colors of transparent pixels do not bleed into the result.
+  GimpPixelRgn region;
+  gimp_pixel_rgn_init (&region, source, x, y, width, height, FALSE, FALSE);
+  ResampleBand band;
+  band.horizontal = &horizontal;
+  band.vertical = &vertical;
+  band.source = rows;
+  band.source_width = width;
+  band.source_rowstride = rowstride;
+  band.alpha = gimp_drawable_has_alpha (drawable);
+  band.result = result;
+  int top = 0;                  // The source rows we have
+  int bottom = 0;
+  int first = 0;
+  int status = 0;
+  while ((first < out_height) && (status == 0))
+    {
+      int band_top = vertical.starts[first];
+      int last = first + 1;
+      while ((last < out_height)
+             && (vertical.starts[last] + vertical.taps - band_top 
+                 <= band_rows))
+        ++last;
+      int band_bottom = vertical.starts[last - 1] + vertical.taps;
+
+      // Keep what we can of the last band and read the rest
+      int keep = (band_top < bottom) ? bottom - band_top : 0;
+      if (keep > 0)
+        memmove (rows, rows + (gsize) (band_top - top) * rowstride,
+                 (gsize) keep * rowstride);
+      if (band_bottom - band_top > keep)
+        {
+          gimp_pixel_rgn_get_rect (&region, rows + (gsize) keep * rowstride,
+                                   x, y + band_top + keep, 
+                                   width, band_bottom - band_top - keep);
+          if (band.alpha)
+            tile_kernel_premultiply (rows + (gsize) keep * rowstride, bpp,
+                                     (gsize) width 
+                                     * (band_bottom - band_top - keep));
+        } // if we need more rows
+      top = band_top;
+      bottom = band_bottom;
+
+      // Compute the output rows
+      band.top = top;
+      band.first = first;
+      status = tile_pool_run (last - first, resample_row, &band);
+      first = last;
+    } // while
+
+  // And we're done
+  g_free (rows);
+  axis_clear (&horizontal);
+  axis_clear (&vertical);
+  gimp_drawable_detach (source);
+  if (status != 0)
+    {
+      tile_buffer_free (result);
+      return NULL;
+    } // if we failed
+  return result;
+} // drawable_region_resample
@@ -0,0 +1,119 @@
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+/**
+ * resample.h
+ *   Scale a rectangle of a drawable to a new size on the server, so
+ *   that the client gets a thumbnail or preview without fetching the
+ *   full-size pixels.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Each output pixel is a weighted average of the source pixels near
+  its center, with the weights given by the filter.  When we shrink,
+  the filter is stretched to cover every source pixel that falls in
+  the output pixel, so box filtering is a true area average and
+  nothing is skipped.  Near the edges of the rectangle, the weights
+  of the pixels that remain are scaled up so that they still sum to
+  one; no pixels from outside the rectangle are used.  Every channel,
+  including alpha, is filtered the same way, but when the drawable has
+  alpha the colors are premultiplied by alpha first and divided by
+  the new alpha afterwards, so that the colors of transparent pixels
+  do not bleed into their neighbors.
+
+  The filter is separable, so we work in two passes: down the columns
+  (each output row is a weighted sum of whole source rows, which runs
+  down the rows with the vectorized filter kernels; see
+  tile_kernel_fir_u8) and then along each output row in one call (see
+  tile_kernel_resample_f32).  Since the vertical pass comes first,
+  shrinking costs little more than reading the source.
+
+  The source is read a band of rows at a time, so only the rows that
+  the current band of output rows needs are ever in memory.  The
+  output rows of each band are computed on the worker pool (see
+  tile_pool_run).
+
+  // Sample usage: a 128x96 preview of a 4000x3000 drawable
+  TileBuffer *preview = 
+    drawable_region_resample (drawable, 0, 0, 4000, 3000, 128, 96,
+                              RESAMPLE_LANCZOS);
+  ...
+  tile_buffer_free (preview);
+ */
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+#include "tile-stream.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * Average the source pixels that fall in each output pixel.  (When
+ * enlarging, this is nearest-neighbor.)
+ */
+#define RESAMPLE_BOX 0
+
+/**
+ * A triangle filter: bilinear when enlarging and a tent-weighted
+ * average when shrinking.
+ */
+#define RESAMPLE_BILINEAR 1
+
+/**
+ * A three-lobed Lanczos filter: the sharpest of the three, but may
+ * ring a little at hard edges.
+ */
+#define RESAMPLE_LANCZOS 2
+
+/**
+ * The largest width or height of a resampled region.
+ */
+#define RESAMPLE_MAX_SIZE 16384
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Scale the width by height rectangle of a drawable whose upper-left
+ * corner is (x,y) to out_width by out_height pixels.  The buffer's
+ * x and y are 0, since it has its own coordinates.  Returns NULL if
+ * the drawable, rectangle, size, or filter is invalid, or if we run
+ * out of memory.  The caller should free the result with
+ * tile_buffer_free.
+ */
+TileBuffer *drawable_region_resample (int drawable, 
+                                      int x, int y, int width, int height,
+                                      int out_width, int out_height,
+                                      int filter);
+
+#endif // __RESAMPLE_H__
@@ -0,0 +1,69 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+/**
+ * simd.h
+ *   Helpers for writing SIMD kernels that are selected at run time,
+ *   so that one build of the plug-in uses AVX2 where it's available
+ *   and falls back to SSE2 (or plain C) where it's not.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  Kernels that use vector instructions are compiled with a target
+  attribute (so that the rest of the file need not be compiled for
+  that instruction set) and are only ever called after checking
+  SIMD_CPU_SUPPORTS.  Everything is guarded by HAVE_X86_SIMD, so other
+  platforms and compilers simply get the scalar kernels.
+
+  // Sample usage
+  #ifdef HAVE_X86_SIMD
+  static void TARGET_AVX2
+  kernel_avx2 (...)
+  {
+    ...
+  } // kernel_avx2
+  #endif
+
+  #ifdef HAVE_X86_SIMD
+    if (SIMD_CPU_SUPPORTS ("avx2"))
+      kernel = kernel_avx2;
+  #endif
+ */
+
+
+// +--------+----------------------------------------------------------
+// | Macros |
+// +--------+
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__)) \
+    && ! defined (NO_SIMD)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__ ((target ("sse2")))
+#define TARGET_SSSE3 __attribute__ ((target ("ssse3")))
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+#define SIMD_CPU_SUPPORTS(FEATURE) \
+  (__builtin_cpu_init (), __builtin_cpu_supports (FEATURE))
+#endif
+
+#endif // __SIMD_H__
@@ -0,0 +1,1623 @@
+/**
+ * tile-kernels.c
+ *   Operations on runs of pixels, as found in the rows of a tile or
+ *   region.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+#include <string.h>             // For memcpy
+
+#include "simd.h"
+#include "tile-kernels.h"
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The length of the repeating patterns we use for per-channel
+ * parameters.  A multiple of every bpp and of the widest vector, so
+ * that each vector in a pass sees the same parameters every time.
+ */
+#define PATTERN_SIZE 96
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * One implementation of each of the kernels.
+ */
+struct TileKernels
+  {
+    const char *name;
+    void (*invert) (guchar *pixels, int bpp, gsize n);
+    void (*affine) (guchar *pixels, int bpp, gsize n,
+                    const int *scales, const int *offsets);
+    void (*clamp) (guchar *pixels, int bpp, gsize n,
+                   const guchar *lo, const guchar *hi);
+    void (*swizzle) (guchar *pixels, int bpp, gsize n, const int *map);
+    void (*premultiply) (guchar *pixels, int bpp, gsize n);
+    void (*unpremultiply) (guchar *pixels, int bpp, gsize n);
+    void (*blend_over) (const guchar *src, guchar *dst, int bpp, gsize n);
+    gsize (*match) (const guchar *pixels, int bpp, gsize n,
+                    const guchar *lo, const guchar *hi,
+                    guint64 *sums, gssize *first, gssize *last);
+    void (*fir_u8) (const guchar *src, gsize stride, float *dst, gsize n,
+                    const float *weights, int taps);
+    void (*fir_f32) (const float *src, gsize stride, guchar *dst, gsize n,
+                     const float *weights, int taps);
+    void (*resample_f32) (const float *src, int bpp, guchar *dst, gsize n,
+                          const int *starts, const float *weights,
+                          int taps);
+    void (*deinterleave) (const guchar *pixels, int bpp,
+                          guchar *planes, gsize plane_stride, gsize n);
+    void (*interleave) (const guchar *planes, gsize plane_stride, int bpp,
+                        guchar *pixels, gsize n);
+  };
+typedef struct TileKernels TileKernels;
+
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+/**
+ * Divide a product of two bytes (plus 128) by 255, rounding to
+ * nearest.  The vector kernels use the same shifts.
+ */
+static inline int
+div255 (int t)
+{
+  return (t + (t >> 8)) >> 8;
+} // div255
+
+/**
+ * Determine if bpp is one that we handle.
+ */
+static inline gboolean
+valid_bpp (int bpp)
+{
+  return (bpp >= 1) && (bpp <= 4);
+} // valid_bpp
+
+/**
+ * Determine if pixels of bpp bytes have alpha.
+ */
+static inline gboolean
+has_alpha (int bpp)
+{
+  return (bpp == 2) || (bpp == 4);
+} // has_alpha
+
+/**
+ * Clamp the parameters to the affine kernel.
+ */
+static void
+affine_params (int bpp, const int *scales, const int *offsets,
+               int *s, int *o)
+{
+  int c;
+  for (c = 0; c < bpp; c++)
+    {
+      s[c] = CLAMP (scales[c], 0, 32767);
+      o[c] = CLAMP (offsets[c], -255, 255);
+    } // for each channel
+} // affine_params
+
+
+
+// +----------------+--------------------------------------------------
+// | Scalar Kernels |
+// +----------------+
+
+/*
+  Each scalar kernel is written once, as an inline body that takes bpp
+  as a parameter, and then instantiated for each bpp (and hence for
+  the presence or absence of alpha) by DEFINE_SCALAR_KERNELS.  Since
+  each instance passes a literal bpp, the compiler sees constant
+  strides and can unroll (and often vectorize) the channel loops.
+  The kernels that take bpp at run time just pick an instance once
+  per call, rather than branching per pixel.
+ */
+
+static inline void
+invert_body (guchar *pixels, const int bpp, gsize n)
+{
+  gsize i;
+  n *= bpp;
+  for (i = 0; i < n; i++)
+    pixels[i] = (guchar) (255 - pixels[i]);
+} // invert_body
+
+static inline void
+affine_body (guchar *pixels, const int bpp, gsize n,
+             const int *scales, const int *offsets)
+{
+  int s[4], o[4];
+  gsize i;
+  int c;
+  affine_params (bpp, scales, offsets, s, o);
+  for (i = 0; i < n; i++, pixels += bpp)
+    for (c = 0; c < bpp; c++)
+      pixels[c] = CLAMP (((pixels[c] * s[c]) >> 8) + o[c], 0, 255);
+} // affine_body
+
+static inline void
+clamp_body (guchar *pixels, const int bpp, gsize n,
+            const guchar *lo, const guchar *hi)
+{
+  gsize i;
+  int c;
+  for (i = 0; i < n; i++, pixels += bpp)
+    for (c = 0; c < bpp; c++)
+      pixels[c] = MIN (MAX (pixels[c], lo[c]), hi[c]);
+} // clamp_body
+
+static inline void
+swizzle_body (guchar *pixels, const int bpp, gsize n, const int *map)
+{
+  guchar tmp[4];
+  gsize i;
+  int c;
+  for (c = 0; c < bpp; c++)
+    if ((map[c] < 0) || (map[c] >= bpp))
+      return;
+  for (i = 0; i < n; i++, pixels += bpp)
+    {
+      for (c = 0; c < bpp; c++)
+        tmp[c] = pixels[map[c]];
+      memcpy (pixels, tmp, bpp);
+    } // for each pixel
+} // swizzle_body
+
+static inline void
+premultiply_body (guchar *pixels, const int bpp, gsize n)
+{
+  gsize i;
+  int c;
+  if (! has_alpha (bpp))
+    return;
+  for (i = 0; i < n; i++, pixels += bpp)
+    {
+      int a = pixels[bpp - 1];
+      for (c = 0; c < bpp - 1; c++)
+        pixels[c] = div255 (pixels[c] * a + 128);
+    } // for each pixel
+} // premultiply_body
+
+static inline void
+unpremultiply_body (guchar *pixels, const int bpp, gsize n)
+{
+  gsize i;
+  int c;
+  if (! has_alpha (bpp))
+    return;
+  for (i = 0; i < n; i++, pixels += bpp)
+    {
+      int a = pixels[bpp - 1];
+      for (c = 0; c < bpp - 1; c++)
+        pixels[c] = (a == 0) ? 0 : MIN (255, (pixels[c] * 255 + a / 2) / a);
+    } // for each pixel
+} // unpremultiply_body
+
+static inline void
+blend_over_body (const guchar *src, guchar *dst, const int bpp, gsize n)
+{
+  gsize i;
+  int c;
+  if (! has_alpha (bpp))
+    {
+      memcpy (dst, src, n * bpp);
+      return;
+    } // if the source is opaque
+  for (i = 0; i < n; i++, src += bpp, dst += bpp)
+    {
+      int sa = src[bpp - 1];
+      for (c = 0; c < bpp - 1; c++)
+        dst[c] = div255 (src[c] * sa + dst[c] * (255 - sa) + 128);
+      dst[bpp - 1] = div255 (255 * sa + dst[bpp - 1] * (255 - sa) + 128);
+    } // for each pixel
+} // blend_over_body
+
+static inline void
+lut_body (const guchar *src, guchar *dst, const int bpp, gsize n,
+          guchar luts[4][256])
+{
+  gsize i;
+  int c;
+  for (i = 0; i < n; i++, src += bpp, dst += bpp)
+    for (c = 0; c < bpp; c++)
+      dst[c] = luts[c][src[c]];
+} // lut_body
+
+static inline void
+halve_body (const guchar *row0, const guchar *row1, guchar *dst,
+            const int bpp, gsize n)
+{
+  gsize i;
+  int c;
+  for (i = 0; i + 1 < n; i += 2, row0 += 2 * bpp, row1 += 2 * bpp, 
+                         dst += bpp)
+    for (c = 0; c < bpp; c++)
+      dst[c] = (row0[c] + row0[bpp + c] + row1[c] + row1[bpp + c] + 2) >> 2;
+  if (i < n)
+    for (c = 0; c < bpp; c++)
+      dst[c] = (row0[c] + row1[c] + 1) >> 1;
+} // halve_body
+
+static inline void
+resample_f32_body (const float *src, guchar *dst, const int bpp, gsize n,
+                   const int *starts, const float *weights, int taps)
+{
+  gsize i;
+  int c, k;
+  for (i = 0; i < n; i++, dst += bpp, weights += taps)
+    {
+      const float *p = src + (gsize) starts[i] * bpp;
+      for (c = 0; c < bpp; c++)
+        {
+          float sum = 0;
+          for (k = 0; k < taps; k++)
+            sum += weights[k] * p[k * bpp + c];
+          sum = MIN (MAX (sum, 0.0f), 255.0f);
+          dst[c] = (guchar) (int) (sum + 0.5f);
+        } // for each channel
+    } // for each output pixel
+} // resample_f32_body
+
+static inline gsize
+match_body (const guchar *pixels, const int bpp, gsize n,
+            const guchar *lo, const guchar *hi,
+            guint64 *sums, gssize *first, gssize *last)
+{
+  gsize i, count = 0;
+  int c;
+  *first = -1;
+  *last = -1;
+  for (i = 0; i < n; i++, pixels += bpp)
+    {
+      gboolean in = TRUE;
+      for (c = 0; c < bpp; c++)
+        in &= (pixels[c] >= lo[c]) & (pixels[c] <= hi[c]);
+      if (! in)
+        continue;
+      for (c = 0; c < bpp; c++)
+        sums[c] += pixels[c];
+      if (*first < 0)
+        *first = i;
+      *last = i;
+      count++;
+    } // for each pixel
+  return count;
+} // match_body
+
+/**
+ * Instantiate every scalar kernel for one bpp.
+ */
+#define DEFINE_SCALAR_KERNELS(BPP) \
+  static void \
+  invert_scalar_##BPP (guchar *pixels, gsize n) \
+  { \
+    invert_body (pixels, BPP, n); \
+  } \
+  static void \
+  affine_scalar_##BPP (guchar *pixels, gsize n, \
+                       const int *scales, const int *offsets) \
+  { \
+    affine_body (pixels, BPP, n, scales, offsets); \
+  } \
+  static void \
+  clamp_scalar_##BPP (guchar *pixels, gsize n, \
+                      const guchar *lo, const guchar *hi) \
+  { \
+    clamp_body (pixels, BPP, n, lo, hi); \
+  } \
+  static void \
+  swizzle_scalar_##BPP (guchar *pixels, gsize n, const int *map) \
+  { \
+    swizzle_body (pixels, BPP, n, map); \
+  } \
+  static void \
+  premultiply_scalar_##BPP (guchar *pixels, gsize n) \
+  { \
+    premultiply_body (pixels, BPP, n); \
+  } \
+  static void \
+  unpremultiply_scalar_##BPP (guchar *pixels, gsize n) \
+  { \
+    unpremultiply_body (pixels, BPP, n); \
+  } \
+  static void \
+  blend_over_scalar_##BPP (const guchar *src, guchar *dst, gsize n) \
+  { \
+    blend_over_body (src, dst, BPP, n); \
+  } \
+  static void \
+  lut_scalar_##BPP (const guchar *src, guchar *dst, gsize n, \
+                    guchar luts[4][256]) \
+  { \
+    lut_body (src, dst, BPP, n, luts); \
+  } \
+  static void \
+  halve_scalar_##BPP (const guchar *row0, const guchar *row1, \
+                      guchar *dst, gsize n) \
+  { \
+    halve_body (row0, row1, dst, BPP, n); \
+  } \
+  static void \
+  resample_f32_scalar_##BPP (const float *src, guchar *dst, gsize n, \
+                             const int *starts, const float *weights, \
+                             int taps) \
+  { \
+    resample_f32_body (src, dst, BPP, n, starts, weights, taps); \
+  } \
+  static gsize \
+  match_scalar_##BPP (const guchar *pixels, gsize n, \
+                      const guchar *lo, const guchar *hi, \
+                      guint64 *sums, gssize *first, gssize *last) \
+  { \
+    return match_body (pixels, BPP, n, lo, hi, sums, first, last); \
+  }
+
+DEFINE_SCALAR_KERNELS (1)
+DEFINE_SCALAR_KERNELS (2)
+DEFINE_SCALAR_KERNELS (3)
+DEFINE_SCALAR_KERNELS (4)
+
+/**
+ * Call the instance of a scalar kernel for the bpp in scope.
+ * (Invalid bpps do nothing.)
+ */
+#define CALL_SCALAR_KERNEL(KERNEL, ARGS) \
+  switch (bpp) \
+    { \
+      case 1: KERNEL##_1 ARGS; break; \
+      case 2: KERNEL##_2 ARGS; break; \
+      case 3: KERNEL##_3 ARGS; break; \
+      case 4: KERNEL##_4 ARGS; break; \
+    }
+
+static void
+invert_scalar (guchar *pixels, int bpp, gsize n)
+{
+  CALL_SCALAR_KERNEL (invert_scalar, (pixels, n));
+} // invert_scalar
+
+static void
+affine_scalar (guchar *pixels, int bpp, gsize n,
+               const int *scales, const int *offsets)
+{
+  CALL_SCALAR_KERNEL (affine_scalar, (pixels, n, scales, offsets));
+} // affine_scalar
+
+static void
+clamp_scalar (guchar *pixels, int bpp, gsize n,
+              const guchar *lo, const guchar *hi)
+{
+  CALL_SCALAR_KERNEL (clamp_scalar, (pixels, n, lo, hi));
+} // clamp_scalar
+
+static void
+swizzle_scalar (guchar *pixels, int bpp, gsize n, const int *map)
+{
+  CALL_SCALAR_KERNEL (swizzle_scalar, (pixels, n, map));
+} // swizzle_scalar
+
+static void
+premultiply_scalar (guchar *pixels, int bpp, gsize n)
+{
+  CALL_SCALAR_KERNEL (premultiply_scalar, (pixels, n));
+} // premultiply_scalar
+
+static void
+unpremultiply_scalar (guchar *pixels, int bpp, gsize n)
+{
+  CALL_SCALAR_KERNEL (unpremultiply_scalar, (pixels, n));
+} // unpremultiply_scalar
+
+static void
+blend_over_scalar (const guchar *src, guchar *dst, int bpp, gsize n)
+{
+  CALL_SCALAR_KERNEL (blend_over_scalar, (src, dst, n));
+} // blend_over_scalar
+
+static gsize
+match_scalar (const guchar *pixels, int bpp, gsize n,
+              const guchar *lo, const guchar *hi,
+              guint64 *sums, gssize *first, gssize *last)
+{
+  // CALL_SCALAR_KERNEL drops the result, so we pick by hand
+  switch (bpp)
+    {
+      case 1:
+        return match_scalar_1 (pixels, n, lo, hi, sums, first, last);
+      case 2:
+        return match_scalar_2 (pixels, n, lo, hi, sums, first, last);
+      case 3:
+        return match_scalar_3 (pixels, n, lo, hi, sums, first, last);
+      case 4:
+        return match_scalar_4 (pixels, n, lo, hi, sums, first, last);
+    } // switch
+  *first = -1;
+  *last = -1;
+  return 0;
+} // match_scalar
+
+static void
+fir_u8_scalar (const guchar *src, gsize stride, float *dst, gsize n,
+               const float *weights, int taps)
+{
+  gsize j;
+  int k;
+  for (j = 0; j < n; j++)
+    {
+      float sum = 0;
+      for (k = 0; k < taps; k++)
+        sum += weights[k] * src[j + k * stride];
+      dst[j] += sum;
+    } // for each output
+} // fir_u8_scalar
+
+static void
+fir_f32_scalar (const float *src, gsize stride, guchar *dst, gsize n,
+                const float *weights, int taps)
+{
+  gsize j;
+  int k;
+  for (j = 0; j < n; j++)
+    {
+      float sum = 0;
+      for (k = 0; k < taps; k++)
+        sum += weights[k] * src[j + k * stride];
+      sum = MIN (MAX (sum, 0.0f), 255.0f);
+      dst[j] = (guchar) (int) (sum + 0.5f);
+    } // for each output
+} // fir_f32_scalar
+
+static void
+resample_f32_scalar (const float *src, int bpp, guchar *dst, gsize n,
+                     const int *starts, const float *weights, int taps)
+{
+  CALL_SCALAR_KERNEL (resample_f32_scalar, 
+                      (src, dst, n, starts, weights, taps));
+} // resample_f32_scalar
+
+/**
+ * Split n interleaved pixels of bpp bytes into bpp planes of n
+ * bytes, plane_stride bytes apart.
+ */
+static void
+deinterleave_scalar (const guchar *pixels, int bpp,
+                     guchar *planes, gsize plane_stride, gsize n)
+{
+  int c;
+  gsize i;
+  if (bpp == 1)
+    {
+      memcpy (planes, pixels, n);
+      return;
+    } // if there is only one channel
+  for (c = 0; c < bpp; c++)
+    {
+      const guchar *src = pixels + c;
+      guchar *dst = planes + c * plane_stride;
+      for (i = 0; i < n; i++)
+        dst[i] = src[i * bpp];
+    } // for each channel
+} // deinterleave_scalar
+
+/**
+ * Merge bpp planes of n bytes, plane_stride bytes apart, into n
+ * interleaved pixels.
+ */
+static void
+interleave_scalar (const guchar *planes, gsize plane_stride, int bpp,
+                   guchar *pixels, gsize n)
+{
+  int c;
+  gsize i;
+  if (bpp == 1)
+    {
+      memcpy (pixels, planes, n);
+      return;
+    } // if there is only one channel
+  for (c = 0; c < bpp; c++)
+    {
+      const guchar *src = planes + c * plane_stride;
+      guchar *dst = pixels + c;
+      for (i = 0; i < n; i++)
+        dst[i * bpp] = src[i];
+    } // for each channel
+} // interleave_scalar
+
+static const TileKernels scalar_kernels =
+  {
+    "scalar",
+    invert_scalar,
+    affine_scalar,
+    clamp_scalar,
+    swizzle_scalar,
+    premultiply_scalar,
+    unpremultiply_scalar,
+    blend_over_scalar,
+    match_scalar,
+    fir_u8_scalar,
+    fir_f32_scalar,
+    resample_f32_scalar,
+    deinterleave_scalar,
+    interleave_scalar
+  };
+
+
+
+#ifdef HAVE_X86_SIMD
+
+// +--------------+----------------------------------------------------
+// | SSE2 Kernels |
+// +--------------+
+
+/*
+  Kernels with per-channel parameters expand them into patterns of
+  PATTERN_SIZE bytes (or words) and walk through the pattern one
+  vector at a time.  Since the pattern length is a multiple of bpp,
+  vector k of every pass lines up with the same channels.
+ */
+
+static void TARGET_SSE2
+invert_sse2 (guchar *pixels, int bpp, gsize n)
+{
+  const __m128i ones = _mm_set1_epi8 ((char) 0xFF);
+  gsize i;
+  n *= bpp;
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (pixels + i));
+      _mm_storeu_si128 ((__m128i *) (pixels + i), _mm_xor_si128 (v, ones));
+    } // for each group of 16 bytes
+  invert_scalar (pixels + i, 1, n - i);
+} // invert_sse2
+
+/**
+ * Compute ((w * s) >> 8) + o for 16-bit lanes holding bytes, with
+ * signed saturation.  (w << 8 fits in an unsigned word and s is at
+ * most 32767, so the high half of the product is exactly the value.)
+ */
+static inline __m128i TARGET_SSE2
+affine_words_sse2 (__m128i w, __m128i s, __m128i o)
+{
+  return _mm_adds_epi16 (_mm_mulhi_epu16 (_mm_slli_epi16 (w, 8), s), o);
+} // affine_words_sse2
+
+static void TARGET_SSE2
+affine_sse2 (guchar *pixels, int bpp, gsize n,
+             const int *scales, const int *offsets)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint16 s_pattern[PATTERN_SIZE], o_pattern[PATTERN_SIZE];
+  int s[4], o[4];
+  gsize i;
+  int k;
+
+  if (! valid_bpp (bpp))
+    return;
+  affine_params (bpp, scales, offsets, s, o);
+  for (k = 0; k < PATTERN_SIZE; k++)
+    {
+      s_pattern[k] = s[k % bpp];
+      o_pattern[k] = o[k % bpp];
+    } // for each entry in the pattern
+
+  n *= bpp;
+  for (i = 0; i + PATTERN_SIZE <= n; i += PATTERN_SIZE)
+    {
+      for (k = 0; k < PATTERN_SIZE; k += 16)
+        {
+          guchar *p = pixels + i + k;
+          __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+          __m128i lo =
+            affine_words_sse2 (_mm_unpacklo_epi8 (v, zero),
+                               _mm_loadu_si128 ((__m128i *) (s_pattern + k)),
+                               _mm_loadu_si128 ((__m128i *) (o_pattern + k)));
+          __m128i hi =
+            affine_words_sse2 (_mm_unpackhi_epi8 (v, zero),
+                               _mm_loadu_si128 ((__m128i *)
+                                                (s_pattern + k + 8)),
+                               _mm_loadu_si128 ((__m128i *)
+                                                (o_pattern + k + 8)));
+          _mm_storeu_si128 ((__m128i *) p, _mm_packus_epi16 (lo, hi));
+        } // for each vector in the pattern
+    } // for each pass
+  affine_scalar (pixels + i, bpp, (n - i) / bpp, scales, offsets);
+} // affine_sse2
+
+static void TARGET_SSE2
+clamp_sse2 (guchar *pixels, int bpp, gsize n,
+            const guchar *lo, const guchar *hi)
+{
+  guchar lo_pattern[PATTERN_SIZE], hi_pattern[PATTERN_SIZE];
+  gsize i;
+  int k;
+
+  if (! valid_bpp (bpp))
+    return;
+  for (k = 0; k < PATTERN_SIZE; k++)
+    {
+      lo_pattern[k] = lo[k % bpp];
+      hi_pattern[k] = hi[k % bpp];
+    } // for each entry in the pattern
+
+  n *= bpp;
+  for (i = 0; i + PATTERN_SIZE <= n; i += PATTERN_SIZE)
+    {
+      for (k = 0; k < PATTERN_SIZE; k += 16)
+        {
+          guchar *p = pixels + i + k;
+          __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+          v = _mm_max_epu8 (v, _mm_loadu_si128 ((__m128i *)
+                                                (lo_pattern + k)));
+          v = _mm_min_epu8 (v, _mm_loadu_si128 ((__m128i *)
+                                                (hi_pattern + k)));
+          _mm_storeu_si128 ((__m128i *) p, v);
+        } // for each vector in the pattern
+    } // for each pass
+  clamp_scalar (pixels + i, bpp, (n - i) / bpp, lo, hi);
+} // clamp_sse2
+
+/**
+ * Broadcast the alpha word of each of the two RGBA pixels in w to the
+ * color words, and put 255 in the alpha words.
+ */
+static inline __m128i TARGET_SSE2
+alpha_weights_sse2 (__m128i w)
+{
+  const __m128i colors = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i opaque = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+  __m128i a = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (w, 0xFF), 0xFF);
+  return _mm_or_si128 (_mm_and_si128 (a, colors), opaque);
+} // alpha_weights_sse2
+
+/**
+ * Divide 16-bit lanes (each a product of bytes plus 128) by 255.
+ */
+static inline __m128i TARGET_SSE2
+div255_sse2 (__m128i t)
+{
+  return _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+} // div255_sse2
+
+/**
+ * Premultiply the two RGBA pixels in w.
+ */
+static inline __m128i TARGET_SSE2
+premultiply_words_sse2 (__m128i w)
+{
+  const __m128i half = _mm_set1_epi16 (128);
+  __m128i t = _mm_add_epi16 (_mm_mullo_epi16 (w, alpha_weights_sse2 (w)),
+                             half);
+  return div255_sse2 (t);
+} // premultiply_words_sse2
+
+static void TARGET_SSE2
+premultiply_sse2 (guchar *pixels, int bpp, gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gsize i;
+  if (bpp != 4)
+    {
+      premultiply_scalar (pixels, bpp, n);
+      return;
+    } // if we don't have RGBA pixels
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      guchar *p = pixels + 4 * i;
+      __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+      __m128i lo = premultiply_words_sse2 (_mm_unpacklo_epi8 (v, zero));
+      __m128i hi = premultiply_words_sse2 (_mm_unpackhi_epi8 (v, zero));
+      _mm_storeu_si128 ((__m128i *) p, _mm_packus_epi16 (lo, hi));
+    } // for each group of 4
+  premultiply_scalar (pixels + 4 * i, bpp, n - i);
+} // premultiply_sse2
+
+/**
+ * Blend the two RGBA pixels in s over the two in d.
+ */
+static inline __m128i TARGET_SSE2
+blend_words_sse2 (__m128i s, __m128i d)
+{
+  const __m128i colors = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i opaque = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i full = _mm_set1_epi16 (255);
+  const __m128i half = _mm_set1_epi16 (128);
+  __m128i sa = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (s, 0xFF), 0xFF);
+  // The alpha channel blends 255 (rather than the source alpha) with
+  // the destination alpha
+  __m128i s1 = _mm_or_si128 (_mm_and_si128 (s, colors), opaque);
+  __m128i t = _mm_add_epi16 (_mm_mullo_epi16 (s1, sa),
+                             _mm_mullo_epi16 (d, _mm_sub_epi16 (full, sa)));
+  return div255_sse2 (_mm_add_epi16 (t, half));
+} // blend_words_sse2
+
+static void TARGET_SSE2
+blend_over_sse2 (const guchar *src, guchar *dst, int bpp, gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gsize i;
+  if (bpp != 4)
+    {
+      blend_over_scalar (src, dst, bpp, n);
+      return;
+    } // if we don't have RGBA pixels
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i s = _mm_loadu_si128 ((const __m128i *) (src + 4 * i));
+      __m128i d = _mm_loadu_si128 ((const __m128i *) (dst + 4 * i));
+      __m128i lo = blend_words_sse2 (_mm_unpacklo_epi8 (s, zero),
+                                     _mm_unpacklo_epi8 (d, zero));
+      __m128i hi = blend_words_sse2 (_mm_unpackhi_epi8 (s, zero),
+                                     _mm_unpackhi_epi8 (d, zero));
+      _mm_storeu_si128 ((__m128i *) (dst + 4 * i),
+                        _mm_packus_epi16 (lo, hi));
+    } // for each group of 4
+  blend_over_scalar (src + 4 * i, dst + 4 * i, bpp, n - i);
+} // blend_over_sse2
+
+/**
+ * Match 16 bytes at a time for bpp 1, 2, and 4 (bpp 3 pixels straddle
+ * the vectors, so they go to the scalar kernel).  Each byte is in
+ * range if clamping it changes nothing; a pixel matches if all of its
+ * bytes do, which we find by comparing whole words (or double words)
+ * against all ones.  The resulting mask selects the bytes that go
+ * into the sums, and its sign bits, one per pixel, give the count and
+ * the first and last matches.
+ */
+static gsize TARGET_SSE2
+match_sse2 (const guchar *pixels, int bpp, gsize n,
+            const guchar *lo, const guchar *hi,
+            guint64 *sums, gssize *first, gssize *last)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i ones = _mm_set1_epi8 ((char) 0xFF);
+  guchar lo_pattern[16], hi_pattern[16], channel_pattern[4][16];
+  __m128i channels[4], totals[4];
+  guint64 halves[2];
+  gsize i, count = 0;
+  int k, c;
+
+  if ((bpp != 1) && (bpp != 2) && (bpp != 4))
+    return match_scalar (pixels, bpp, n, lo, hi, sums, first, last);
+  for (k = 0; k < 16; k++)
+    {
+      lo_pattern[k] = lo[k % bpp];
+      hi_pattern[k] = hi[k % bpp];
+      for (c = 0; c < bpp; c++)
+        channel_pattern[c][k] = (k % bpp == c) ? 0xFF : 0;
+    } // for each entry in the pattern
+  const __m128i vlo = _mm_loadu_si128 ((__m128i *) lo_pattern);
+  const __m128i vhi = _mm_loadu_si128 ((__m128i *) hi_pattern);
+  for (c = 0; c < bpp; c++)
+    {
+      channels[c] = _mm_loadu_si128 ((__m128i *) channel_pattern[c]);
+      totals[c] = zero;
+    } // for each channel
+
+  const gsize per = 16 / bpp;
+  *first = -1;
+  *last = -1;
+  for (i = 0; i + per <= n; i += per)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (pixels + i * bpp));
+      __m128i in = 
+        _mm_and_si128 (_mm_cmpeq_epi8 (_mm_max_epu8 (v, vlo), v),
+                       _mm_cmpeq_epi8 (_mm_min_epu8 (v, vhi), v));
+      int bits;
+      if (bpp == 1)
+        bits = _mm_movemask_epi8 (in);
+      else if (bpp == 2)
+        {
+          in = _mm_cmpeq_epi16 (in, ones);
+          bits = _mm_movemask_epi8 (_mm_packs_epi16 (in, zero));
+        } // if bpp is 2
+      else
+        {
+          in = _mm_cmpeq_epi32 (in, ones);
+          bits = _mm_movemask_ps (_mm_castsi128_ps (in));
+        } // if bpp is 4
+      if (bits == 0)
+        continue;
+      count += __builtin_popcount (bits);
+      if (*first < 0)
+        *first = i + __builtin_ctz (bits);
+      *last = i + 31 - __builtin_clz (bits);
+      v = _mm_and_si128 (v, in);
+      for (c = 0; c < bpp; c++)
+        totals[c] = 
+          _mm_add_epi64 (totals[c], 
+                         _mm_sad_epu8 (_mm_and_si128 (v, channels[c]), zero));
+    } // for each vector
+  for (c = 0; c < bpp; c++)
+    {
+      _mm_storeu_si128 ((__m128i *) halves, totals[c]);
+      sums[c] += halves[0] + halves[1];
+    } // for each channel
+
+  // Pick up the stragglers
+  gssize rest_first, rest_last;
+  count += match_scalar (pixels + i * bpp, bpp, n - i, lo, hi, sums,
+                         &rest_first, &rest_last);
+  if (rest_first >= 0)
+    {
+      if (*first < 0)
+        *first = i + rest_first;
+      *last = i + rest_last;
+    } // if there were matches among them
+  return count;
+} // match_sse2
+
+/**
+ * The filters work on eight outputs at a time, widening the bytes (or
+ * narrowing the sums) in registers.  Each lane forms its sum in the
+ * same order as the scalar kernel, so the results are the same.
+ */
+static void TARGET_SSE2
+fir_u8_sse2 (const guchar *src, gsize stride, float *dst, gsize n,
+             const float *weights, int taps)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gsize j;
+  int k;
+  for (j = 0; j + 8 <= n; j += 8)
+    {
+      __m128 lo = _mm_setzero_ps ();
+      __m128 hi = _mm_setzero_ps ();
+      for (k = 0; k < taps; k++)
+        {
+          __m128i v = 
+            _mm_loadl_epi64 ((const __m128i *) (src + j + k * stride));
+          __m128 w = _mm_set1_ps (weights[k]);
+          v = _mm_unpacklo_epi8 (v, zero);
+          lo = _mm_add_ps (lo, 
+                           _mm_mul_ps (w, _mm_cvtepi32_ps 
+                                            (_mm_unpacklo_epi16 (v, zero))));
+          hi = _mm_add_ps (hi, 
+                           _mm_mul_ps (w, _mm_cvtepi32_ps 
+                                            (_mm_unpackhi_epi16 (v, zero))));
+        } // for each tap
+      _mm_storeu_ps (dst + j, _mm_add_ps (_mm_loadu_ps (dst + j), lo));
+      _mm_storeu_ps (dst + j + 4, _mm_add_ps (_mm_loadu_ps (dst + j + 4), hi));
+    } // for each group of eight
+  fir_u8_scalar (src + j, stride, dst + j, n - j, weights, taps);
+} // fir_u8_sse2
+
+static void TARGET_SSE2
+fir_f32_sse2 (const float *src, gsize stride, guchar *dst, gsize n,
+              const float *weights, int taps)
+{
+  const __m128 zero = _mm_setzero_ps ();
+  const __m128 top = _mm_set1_ps (255.0f);
+  const __m128 half = _mm_set1_ps (0.5f);
+  gsize j;
+  int k;
+  for (j = 0; j + 8 <= n; j += 8)
+    {
+      __m128 lo = _mm_setzero_ps ();
+      __m128 hi = _mm_setzero_ps ();
+      for (k = 0; k < taps; k++)
+        {
+          const float *p = src + j + k * stride;
+          __m128 w = _mm_set1_ps (weights[k]);
+          lo = _mm_add_ps (lo, _mm_mul_ps (w, _mm_loadu_ps (p)));
+          hi = _mm_add_ps (hi, _mm_mul_ps (w, _mm_loadu_ps (p + 4)));
+        } // for each tap
+      lo = _mm_add_ps (_mm_min_ps (_mm_max_ps (lo, zero), top), half);
+      hi = _mm_add_ps (_mm_min_ps (_mm_max_ps (hi, zero), top), half);
+      __m128i words = _mm_packs_epi32 (_mm_cvttps_epi32 (lo),
+                                       _mm_cvttps_epi32 (hi));
+      _mm_storel_epi64 ((__m128i *) (dst + j),
+                        _mm_packus_epi16 (words, words));
+    } // for each group of eight
+  fir_f32_scalar (src + j, stride, dst + j, n - j, weights, taps);
+} // fir_f32_sse2
+
+/**
+ * Load the floats of a pixel of bpp channels into the low lanes of a
+ * vector, without reading past the pixel.
+ */
+static inline __m128 TARGET_SSE2
+load_pixel_sse2 (const float *p, int bpp)
+{
+  switch (bpp)
+    {
+      case 1:
+        return _mm_load_ss (p);
+      case 2:
+        return _mm_castpd_ps (_mm_load_sd ((const double *) p));
+      case 3:
+        return _mm_movelh_ps (_mm_castpd_ps (_mm_load_sd ((const double *) p)),
+                              _mm_load_ss (p + 2));
+      default:
+        return _mm_loadu_ps (p);
+    } // switch
+} // load_pixel_sse2
+
+static void TARGET_SSE2
+resample_f32_sse2 (const float *src, int bpp, guchar *dst, gsize n,
+                   const int *starts, const float *weights, int taps)
+{
+  const __m128 zero = _mm_setzero_ps ();
+  const __m128 top = _mm_set1_ps (255.0f);
+  const __m128 half = _mm_set1_ps (0.5f);
+  gsize i;
+  int k;
+
+  // One channel fills only one lane, so the scalar kernel does as well
+  if ((bpp < 2) || (bpp > 4))
+    {
+      resample_f32_scalar (src, bpp, dst, n, starts, weights, taps);
+      return;
+    } // if the pixels are too small or invalid
+
+  // Each output pixel's channels are summed side by side
+  for (i = 0; i < n; i++, dst += bpp, weights += taps)
+    {
+      const float *p = src + (gsize) starts[i] * bpp;
+      __m128 sum = _mm_setzero_ps ();
+      for (k = 0; k < taps; k++)
+        sum = _mm_add_ps (sum, 
+                          _mm_mul_ps (_mm_set1_ps (weights[k]),
+                                      load_pixel_sse2 (p + k * bpp, bpp)));
+      sum = _mm_add_ps (_mm_min_ps (_mm_max_ps (sum, zero), top), half);
+      __m128i words = _mm_packs_epi32 (_mm_cvttps_epi32 (sum),
+                                       _mm_setzero_si128 ());
+      guint32 bytes = 
+        _mm_cvtsi128_si32 (_mm_packus_epi16 (words, words));
+      memcpy (dst, &bytes, bpp);
+    } // for each output pixel
+} // resample_f32_sse2
+
+static const TileKernels sse2_kernels =
+  {
+    "sse2",
+    invert_sse2,
+    affine_sse2,
+    clamp_sse2,
+    swizzle_scalar,
+    premultiply_sse2,
+    unpremultiply_scalar,
+    blend_over_sse2,
+    match_sse2,
+    fir_u8_sse2,
+    fir_f32_sse2,
+    resample_f32_sse2,
+    deinterleave_scalar,
+    interleave_scalar
+  };
+
+
+
+// +---------------+---------------------------------------------------
+// | SSSE3 Kernels |
+// +---------------+
+
+static void TARGET_SSSE3
+swizzle_ssse3 (guchar *pixels, int bpp, gsize n, const int *map)
+{
+  guchar mask_bytes[16];
+  __m128i mask;
+  int group;
+  gsize i;
+  int k;
+
+  if ((bpp < 2) || (bpp > 4))
+    return;
+  for (k = 0; k < bpp; k++)
+    if ((map[k] < 0) || (map[k] >= bpp))
+      return;
+
+  // Each shuffle handles the whole pixels in 16 bytes.  (For bpp 3,
+  // that's 12 bytes; the other 4 map to themselves, so storing them
+  // back is harmless.)
+  group = (16 / bpp) * bpp;
+  for (k = 0; k < 16; k++)
+    mask_bytes[k] = (k < group) ? (k / bpp) * bpp + map[k % bpp] : k;
+  mask = _mm_loadu_si128 ((const __m128i *) mask_bytes);
+
+  for (i = 0; i * bpp + 16 <= n * bpp; i += group / bpp)
+    {
+      guchar *p = pixels + i * bpp;
+      __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+      _mm_storeu_si128 ((__m128i *) p, _mm_shuffle_epi8 (v, mask));
+    } // for each group
+  swizzle_scalar (pixels + i * bpp, bpp, n - i, map);
+} // swizzle_ssse3
+
+/*
+  We work on sixteen pixels at a time.  A pshufb groups each run of
+  four pixels by channel (four bytes of red, then four of green, and
+  so on), and then a 4x4 transpose of 32-bit lanes gathers sixteen
+  bytes of each channel into a register.  Interleaving runs the same
+  steps backwards.  Missing channels (bpp < 4) are zero-filled by the
+  mask and simply never stored.
+ */
+
+#define Z 0x80
+
+static const guchar deinterleave_masks[5][16] =
+  {
+    { 0 }, { 0 },
+    { 0, 2, 4, 6, 1, 3, 5, 7, Z, Z, Z, Z, Z, Z, Z, Z },
+    { 0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, Z, Z, Z, Z },
+    { 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 }
+  };
+
+static const guchar interleave_masks[5][16] =
+  {
+    { 0 }, { 0 },
+    { 0, 4, 1, 5, 2, 6, 3, 7, Z, Z, Z, Z, Z, Z, Z, Z },
+    { 0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, Z, Z, Z, Z },
+    { 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 }
+  };
+
+#undef Z
+
+static void TARGET_SSSE3
+deinterleave_ssse3 (const guchar *pixels, int bpp,
+                    guchar *planes, gsize plane_stride, gsize n)
+{
+  __m128i mask;
+  __m128i c[4];
+  gsize i;
+  int k;
+
+  if ((bpp < 2) || (bpp > 4))
+    {
+      deinterleave_scalar (pixels, bpp, planes, plane_stride, n);
+      return;
+    } // if there's nothing to shuffle
+  mask = _mm_loadu_si128 ((const __m128i *) deinterleave_masks[bpp]);
+
+  // The last load reads 16 bytes starting at pixel i + 12, so stop
+  // while that is safe.
+  for (i = 0; (i + 12) * bpp + 16 <= n * bpp; i += 16)
+    {
+      const guchar *src = pixels + i * bpp;
+      __m128i v0 = 
+        _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) src), mask);
+      __m128i v1 = 
+        _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + 4 * bpp)),
+                          mask);
+      __m128i v2 = 
+        _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + 8 * bpp)),
+                          mask);
+      __m128i v3 = 
+        _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + 12 * bpp)),
+                          mask);
+      __m128i t0 = _mm_unpacklo_epi32 (v0, v1);
+      __m128i t1 = _mm_unpackhi_epi32 (v0, v1);
+      __m128i t2 = _mm_unpacklo_epi32 (v2, v3);
+      __m128i t3 = _mm_unpackhi_epi32 (v2, v3);
+      c[0] = _mm_unpacklo_epi64 (t0, t2);
+      c[1] = _mm_unpackhi_epi64 (t0, t2);
+      c[2] = _mm_unpacklo_epi64 (t1, t3);
+      c[3] = _mm_unpackhi_epi64 (t1, t3);
+      for (k = 0; k < bpp; k++)
+        _mm_storeu_si128 ((__m128i *) (planes + k * plane_stride + i), c[k]);
+    } // for each group of 16
+
+  // Clean up the stragglers
+  deinterleave_scalar (pixels + i * bpp, bpp, planes + i, plane_stride, 
+                       n - i);
+} // deinterleave_ssse3
+
+static void TARGET_SSSE3
+interleave_ssse3 (const guchar *planes, gsize plane_stride, int bpp,
+                  guchar *pixels, gsize n)
+{
+  __m128i mask;
+  __m128i c[4];
+  gsize i;
+  int k;
+
+  if ((bpp < 2) || (bpp > 4))
+    {
+      interleave_scalar (planes, plane_stride, bpp, pixels, n);
+      return;
+    } // if there's nothing to shuffle
+  mask = _mm_loadu_si128 ((const __m128i *) interleave_masks[bpp]);
+
+  // Each store writes 16 bytes, the tail of which is junk that the
+  // next store overwrites, so stop while the last one is safe.
+  for (i = 0; (i + 12) * bpp + 16 <= n * bpp; i += 16)
+    {
+      guchar *dst = pixels + i * bpp;
+      for (k = 0; k < 4; k++)
+        c[k] = (k < bpp) 
+               ? _mm_loadu_si128 ((const __m128i *) 
+                                  (planes + k * plane_stride + i))
+               : _mm_setzero_si128 ();
+      __m128i t0 = _mm_unpacklo_epi32 (c[0], c[1]);
+      __m128i t1 = _mm_unpacklo_epi32 (c[2], c[3]);
+      __m128i t2 = _mm_unpackhi_epi32 (c[0], c[1]);
+      __m128i t3 = _mm_unpackhi_epi32 (c[2], c[3]);
+      __m128i v0 = _mm_unpacklo_epi64 (t0, t1);
+      __m128i v1 = _mm_unpackhi_epi64 (t0, t1);
+      __m128i v2 = _mm_unpacklo_epi64 (t2, t3);
+      __m128i v3 = _mm_unpackhi_epi64 (t2, t3);
+      _mm_storeu_si128 ((__m128i *) dst, _mm_shuffle_epi8 (v0, mask));
+      _mm_storeu_si128 ((__m128i *) (dst + 4 * bpp), 
+                        _mm_shuffle_epi8 (v1, mask));
+      _mm_storeu_si128 ((__m128i *) (dst + 8 * bpp), 
+                        _mm_shuffle_epi8 (v2, mask));
+      _mm_storeu_si128 ((__m128i *) (dst + 12 * bpp), 
+                        _mm_shuffle_epi8 (v3, mask));
+    } // for each group of 16
+
+  // Clean up the stragglers
+  interleave_scalar (planes + i, plane_stride, bpp, pixels + i * bpp, 
+                     n - i);
+} // interleave_ssse3
+
+static const TileKernels ssse3_kernels =
+  {
+    "ssse3",
+    invert_sse2,
+    affine_sse2,
+    clamp_sse2,
+    swizzle_ssse3,
+    premultiply_sse2,
+    unpremultiply_scalar,
+    blend_over_sse2,
+    match_sse2,
+    fir_u8_sse2,
+    fir_f32_sse2,
+    resample_f32_sse2,
+    deinterleave_ssse3,
+    interleave_ssse3
+  };
+
+
+
+// +--------------+----------------------------------------------------
+// | AVX2 Kernels |
+// +--------------+
+
+static void TARGET_AVX2
+invert_avx2 (guchar *pixels, int bpp, gsize n)
+{
+  const __m256i ones = _mm256_set1_epi8 ((char) 0xFF);
+  gsize i;
+  n *= bpp;
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (pixels + i));
+      _mm256_storeu_si256 ((__m256i *) (pixels + i),
+                           _mm256_xor_si256 (v, ones));
+    } // for each group of 32 bytes
+  invert_scalar (pixels + i, 1, n - i);
+} // invert_avx2
+
+/**
+ * Apply the affine map to 16 bytes, widened to words.
+ */
+static inline __m256i TARGET_AVX2
+affine_words_avx2 (const guchar *p, const gint16 *s, const gint16 *o)
+{
+  __m256i w = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) p));
+  __m256i t = _mm256_mulhi_epu16 (_mm256_slli_epi16 (w, 8),
+                                  _mm256_loadu_si256 ((const __m256i *) s));
+  return _mm256_adds_epi16 (t, _mm256_loadu_si256 ((const __m256i *) o));
+} // affine_words_avx2
+
+static void TARGET_AVX2
+affine_avx2 (guchar *pixels, int bpp, gsize n,
+             const int *scales, const int *offsets)
+{
+  gint16 s_pattern[PATTERN_SIZE], o_pattern[PATTERN_SIZE];
+  int s[4], o[4];
+  gsize i;
+  int k;
+
+  if (! valid_bpp (bpp))
+    return;
+  affine_params (bpp, scales, offsets, s, o);
+  for (k = 0; k < PATTERN_SIZE; k++)
+    {
+      s_pattern[k] = s[k % bpp];
+      o_pattern[k] = o[k % bpp];
+    } // for each entry in the pattern
+
+  n *= bpp;
+  for (i = 0; i + PATTERN_SIZE <= n; i += PATTERN_SIZE)
+    {
+      for (k = 0; k < PATTERN_SIZE; k += 32)
+        {
+          guchar *p = pixels + i + k;
+          __m256i lo = affine_words_avx2 (p, s_pattern + k, o_pattern + k);
+          __m256i hi = affine_words_avx2 (p + 16, s_pattern + k + 16,
+                                          o_pattern + k + 16);
+          // packus works within 128-bit lanes, so put the quarters
+          // back in order
+          __m256i v = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (lo, hi),
+                                                0xD8);
+          _mm256_storeu_si256 ((__m256i *) p, v);
+        } // for each vector in the pattern
+    } // for each pass
+  affine_scalar (pixels + i, bpp, (n - i) / bpp, scales, offsets);
+} // affine_avx2
+
+static void TARGET_AVX2
+clamp_avx2 (guchar *pixels, int bpp, gsize n,
+            const guchar *lo, const guchar *hi)
+{
+  guchar lo_pattern[PATTERN_SIZE], hi_pattern[PATTERN_SIZE];
+  gsize i;
+  int k;
+
+  if (! valid_bpp (bpp))
+    return;
+  for (k = 0; k < PATTERN_SIZE; k++)
+    {
+      lo_pattern[k] = lo[k % bpp];
+      hi_pattern[k] = hi[k % bpp];
+    } // for each entry in the pattern
+
+  n *= bpp;
+  for (i = 0; i + PATTERN_SIZE <= n; i += PATTERN_SIZE)
+    {
+      for (k = 0; k < PATTERN_SIZE; k += 32)
+        {
+          guchar *p = pixels + i + k;
+          __m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+          v = _mm256_max_epu8 (v, _mm256_loadu_si256 ((__m256i *)
+                                                      (lo_pattern + k)));
+          v = _mm256_min_epu8 (v, _mm256_loadu_si256 ((__m256i *)
+                                                      (hi_pattern + k)));
+          _mm256_storeu_si256 ((__m256i *) p, v);
+        } // for each vector in the pattern
+    } // for each pass
+  clamp_scalar (pixels + i, bpp, (n - i) / bpp, lo, hi);
+} // clamp_avx2
+
+static void TARGET_AVX2
+fir_u8_avx2 (const guchar *src, gsize stride, float *dst, gsize n,
+             const float *weights, int taps)
+{
+  gsize j;
+  int k;
+  for (j = 0; j + 8 <= n; j += 8)
+    {
+      __m256 sum = _mm256_setzero_ps ();
+      for (k = 0; k < taps; k++)
+        {
+          __m128i v = 
+            _mm_loadl_epi64 ((const __m128i *) (src + j + k * stride));
+          sum = _mm256_add_ps (sum, 
+                               _mm256_mul_ps (_mm256_set1_ps (weights[k]),
+                                              _mm256_cvtepi32_ps
+                                                (_mm256_cvtepu8_epi32 (v))));
+        } // for each tap
+      _mm256_storeu_ps (dst + j, 
+                        _mm256_add_ps (_mm256_loadu_ps (dst + j), sum));
+    } // for each group of eight
+  fir_u8_scalar (src + j, stride, dst + j, n - j, weights, taps);
+} // fir_u8_avx2
+
+static void TARGET_AVX2
+fir_f32_avx2 (const float *src, gsize stride, guchar *dst, gsize n,
+              const float *weights, int taps)
+{
+  const __m256 zero = _mm256_setzero_ps ();
+  const __m256 top = _mm256_set1_ps (255.0f);
+  const __m256 half = _mm256_set1_ps (0.5f);
+  gsize j;
+  int k;
+  for (j = 0; j + 8 <= n; j += 8)
+    {
+      __m256 sum = _mm256_setzero_ps ();
+      for (k = 0; k < taps; k++)
+        sum = _mm256_add_ps (sum, 
+                             _mm256_mul_ps (_mm256_set1_ps (weights[k]),
+                                            _mm256_loadu_ps 
+                                              (src + j + k * stride)));
+      sum = _mm256_add_ps (_mm256_min_ps (_mm256_max_ps (sum, zero), top),
+                           half);
+      __m256i ints = _mm256_cvttps_epi32 (sum);
+      __m128i words = _mm_packs_epi32 (_mm256_castsi256_si128 (ints),
+                                       _mm256_extracti128_si256 (ints, 1));
+      _mm_storel_epi64 ((__m128i *) (dst + j),
+                        _mm_packus_epi16 (words, words));
+    } // for each group of eight
+  fir_f32_scalar (src + j, stride, dst + j, n - j, weights, taps);
+} // fir_f32_avx2
+
+static const TileKernels avx2_kernels =
+  {
+    "avx2",
+    invert_avx2,
+    affine_avx2,
+    clamp_avx2,
+    swizzle_ssse3,
+    premultiply_sse2,
+    unpremultiply_scalar,
+    blend_over_sse2,
+    match_sse2,
+    fir_u8_avx2,
+    fir_f32_avx2,
+    resample_f32_sse2,
+    deinterleave_ssse3,
+    interleave_ssse3
+  };
+
+#endif // HAVE_X86_SIMD
+
+
+
+// +----------+--------------------------------------------------------
+// | Dispatch |
+// +----------+
+
+/**
+ * Pick the best kernels for this CPU.  (We do this once, on first
+ * use, which may be on any thread.)
+ */
+static const TileKernels *
+tile_kernels (void)
+{
+  static gsize kernels = 0;
+  if (g_once_init_enter (&kernels))
+    {
+      const TileKernels *best = &scalar_kernels;
+#ifdef HAVE_X86_SIMD
+      if (SIMD_CPU_SUPPORTS ("avx2"))
+        best = &avx2_kernels;
+      else if (SIMD_CPU_SUPPORTS ("ssse3"))
+        best = &ssse3_kernels;
+      else if (SIMD_CPU_SUPPORTS ("sse2"))
+        best = &sse2_kernels;
+#endif
+      g_once_init_leave (&kernels, (gsize) best);
+    } // if we have not yet picked kernels
+  return (const TileKernels *) kernels;
+} // tile_kernels
+
+/**
+ * Instantiate, for one bpp, wrappers that call the chosen vector
+ * kernels with a constant bpp.
+ */
+#define DEFINE_ROW_WRAPPERS(BPP) \
+  static void \
+  invert_row_##BPP (guchar *pixels, gsize n) \
+  { \
+    tile_kernels ()->invert (pixels, BPP, n); \
+  } \
+  static void \
+  affine_row_##BPP (guchar *pixels, gsize n, \
+                    const int *scales, const int *offsets) \
+  { \
+    tile_kernels ()->affine (pixels, BPP, n, scales, offsets); \
+  } \
+  static void \
+  clamp_row_##BPP (guchar *pixels, gsize n, \
+                   const guchar *lo, const guchar *hi) \
+  { \
+    tile_kernels ()->clamp (pixels, BPP, n, lo, hi); \
+  } \
+  static void \
+  swizzle_row_##BPP (guchar *pixels, gsize n, const int *map) \
+  { \
+    tile_kernels ()->swizzle (pixels, BPP, n, map); \
+  } \
+  static void \
+  premultiply_row_##BPP (guchar *pixels, gsize n) \
+  { \
+    tile_kernels ()->premultiply (pixels, BPP, n); \
+  } \
+  static void \
+  unpremultiply_row_##BPP (guchar *pixels, gsize n) \
+  { \
+    tile_kernels ()->unpremultiply (pixels, BPP, n); \
+  } \
+  static void \
+  blend_over_row_##BPP (const guchar *src, guchar *dst, gsize n) \
+  { \
+    tile_kernels ()->blend_over (src, dst, BPP, n); \
+  } \
+  static gsize \
+  match_row_##BPP (const guchar *pixels, gsize n, \
+                   const guchar *lo, const guchar *hi, \
+                   guint64 *sums, gssize *first, gssize *last) \
+  { \
+    return tile_kernels ()->match (pixels, BPP, n, lo, hi, \
+                                   sums, first, last); \
+  }
+
+DEFINE_ROW_WRAPPERS (1)
+DEFINE_ROW_WRAPPERS (2)
+DEFINE_ROW_WRAPPERS (3)
+DEFINE_ROW_WRAPPERS (4)
+
+/**
+ * Pick the row version of a kernel: the scalar instance for BPP if
+ * the chosen kernels are scalar, and a wrapper around the vector
+ * kernel otherwise.
+ */
+#define ROW_KERNEL(KERNELS, NAME, BPP) \
+  (((KERNELS)->NAME == NAME##_scalar) ? NAME##_scalar_##BPP \
+                                      : NAME##_row_##BPP)
+
+#define INIT_ROW_KERNELS(ROW, KERNELS, BPP) \
+  do \
+    { \
+      (ROW)->bpp = BPP; \
+      (ROW)->alpha = has_alpha (BPP); \
+      (ROW)->invert = ROW_KERNEL (KERNELS, invert, BPP); \
+      (ROW)->affine = ROW_KERNEL (KERNELS, affine, BPP); \
+      (ROW)->clamp = ROW_KERNEL (KERNELS, clamp, BPP); \
+      (ROW)->swizzle = ROW_KERNEL (KERNELS, swizzle, BPP); \
+      (ROW)->premultiply = ROW_KERNEL (KERNELS, premultiply, BPP); \
+      (ROW)->unpremultiply = ROW_KERNEL (KERNELS, unpremultiply, BPP); \
+      (ROW)->blend_over = ROW_KERNEL (KERNELS, blend_over, BPP); \
+      (ROW)->lut = lut_scalar_##BPP; \
+      (ROW)->match = ROW_KERNEL (KERNELS, match, BPP); \
+    } \
+  while (0)
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+void
+tile_kernel_invert (guchar *pixels, int bpp, gsize n)
+{
+  tile_kernels ()->invert (pixels, bpp, n);
+} // tile_kernel_invert
+
+void
+tile_kernel_affine (guchar *pixels, int bpp, gsize n,
+                    const int *scales, const int *offsets)
+{
+  tile_kernels ()->affine (pixels, bpp, n, scales, offsets);
+} // tile_kernel_affine
+
+void
+tile_kernel_clamp (guchar *pixels, int bpp, gsize n,
+                   const guchar *lo, const guchar *hi)
+{
+  tile_kernels ()->clamp (pixels, bpp, n, lo, hi);
+} // tile_kernel_clamp
+
+void
+tile_kernel_swizzle (guchar *pixels, int bpp, gsize n, const int *map)
+{
+  tile_kernels ()->swizzle (pixels, bpp, n, map);
+} // tile_kernel_swizzle
+
+void
+tile_kernel_premultiply (guchar *pixels, int bpp, gsize n)
+{
+  tile_kernels ()->premultiply (pixels, bpp, n);
+} // tile_kernel_premultiply
+
+void
+tile_kernel_unpremultiply (guchar *pixels, int bpp, gsize n)
+{
+  tile_kernels ()->unpremultiply (pixels, bpp, n);
+} // tile_kernel_unpremultiply
+
+void
+tile_kernel_blend_over (const guchar *src, guchar *dst, int bpp, gsize n)
+{
+  tile_kernels ()->blend_over (src, dst, bpp, n);
+} // tile_kernel_blend_over
+
+void
+tile_kernel_lut (const guchar *src, guchar *dst, int bpp, gsize n,
+                 guchar luts[4][256])
+{
+  CALL_SCALAR_KERNEL (lut_scalar, (src, dst, n, luts));
+} // tile_kernel_lut
+
+void
+tile_kernel_halve (const guchar *row0, const guchar *row1, guchar *dst,
+                   int bpp, gsize n)
+{
+  CALL_SCALAR_KERNEL (halve_scalar, (row0, row1, dst, n));
+} // tile_kernel_halve
+
+gsize
+tile_kernel_match (const guchar *pixels, int bpp, gsize n,
+                   const guchar *lo, const guchar *hi,
+                   guint64 *sums, gssize *first, gssize *last)
+{
+  return tile_kernels ()->match (pixels, bpp, n, lo, hi, sums, first, last);
+} // tile_kernel_match
+
+void
+tile_kernel_fir_u8 (const guchar *src, gsize stride, float *dst, 
+                    gsize n, const float *weights, int taps)
+{
+  tile_kernels ()->fir_u8 (src, stride, dst, n, weights, taps);
+} // tile_kernel_fir_u8
+
+void
+tile_kernel_fir_f32 (const float *src, gsize stride, guchar *dst,
+                     gsize n, const float *weights, int taps)
+{
+  tile_kernels ()->fir_f32 (src, stride, dst, n, weights, taps);
+} // tile_kernel_fir_f32
+
+void
+tile_kernel_resample_f32 (const float *src, int bpp, guchar *dst, gsize n,
+                          const int *starts, const float *weights, int taps)
+{
+  tile_kernels ()->resample_f32 (src, bpp, dst, n, starts, weights, taps);
+} // tile_kernel_resample_f32
+
+void
+tile_kernel_deinterleave (const guchar *pixels, int bpp,
+                          guchar *planes, gsize plane_stride, gsize n)
+{
+  tile_kernels ()->deinterleave (pixels, bpp, planes, plane_stride, n);
+} // tile_kernel_deinterleave
+
+void
+tile_kernel_interleave (const guchar *planes, gsize plane_stride, int bpp,
+                        guchar *pixels, gsize n)
+{
+  tile_kernels ()->interleave (planes, plane_stride, bpp, pixels, n);
+} // tile_kernel_interleave
+
+const TileRowKernels *
+tile_row_kernels (int bpp)
+{
+  static TileRowKernels row_kernels[5];
+  static gsize initialized = 0;
+  if (! valid_bpp (bpp))
+    return NULL;
+  // Workers may get here first, so only one thread builds the tables
+  // and the rest wait for it
+  if (g_once_init_enter (&initialized))
+    {
+      const TileKernels *kernels = tile_kernels ();
+      INIT_ROW_KERNELS (&row_kernels[1], kernels, 1);
+      INIT_ROW_KERNELS (&row_kernels[2], kernels, 2);
+      INIT_ROW_KERNELS (&row_kernels[3], kernels, 3);
+      INIT_ROW_KERNELS (&row_kernels[4], kernels, 4);
+      g_once_init_leave (&initialized, 1);
+    } // if we have not yet built the tables
+  return &row_kernels[bpp];
+} // tile_row_kernels
+
+const char *
+tile_kernel_name (void)
+{
+  return tile_kernels ()->name;
+} // tile_kernel_name
@@ -0,0 +1,240 @@
+#ifndef __TILE_KERNELS_H__
+#define __TILE_KERNELS_H__
+
+/**
+ * tile-kernels.h
+ *   Operations on runs of pixels, as found in the rows of a tile or
+ *   region.  Each operation has a scalar reference implementation and
+ *   vectorized versions, the best of which is picked once for the
+ *   running CPU.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  All of the kernels work in place on n pixels of bpp bytes each (1,
+  2, 3, or 4), stored one after another, so callers work a row at a
+  time when the rowstride is not tight.  Alpha, when present, is the
+  last channel (bpp 2 or 4).  Per-channel parameters are arrays of
+  bpp values.
+
+  Every vectorized kernel computes exactly the same bytes as its
+  scalar counterpart, including rounding.
+
+  // Sample usage
+  for (r = 0; r < rgn->h; r++)
+    tile_kernel_invert (rgn->data + r * rgn->rowstride, rgn->bpp, rgn->w);
+
+  Code that runs many rows of the same bpp (e.g., a tile stream) can
+  instead look up a set of row kernels once.  Those are specialized
+  for the bpp (and hence for alpha), so no call has to decide what
+  to do based on bpp.
+
+  // Sample usage
+  const TileRowKernels *kernels = tile_row_kernels (rgn->bpp);
+  for (r = 0; r < rgn->h; r++)
+    kernels->invert (rgn->data + r * rgn->rowstride, rgn->w);
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * The kernels, specialized for pixels of one particular bpp.  The
+ * parameters mean the same as for the corresponding tile_kernel
+ * functions.
+ */
+struct TileRowKernels
+  {
+    int bpp;
+    gboolean alpha;
+    void (*invert) (guchar *pixels, gsize n);
+    void (*affine) (guchar *pixels, gsize n,
+                    const int *scales, const int *offsets);
+    void (*clamp) (guchar *pixels, gsize n,
+                   const guchar *lo, const guchar *hi);
+    void (*swizzle) (guchar *pixels, gsize n, const int *map);
+    void (*premultiply) (guchar *pixels, gsize n);
+    void (*unpremultiply) (guchar *pixels, gsize n);
+    void (*blend_over) (const guchar *src, guchar *dst, gsize n);
+    void (*lut) (const guchar *src, guchar *dst, gsize n,
+                 guchar luts[4][256]);
+    gsize (*match) (const guchar *pixels, gsize n,
+                    const guchar *lo, const guchar *hi,
+                    guint64 *sums, gssize *first, gssize *last);
+  };
+typedef struct TileRowKernels TileRowKernels;
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Replace each byte b by 255 - b.
+ */
+void tile_kernel_invert (guchar *pixels, int bpp, gsize n);
+
+/**
+ * Replace each byte b of channel c by
+ *   ((b * scales[c]) >> 8) + offsets[c],
+ * clamped to [0,255].  Scales are in 1/256ths and are clamped to
+ * [0, 32767]; offsets are clamped to [-255, 255].
+ */
+void tile_kernel_affine (guchar *pixels, int bpp, gsize n,
+                         const int *scales, const int *offsets);
+
+/**
+ * Clamp each byte of channel c to [lo[c], hi[c]].
+ */
+void tile_kernel_clamp (guchar *pixels, int bpp, gsize n,
+                        const guchar *lo, const guchar *hi);
+
+/**
+ * Rearrange the channels of each pixel, so that channel c of the
+ * result is channel map[c] of the original.  (Channels may be
+ * repeated.)  Does nothing if any entry of map is out of range.
+ */
+void tile_kernel_swizzle (guchar *pixels, int bpp, gsize n, const int *map);
+
+/**
+ * Multiply the color channels of each pixel by its alpha.  Does
+ * nothing for pixels without alpha.
+ */
+void tile_kernel_premultiply (guchar *pixels, int bpp, gsize n);
+
+/**
+ * Divide the color channels of each pixel by its alpha (the inverse
+ * of tile_kernel_premultiply, up to rounding).  Fully transparent
+ * pixels become black.  Does nothing for pixels without alpha.
+ */
+void tile_kernel_unpremultiply (guchar *pixels, int bpp, gsize n);
+
+/**
+ * Draw the pixels in src over the pixels in dst, as with the
+ * "normal" layer mode: each color channel moves toward the source
+ * color in proportion to the source alpha, and the alphas combine.
+ * (Exact when dst is opaque.)  Pixels without alpha are treated as
+ * opaque.
+ */
+void tile_kernel_blend_over (const guchar *src, guchar *dst,
+                             int bpp, gsize n);
+
+/**
+ * Copy n pixels from src to dst, replacing each byte of channel c by
+ * its entry in luts[c].  (src and dst may be the same.)
+ */
+void tile_kernel_lut (const guchar *src, guchar *dst, int bpp, gsize n,
+                      guchar luts[4][256]);
+
+/**
+ * Shrink a 2-row by n-pixel block to one row of (n+1)/2 pixels, each
+ * the rounded average of a 2x2 block of row0 and row1.  If n is odd,
+ * the last pixel averages the last pixel of each row.  (To halve a
+ * lone last row, pass it as both row0 and row1.)
+ */
+void tile_kernel_halve (const guchar *row0, const guchar *row1, guchar *dst,
+                        int bpp, gsize n);
+
+/**
+ * Find the pixels each of whose channels c lies in [lo[c], hi[c]].
+ * Returns the number of such pixels, adds each of their channels c to
+ * sums[c], and sets first and last to the indices of the first and
+ * last of them (or to -1 if there are none).  Does not change the
+ * pixels.
+ */
+gsize tile_kernel_match (const guchar *pixels, int bpp, gsize n,
+                         const guchar *lo, const guchar *hi,
+                         guint64 *sums, gssize *first, gssize *last);
+
+/**
+ * Add a weighted sum of taps bytes, stride bytes apart, to each of n
+ * floats:
+ *   dst[j] += weights[0] * src[j] + ... 
+ *             + weights[taps-1] * src[j + (taps-1) * stride]
+ * (The sum is formed first, in order, and then added.)  With stride
+ * bpp, this runs a filter along a row of pixels; with stride the
+ * rowstride, down the columns of a block of rows.
+ */
+void tile_kernel_fir_u8 (const guchar *src, gsize stride, float *dst, 
+                         gsize n, const float *weights, int taps);
+
+/**
+ * Set each of n bytes to a weighted sum of taps floats, stride floats
+ * apart, clamped to [0,255] and rounded (halves up):
+ *   dst[j] = weights[0] * src[j] + ...
+ *            + weights[taps-1] * src[j + (taps-1) * stride]
+ */
+void tile_kernel_fir_f32 (const float *src, gsize stride, guchar *dst,
+                          gsize n, const float *weights, int taps);
+
+/**
+ * Resample a row of pixels of bpp floats into n pixels of bpp bytes.
+ * Output pixel i is the weighted sum of the taps pixels starting at
+ * pixel starts[i] of src, using the taps weights starting at
+ * weights[i * taps], clamped and rounded as by tile_kernel_fir_f32:
+ *   dst[i*bpp + c] = weights[i*taps] * src[starts[i]*bpp + c] + ...
+ *     + weights[i*taps + taps-1] * src[(starts[i] + taps-1)*bpp + c]
+ */
+void tile_kernel_resample_f32 (const float *src, int bpp, guchar *dst,
+                               gsize n, const int *starts,
+                               const float *weights, int taps);
+
+/**
+ * Split n interleaved pixels of bpp bytes into bpp planes of n bytes,
+ * plane_stride bytes apart.
+ */
+void tile_kernel_deinterleave (const guchar *pixels, int bpp,
+                               guchar *planes, gsize plane_stride, gsize n);
+
+/**
+ * Merge bpp planes of n bytes, plane_stride bytes apart, into n
+ * interleaved pixels of bpp bytes.
+ */
+void tile_kernel_interleave (const guchar *planes, gsize plane_stride,
+                             int bpp, guchar *pixels, gsize n);
+
+/**
+ * Get the kernels specialized for pixels of bpp bytes.  Returns NULL
+ * if we don't handle that bpp.
+ */
+const TileRowKernels *tile_row_kernels (int bpp);
+
+/**
+ * Get the name of the most advanced instruction set used by the
+ * kernels (e.g., "avx2", "ssse3", "sse2", or "scalar").
+ */
+const char *tile_kernel_name (void);
+
+#endif // __TILE_KERNELS_H__
@@ -0,0 +1,716 @@
+/**
+ * tile-pool.c
+ *   Run pure pixel kernels over the tiles of a drawable on a pool of
+ *   worker threads.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <libgimp/gimp.h>
+#include <string.h>             // For memcpy and memmove
+
+#include "mipmap.h"
+#include "tile-pool.h"
+
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The number of tiles per thread in a batch.  More than one, so that
+ * a thread that finishes early can pick up another tile rather than
+ * wait for the slowest thread.
+ */
+#define TILES_PER_THREAD 4
+
+/**
+ * The most threads we will use.
+ */
+#define MAX_THREADS 64
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * A batch of jobs that the main thread waits for.
+ */
+struct TileBatch
+  {
+    GMutex mutex;
+    GCond done;
+    int pending;                // The number of unfinished jobs
+  };
+typedef struct TileBatch TileBatch;
+
+/**
+ * Where the tiles come from and where they go.  Shared by all the
+ * jobs in a run, and not changed while a batch is running.
+ */
+struct TileSource
+  {
+    int drawable;
+    int bpp;
+    int width;                  // The size of the drawable
+    int height;
+    gboolean writes;            // Do we write the tiles back?
+#if HAVE_GEGL_BUFFERS
+    GeglBuffer *buffer;
+    GeglBuffer *shadow;         // NULL unless we write
+    const Babl *format;
+#else
+    GimpDrawable *gdrawable;
+    GimpPixelRgn source_region;
+    GimpPixelRgn target_region;
+#endif
+  };
+typedef struct TileSource TileSource;
+
+/**
+ * What to do with each tile.  Exactly one of map, reduce, filter, and
+ * task is set.
+ */
+struct TileWork
+  {
+    TileJobFunc map;
+    TileReduceFunc reduce;
+    TileMergeFunc merge;
+    gsize partial_size;
+    gconstpointer identity;
+    gpointer result;
+    TileHaloFunc filter;
+    int halo;                   // How far around each tile filter looks
+    TileTaskFunc task;          // For numbered tasks, which have no tiles
+    gpointer data;
+  };
+typedef struct TileWork TileWork;
+
+/**
+ * One tile's worth of work.
+ */
+struct TileJob
+  {
+    TileSource *source;
+    const TileWork *work;
+    guchar *pixels;
+    gpointer partial;           // This tile's partial result
+    guchar *halo_pixels;        // The tile and its halo (for filters)
+    int halo_rowstride;
+    int rowstride;
+    int x;
+    int y;
+    int width;
+    int height;
+    int task;                   // The task number (for tasks)
+    TileBatch *batch;
+  };
+typedef struct TileJob TileJob;
+
+
+
+// +---------+---------------------------------------------------------
+// | Globals |
+// +---------+
+
+/**
+ * The worker threads.  Created when first needed.
+ */
+static GThreadPool *pool = NULL;
+
+/**
+ * The number of threads we use (0 for not yet decided).
+ */
+static int pool_threads = 0;
+
+
+
+// +-----------------+-------------------------------------------------
+// | Local Utilities |
+// +-----------------+
+
+#if HAVE_GEGL_BUFFERS
+/**
+ * Get the 8-bit format whose channels match those of a drawable.
+ */
+static const Babl *
+drawable_u8_format (int drawable)
+{
+  gboolean alpha = gimp_drawable_has_alpha (drawable);
+  if (gimp_drawable_is_gray (drawable))
+    return babl_format (alpha ? "Y'A u8" : "Y' u8");
+  return babl_format (alpha ? "R'G'B'A u8" : "R'G'B' u8");
+} // drawable_u8_format
+#endif
+
+/**
+ * Fill in the parts of a halo that lie past the edge of the drawable
+ * by repeating the edge pixels.  pixels holds height rows of width
+ * pixels, of which the outer left and right columns and top and bottom
+ * rows need filling.
+ */
+static void
+halo_pad (guchar *pixels, int bpp, int rowstride, int width, int height,
+          int left, int top, int right, int bottom)
+{
+  int r, i;
+  for (r = top; r < height - bottom; r++)
+    {
+      guchar *row = pixels + r * rowstride;
+      for (i = 0; i < left; i++)
+        memcpy (row + i * bpp, row + left * bpp, bpp);
+      for (i = width - right; i < width; i++)
+        memcpy (row + i * bpp, row + (width - right - 1) * bpp, bpp);
+    } // for each fetched row
+  for (r = 0; r < top; r++)
+    memcpy (pixels + r * rowstride, pixels + top * rowstride, width * bpp);
+  for (r = height - bottom; r < height; r++)
+    memcpy (pixels + r * rowstride, 
+            pixels + (height - bottom - 1) * rowstride, width * bpp);
+} // halo_pad
+
+/**
+ * Copy a rectangle of a drawable into its shadow unchanged.
+ */
+static void
+shadow_copy_rect (int drawable, int x, int y, int width, int height)
+{
+#if HAVE_GEGL_BUFFERS
+  GeglBuffer *buffer = gimp_drawable_get_buffer (drawable);
+  GeglBuffer *shadow = gimp_drawable_get_shadow_buffer (drawable);
+  GeglRectangle rect = { x, y, width, height };
+  if ((buffer != NULL) && (shadow != NULL))
+    {
+      gegl_buffer_copy (buffer, &rect, GEGL_ABYSS_NONE, shadow, &rect);
+      gegl_buffer_flush (shadow);
+    } // if we got both buffers
+  if (shadow != NULL)
+    g_object_unref (shadow);
+  if (buffer != NULL)
+    g_object_unref (buffer);
+#else
+  GimpDrawable *gdrawable = gimp_drawable_get (drawable);
+  if (gdrawable == NULL)
+    return;
+  GimpPixelRgn from, to;
+  gimp_pixel_rgn_init (&from, gdrawable, x, y, width, height, FALSE, FALSE);
+  gimp_pixel_rgn_init (&to, gdrawable, x, y, width, height, TRUE, TRUE);
+  gpointer pr;
+  for (pr = gimp_pixel_rgns_register (2, &from, &to); 
+       pr != NULL; 
+       pr = gimp_pixel_rgns_process (pr))
+    {
+      int r;
+      for (r = 0; r < from.h; r++)
+        memcpy (to.data + r * to.rowstride, from.data + r * from.rowstride,
+                from.w * from.bpp);
+    } // for each pair of tiles
+  gimp_drawable_flush (gdrawable);
+  gimp_drawable_detach (gdrawable);
+#endif
+} // shadow_copy_rect
+
+/**
+ * Get ready to read (and perhaps write) the tiles of a drawable, and
+ * to read halo pixels around them.  Returns FALSE if we cannot.
+ */
+static gboolean
+tile_source_open (TileSource *source, int drawable,
+                  int x, int y, int width, int height, int halo,
+                  gboolean writes)
+{
+  source->drawable = drawable;
+  source->width = gimp_drawable_width (drawable);
+  source->height = gimp_drawable_height (drawable);
+  source->writes = writes;
+#if HAVE_GEGL_BUFFERS
+  source->buffer = gimp_drawable_get_buffer (drawable);
+  if (source->buffer == NULL)
+    return FALSE;
+  source->shadow = writes 
+                   ? gimp_drawable_get_shadow_buffer (drawable) : NULL;
+  if (writes && (source->shadow == NULL))
+    {
+      g_object_unref (source->buffer);
+      return FALSE;
+    } // if we could not get the shadow
+  source->format = drawable_u8_format (drawable);
+  source->bpp = babl_format_get_bytes_per_pixel (source->format);
+#else
+  source->gdrawable = gimp_drawable_get (drawable);
+  if (source->gdrawable == NULL)
+    return FALSE;
+  source->bpp = source->gdrawable->bpp;
+  int left = MAX (0, x - halo);
+  int top = MAX (0, y - halo);
+  gimp_pixel_rgn_init (&(source->source_region), source->gdrawable,
+                       left, top, 
+                       MIN (source->width, x + width + halo) - left,
+                       MIN (source->height, y + height + halo) - top,
+                       FALSE, FALSE);
+  gimp_pixel_rgn_init (&(source->target_region), source->gdrawable,
+                       x, y, width, height, TRUE, TRUE);
+#endif
+  return TRUE;
+} // tile_source_open
+
+/**
+ * Finish with the tiles of a drawable, writing back any changes to the
+ * rectangle we worked on.
+ */
+static void
+tile_source_close (TileSource *source, int x, int y, int width, int height)
+{
+#if HAVE_GEGL_BUFFERS
+  if (source->writes)
+    {
+      gegl_buffer_flush (source->shadow);
+      g_object_unref (source->shadow);
+    } // if we wrote
+  g_object_unref (source->buffer);
+#else
+  gimp_drawable_flush (source->gdrawable);
+  gimp_drawable_detach (source->gdrawable);
+#endif
+  if (source->writes)
+    {
+      drawable_shadow_fill (source->drawable, x, y, width, height);
+      gimp_drawable_merge_shadow (source->drawable, TRUE);
+      gimp_drawable_update (source->drawable, x, y, width, height);
+      mipmap_invalidate (source->drawable, x, y, width, height);
+      gimp_displays_flush ();
+    } // if we wrote
+} // tile_source_close
+
+/**
+ * Fetch the pixels for a job.  With GEGL buffers, any thread may call
+ * this; otherwise only the main thread may.
+ */
+static void
+tile_source_fetch (TileSource *source, TileJob *job)
+{
+#if HAVE_GEGL_BUFFERS
+  GeglRectangle rect = { job->x, job->y, job->width, job->height };
+  gegl_buffer_get (source->buffer, &rect, 1.0, source->format,
+                   job->pixels, job->rowstride, GEGL_ABYSS_NONE);
+#else
+  gimp_pixel_rgn_get_rect (&(source->source_region), job->pixels,
+                           job->x, job->y, job->width, job->height);
+#endif
+} // tile_source_fetch
+
+/**
+ * Fetch the pixels around a job, for a filter.  The same threading
+ * rules apply as for tile_source_fetch.
+ */
+static void
+tile_source_fetch_halo (TileSource *source, TileJob *job, int halo)
+{
+#if HAVE_GEGL_BUFFERS
+  GeglRectangle rect = { job->x - halo, job->y - halo, 
+                         job->width + 2 * halo, job->height + 2 * halo };
+  gegl_buffer_get (source->buffer, &rect, 1.0, source->format,
+                   job->halo_pixels, job->halo_rowstride, GEGL_ABYSS_CLAMP);
+#else
+  // Fetch the part that lies within the drawable, and make up the rest
+  int left = MAX (0, halo - job->x);
+  int top = MAX (0, halo - job->y);
+  int right = MAX (0, job->x + job->width + halo - source->width);
+  int bottom = MAX (0, job->y + job->height + halo - source->height);
+  int width = job->width + 2 * halo;
+  int height = job->height + 2 * halo;
+  gimp_pixel_rgn_get_rect (&(source->source_region), 
+                           job->halo_pixels + top * job->halo_rowstride 
+                             + left * source->bpp,
+                           job->x - halo + left, job->y - halo + top,
+                           width - left - right, height - top - bottom);
+  int packed = (width - left - right) * source->bpp;
+  if (packed != job->halo_rowstride)
+    {
+      // get_rect packs the rows, so spread them out, last first
+      guchar *base = job->halo_pixels + top * job->halo_rowstride
+                     + left * source->bpp;
+      int r;
+      for (r = height - top - bottom - 1; r > 0; r--)
+        memmove (base + r * job->halo_rowstride, base + r * packed, packed);
+    } // if we fetched narrower rows
+  if (left + top + right + bottom > 0)
+    halo_pad (job->halo_pixels, source->bpp, job->halo_rowstride,
+              width, height, left, top, right, bottom);
+#endif
+} // tile_source_fetch_halo
+
+/**
+ * Store the pixels for a job.  The same threading rules apply as for
+ * tile_source_fetch.
+ */
+static void
+tile_source_store (TileSource *source, TileJob *job)
+{
+#if HAVE_GEGL_BUFFERS
+  GeglRectangle rect = { job->x, job->y, job->width, job->height };
+  gegl_buffer_set (source->shadow, &rect, 0, source->format,
+                   job->pixels, job->rowstride);
+#else
+  gimp_pixel_rgn_set_rect (&(source->target_region), job->pixels,
+                           job->x, job->y, job->width, job->height);
+#endif
+} // tile_source_store
+
+/**
+ * Run one job.
+ */
+static void
+run_job (TileJob *job)
+{
+  const TileWork *work = job->work;
+  if (work->task != NULL)
+    {
+      work->task (job->task, work->data);
+      return;
+    } // if it's a task rather than a tile
+#if HAVE_GEGL_BUFFERS
+  if (work->filter != NULL)
+    tile_source_fetch_halo (job->source, job, work->halo);
+  else
+    tile_source_fetch (job->source, job);
+#endif
+  if (work->filter != NULL)
+    work->filter (job->halo_pixels, job->halo_rowstride,
+                  job->pixels, job->source->bpp, job->rowstride,
+                  job->x, job->y, job->width, job->height,
+                  work->halo, work->data);
+  else if (work->map != NULL)
+    work->map (job->pixels, job->source->bpp, job->rowstride,
+               job->x, job->y, job->width, job->height,
+               work->data);
+  else
+    work->reduce (job->pixels, job->source->bpp, job->rowstride,
+                  job->x, job->y, job->width, job->height,
+                  job->partial, work->data);
+#if HAVE_GEGL_BUFFERS
+  if (job->source->writes)
+    tile_source_store (job->source, job);
+#endif
+} // run_job
+
+/**
+ * Run one job on a worker thread and tell the batch when we're done.
+ */
+static void
+tile_pool_work (gpointer data, gpointer user_data)
+{
+  TileJob *job = (TileJob *) data;
+  run_job (job);
+  g_mutex_lock (&(job->batch->mutex));
+  if (--(job->batch->pending) == 0)
+    g_cond_signal (&(job->batch->done));
+  g_mutex_unlock (&(job->batch->mutex));
+} // tile_pool_work
+
+/**
+ * Get the pool, creating it if necessary.  Returns NULL if we should
+ * do the work ourselves.
+ */
+static GThreadPool *
+tile_pool_get (void)
+{
+  if (tile_pool_threads () < 2)
+    return NULL;
+  if (pool == NULL)
+    pool = g_thread_pool_new (tile_pool_work, NULL, pool_threads,
+                              FALSE, NULL);
+  return pool;
+} // tile_pool_get
+
+/**
+ * Run n jobs, on the pool if we have one, and wait for all of them
+ * to finish.
+ */
+static void
+run_jobs (TileJob *jobs, int n, TileBatch *batch)
+{
+  GThreadPool *workers = tile_pool_get ();
+  int i;
+
+  // Without a pool, just do the work
+  if ((workers == NULL) || (n == 1))
+    {
+      for (i = 0; i < n; i++)
+        run_job (jobs + i);
+      return;
+    } // if there's no pool
+
+  batch->pending = n;
+  for (i = 0; i < n; i++)
+    {
+      jobs[i].batch = batch;
+      g_thread_pool_push (workers, jobs + i, NULL);
+    } // for each job
+  g_mutex_lock (&(batch->mutex));
+  while (batch->pending > 0)
+    g_cond_wait (&(batch->done), &(batch->mutex));
+  g_mutex_unlock (&(batch->mutex));
+} // run_jobs
+
+/**
+ * Do some work over every tile of a rectangle of a drawable.  This is
+ * the driver for drawable_map_tiles, drawable_map_tiles_halo, and
+ * drawable_reduce_tiles.
+ */
+static int
+run_tiles (int drawable, int x, int y, int width, int height,
+           const TileWork *work)
+{
+  // Validate
+  if ((x < 0) || (y < 0) || (width <= 0) || (height <= 0)
+      || (x + width > gimp_drawable_width (drawable))
+      || (y + height > gimp_drawable_height (drawable)))
+    return -1;
+  TileSource source;
+  int halo = work->halo;
+  gboolean writes = (work->map != NULL) || (work->filter != NULL);
+  // Merging the shadow only changes the selection, so there is no
+  // point in writing the rest
+  if (writes 
+      && ! gimp_drawable_mask_intersect (drawable, &x, &y, &width, &height))
+    return 0;
+  if (! tile_source_open (&source, drawable, x, y, width, height, halo,
+                          writes))
+    return -1;
+
+  // Set up the batches
+  int bpp = source.bpp;
+  int tw = gimp_tile_width ();
+  int th = gimp_tile_height ();
+  int ntiles = ((x + width - 1) / tw - x / tw + 1)
+               * ((y + height - 1) / th - y / th + 1);
+  int size = MIN (tile_pool_threads () * TILES_PER_THREAD, ntiles);
+  gsize psize = work->partial_size;
+  TileJob *jobs = g_try_new0 (TileJob, size);
+  guchar *buffers = g_try_malloc ((gsize) size * tw * th * bpp);
+  guchar *partials = g_try_malloc (MAX (1, size * psize));
+  gsize halo_size = (work->filter == NULL) 
+                    ? 0 : (gsize) (tw + 2 * halo) * (th + 2 * halo) * bpp;
+  guchar *halos = g_try_malloc (MAX (1, size * halo_size));
+  if ((jobs == NULL) || (buffers == NULL) || (partials == NULL)
+      || (halos == NULL))
+    {
+      g_free (jobs);
+      g_free (buffers);
+      g_free (partials);
+      g_free (halos);
+      source.writes = FALSE;
+      tile_source_close (&source, x, y, width, height);
+      return -1;
+    } // if we could not allocate the buffers
+  TileBatch batch;
+  g_mutex_init (&(batch.mutex));
+  g_cond_init (&(batch.done));
+
+  // Work through the tiles in batches, a row of tiles at a time.  We
+  // follow the tile grid, so that each job touches exactly one tile.
+  int tx = x;
+  int ty = y;
+  while (ty < y + height)
+    {
+      // Set up a batch
+      int n = 0;
+      while ((n < size) && (ty < y + height))
+        {
+          TileJob *job = jobs + n;
+          job->source = &source;
+          job->work = work;
+          job->pixels = buffers + (gsize) n * tw * th * bpp;
+          job->partial = partials + n * psize;
+          job->x = tx;
+          job->y = ty;
+          job->width = MIN ((tx / tw + 1) * tw, x + width) - tx;
+          job->height = MIN ((ty / th + 1) * th, y + height) - ty;
+          job->rowstride = job->width * bpp;
+          job->halo_pixels = halos + n * halo_size;
+          job->halo_rowstride = (job->width + 2 * halo) * bpp;
+          if (psize > 0)
+            memcpy (job->partial, work->identity, psize);
+#if ! HAVE_GEGL_BUFFERS
+          // Only the main thread may talk to libgimp
+          if (work->filter != NULL)
+            tile_source_fetch_halo (&source, job, halo);
+          else
+            tile_source_fetch (&source, job);
+#endif
+          ++n;
+          tx += job->width;
+          if (tx >= x + width)
+            {
+              tx = x;
+              ty += job->height;
+            } // if we've finished a row of tiles
+        } // while
+
+      // Process it
+      run_jobs (jobs, n, &batch);
+
+      // And finish it, in tile order, so that the results do not
+      // depend on which thread finished first
+      int i;
+      for (i = 0; i < n; i++)
+        {
+#if ! HAVE_GEGL_BUFFERS
+          if (source.writes)
+            tile_source_store (&source, jobs + i);
+#endif
+          if (work->merge != NULL)
+            work->merge (work->result, jobs[i].partial, work->data);
+        } // for each job
+    } // while
+
+  // Clean up
+  g_mutex_clear (&(batch.mutex));
+  g_cond_clear (&(batch.done));
+  g_free (jobs);
+  g_free (buffers);
+  g_free (partials);
+  g_free (halos);
+  tile_source_close (&source, x, y, width, height);
+  return 0;
+} // run_tiles
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+void
+tile_pool_init (void)
+{
+#if HAVE_GEGL_BUFFERS
+  gegl_init (NULL, NULL);
+#endif
+} // tile_pool_init
+
+void
+drawable_shadow_fill (int drawable, int x, int y, int width, int height)
+{
+  int x1, y1, x2, y2;
+  gimp_drawable_mask_bounds (drawable, &x1, &y1, &x2, &y2);
+
+  // Split the part of the bounds outside the rectangle into the bands
+  // above and below it and the pieces to its left and right
+  int top = MIN (MAX (y, y1), y2);
+  int bottom = MAX (MIN (y + height, y2), top);
+  int left = MIN (MAX (x, x1), x2);
+  int right = MAX (MIN (x + width, x2), left);
+  int pieces[4][4] =
+    {
+      { x1, y1, x2 - x1, top - y1 },
+      { x1, bottom, x2 - x1, y2 - bottom },
+      { x1, top, left - x1, bottom - top },
+      { right, top, x2 - right, bottom - top }
+    };
+  int i;
+  for (i = 0; i < 4; i++)
+    if ((pieces[i][2] > 0) && (pieces[i][3] > 0))
+      shadow_copy_rect (drawable, pieces[i][0], pieces[i][1], 
+                        pieces[i][2], pieces[i][3]);
+} // drawable_shadow_fill
+
+int
+drawable_map_tiles (int drawable, int x, int y, int width, int height,
+                    TileJobFunc func, gpointer data)
+{
+  TileWork work = { func, NULL, NULL, 0, NULL, NULL, NULL, 0, NULL, data };
+  return run_tiles (drawable, x, y, width, height, &work);
+} // drawable_map_tiles
+
+int
+drawable_map_tiles_halo (int drawable, int x, int y, 
+                         int width, int height, int halo,
+                         TileHaloFunc func, gpointer data)
+{
+  if ((func == NULL) || (halo < 0))
+    return -1;
+  TileWork work = { NULL, NULL, NULL, 0, NULL, NULL, func, halo, NULL, data };
+  return run_tiles (drawable, x, y, width, height, &work);
+} // drawable_map_tiles_halo
+
+int
+drawable_reduce_tiles (int drawable, int x, int y, int width, int height,
+                       TileReduceFunc reduce, TileMergeFunc merge,
+                       gsize partial_size, gconstpointer identity,
+                       gpointer result, gpointer data)
+{
+  if ((reduce == NULL) || (merge == NULL) || (partial_size == 0))
+    return -1;
+  TileWork work = { NULL, reduce, merge, partial_size, identity,
+                    result, NULL, 0, NULL, data };
+  return run_tiles (drawable, x, y, width, height, &work);
+} // drawable_reduce_tiles
+
+int
+tile_pool_run (int n, TileTaskFunc func, gpointer data)
+{
+  if ((func == NULL) || (n < 0))
+    return -1;
+  if (n == 0)
+    return 0;
+  TileWork work = { NULL, NULL, NULL, 0, NULL, NULL, NULL, 0, func, data };
+  int size = MIN (tile_pool_threads () * TILES_PER_THREAD, n);
+  TileJob *jobs = g_try_new0 (TileJob, size);
+  if (jobs == NULL)
+    return -1;
+  TileBatch batch;
+  g_mutex_init (&(batch.mutex));
+  g_cond_init (&(batch.done));
+
+  // Run the tasks in batches
+  int task = 0;
+  while (task < n)
+    {
+      int count = MIN (size, n - task);
+      int i;
+      for (i = 0; i < count; i++)
+        {
+          jobs[i].work = &work;
+          jobs[i].task = task++;
+        } // for each job in the batch
+      run_jobs (jobs, count, &batch);
+    } // while
+
+  // Clean up
+  g_mutex_clear (&(batch.mutex));
+  g_cond_clear (&(batch.done));
+  g_free (jobs);
+  return 0;
+} // tile_pool_run
+
+int
+tile_pool_threads (void)
+{
+  if (pool_threads == 0)
+    pool_threads = CLAMP (g_get_num_processors (), 1, MAX_THREADS);
+  return pool_threads;
+} // tile_pool_threads
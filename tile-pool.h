@@ -0,0 +1,234 @@
+#ifndef __TILE_POOL_H__
+#define __TILE_POOL_H__
+
+/**
+ * tile-pool.h
+ *   Run pure pixel kernels over the tiles of a drawable on a pool of
+ *   worker threads.
+ *
+ * Copyright (c) 2013 Samuel A. Rebelsky.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// +-------+-----------------------------------------------------------
+// | Notes |
+// +-------+
+
+/*
+  libgimp is not thread safe, so only the thread that calls
+  drawable_map_tiles ever talks to the GIMP.  That thread copies a
+  batch of tiles into private buffers, hands each buffer to a worker,
+  waits for the batch, and then writes the buffers back through the
+  shadow, in order.  Workers see nothing but bytes.
+
+  With GIMP 2.10 and up, the drawable's GEGL buffers can be used from
+  any thread, so the workers fetch and store their own tiles (always
+  as 8-bit pixels, with the drawable's channels) and the main thread
+  only waits.
+
+  A job function must therefore be pure: it may read data and change
+  the pixels it is given, but it may not call libgimp or change
+  anything shared.
+
+  Filters that need the pixels around each tile (such as
+  convolutions) use drawable_map_tiles_halo, which gives each job a
+  read-only copy of its tile grown by a halo, along with the buffer
+  for its results.  Neighboring jobs fetch overlapping halos, which
+  costs a little extra reading but means that no job waits for
+  another.
+
+  Work that does not follow the tiles of a drawable (such as
+  resampling, which reads rows at one scale and writes them at
+  another) can still use the workers through tile_pool_run, which
+  calls a function once for each of n numbered tasks.  The same rule
+  applies: tasks may not call libgimp, so the caller fetches the
+  pixels first and stores the results afterwards.
+
+  Reductions work the same way, except that each tile's job fills in
+  its own partial result, starting from a copy of an identity value,
+  and the main thread merges the partial results into the final
+  result in tile order (left to right, then top to bottom).  Since
+  the order never depends on which thread finishes first, the result
+  is the same from run to run, even for merges (such as floating-
+  point sums) that are not associative.
+
+  // Sample usage
+  static void
+  invert_job (guchar *pixels, int bpp, int rowstride,
+              int x, int y, int width, int height, gpointer data)
+  {
+    int r;
+    for (r = 0; r < height; r++)
+      tile_kernel_invert (pixels + r * rowstride, bpp, width);
+  } // invert_job
+
+  drawable_map_tiles (drawable, 0, 0, width, height, invert_job, NULL);
+
+  // Sample usage: count the pixels whose first channel is 255
+  static void
+  count_job (const guchar *pixels, int bpp, int rowstride,
+             int x, int y, int width, int height, 
+             gpointer partial, gpointer data)
+  {
+    ...
+    *((gint64 *) partial) += count;
+  } // count_job
+
+  static void
+  count_merge (gpointer result, gconstpointer partial, gpointer data)
+  {
+    *((gint64 *) result) += *((const gint64 *) partial);
+  } // count_merge
+
+  gint64 zero = 0, count = 0;
+  drawable_reduce_tiles (drawable, 0, 0, width, height, 
+                         count_job, count_merge, sizeof (gint64), &zero,
+                         &count, NULL);
+ */
+
+
+
+// +---------+---------------------------------------------------------
+// | Headers |
+// +---------+
+
+#include <glib.h>
+#include <libgimp/gimp.h>
+
+/**
+ * GEGL buffers may be read and written from any thread, so when we
+ * have them (GIMP 2.10 and up), the workers fetch and store their own
+ * tiles.  Everything else that uses GEGL shares this test.
+ */
+#define HAVE_GEGL_BUFFERS GIMP_CHECK_VERSION (2, 10, 0)
+
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * A kernel to run over one tile.  pixels holds height rows of width
+ * pixels of bpp bytes each, rowstride bytes apart, for the rectangle
+ * whose upper-left corner is (x,y).  data is the data given to
+ * drawable_map_tiles.
+ */
+typedef void (*TileJobFunc) (guchar *pixels, int bpp, int rowstride,
+                             int x, int y, int width, int height,
+                             gpointer data);
+
+/**
+ * A reduction over one tile.  The pixels are as for TileJobFunc, but
+ * must not be changed.  The function should fold the pixels into
+ * partial, which starts as a copy of the identity given to
+ * drawable_reduce_tiles.
+ */
+typedef void (*TileReduceFunc) (const guchar *pixels, int bpp, int rowstride,
+                                int x, int y, int width, int height,
+                                gpointer partial, gpointer data);
+
+/**
+ * A filter over one tile: a kernel whose new pixels depend on the
+ * pixels around them.  source holds the old pixels of the tile grown
+ * by halo pixels on every side (so its upper-left pixel is at
+ * (x - halo, y - halo)), with rows source_rowstride bytes apart.
+ * Where that reaches past the edge of the drawable, the edge pixels
+ * are repeated.  The function fills in pixels, laid out as for
+ * TileJobFunc, with the new pixels of the tile.
+ */
+typedef void (*TileHaloFunc) (const guchar *source, int source_rowstride,
+                              guchar *pixels, int bpp, int rowstride,
+                              int x, int y, int width, int height,
+                              int halo, gpointer data);
+
+/**
+ * One of the numbered tasks given to tile_pool_run.
+ */
+typedef void (*TileTaskFunc) (int task, gpointer data);
+
+/**
+ * Fold one tile's partial result into the final result.  Always called
+ * on the thread that called drawable_reduce_tiles, in tile order.
+ */
+typedef void (*TileMergeFunc) (gpointer result, gconstpointer partial,
+                               gpointer data);
+
+
+
+// +-----------+-------------------------------------------------------
+// | Functions |
+// +-----------+
+
+/**
+ * Get ready to use the pool.  Call once, on the main thread, before
+ * any other tile-pool function.
+ */
+void tile_pool_init (void);
+
+/**
+ * Copy the pixels of a drawable that lie within the bounds of the
+ * selection but outside a rectangle into the shadow.  Merging the
+ * shadow applies all of the selection bounds, so call this after
+ * writing just the rectangle into the shadow and before merging it.
+ */
+void drawable_shadow_fill (int drawable, int x, int y, int width, int height);
+
+/**
+ * Run func over every tile of a rectangle of a drawable, writing the
+ * results back so that the change can be undone.  Only the part of
+ * the rectangle within the selection changes.  Returns 0 on success
+ * and a negative number on failure.
+ */
+int drawable_map_tiles (int drawable, int x, int y, int width, int height,
+                        TileJobFunc func, gpointer data);
+
+/**
+ * Run func over every tile of a rectangle of a drawable, giving it
+ * halo pixels of context on every side, and write the results back so
+ * that the change can be undone.  Only the part of the rectangle within
+ * the selection changes.  The context always comes from the original
+ * pixels, so tiles never see each other's results.  Returns 0 on
+ * success and a negative number on failure.
+ */
+int drawable_map_tiles_halo (int drawable, int x, int y, 
+                             int width, int height, int halo,
+                             TileHaloFunc func, gpointer data);
+
+/**
+ * Reduce every tile of a rectangle of a drawable, merging the partial
+ * results (each partial_size bytes, starting as a copy of identity)
+ * into result.  Returns 0 on success and a negative number on failure.
+ */
+int drawable_reduce_tiles (int drawable, int x, int y, int width, int height,
+                           TileReduceFunc reduce, TileMergeFunc merge,
+                           gsize partial_size, gconstpointer identity,
+                           gpointer result, gpointer data);
+
+/**
+ * Call func for each task from 0 to n-1, on the worker threads, and
+ * wait for all of them to finish.  The tasks may run in any order.
+ * Returns 0 on success and a negative number on failure.
+ */
+int tile_pool_run (int n, TileTaskFunc func, gpointer data);
+
+/**
+ * Get the number of threads that work on tiles, one per processor.
+ */
+int tile_pool_threads (void);
+
+#endif // __TILE_POOL_H__
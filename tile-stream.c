@@ -29,6 +29,10 @@
 #include <libgimp/gimp.h>
 #include <string.h>             //  For memcpy.
 
+#include "irgb.h"
+#include "mipmap.h"
+#include "tile-kernels.h"
+#include "tile-pool.h"
 #include "tile-stream.h"
 
 
@@ -41,6 +45,36 @@
  */
 #define MAX_TILE_STREAMS 16
 
+/**
+ * The number of tiles we prefetch ahead of the current tile unless
+ * the client asks for something different.
+ */
+#define DEFAULT_LOOKAHEAD 2
+
+/**
+ * The largest lookahead window we permit.  (Each prefetched tile stays
+ * in the plug-in's tile cache, so we don't want this to grow without
+ * bound.)
+ */
+#define MAX_LOOKAHEAD 16
+
+/**
+ * The default number of bytes that we transfer at once when getting
+ * or setting a region.
+ */
+#define DEFAULT_REGION_CHUNK_SIZE (4 * 1024 * 1024)
+
+/**
+ * The most tiles we will ask the tile cache to hold when we're
+ * fetching scattered pixels.
+ */
+#define MAX_PIXEL_CACHE_TILES 256
+
+/**
+ * The widest halo we permit around the tiles of a stream.
+ */
+#define MAX_HALO 64
+
 
 // +-------+-----------------------------------------------------------
 // | Types |
@@ -59,6 +93,21 @@ struct TileStream
     int width;
     int height;
     int n;
+    int ntiles;
+    int lookahead;
+    int prefetched;
+    guint prefetcher;
+    IrgbFormat format;
+    guint32 *packed;
+    int layout;
+    guchar *planes;
+    int channels;
+    guchar *selected;
+    int halo;
+    int halo_mode;
+    int halo_n;                 // The tile that halo_region holds
+    GimpPixelRgn halo_region;   // The current tile, with its halo
+    GimpPixelRgn context_region;        // The whole drawable, for halos
     GimpDrawable *source;
     GimpDrawable *target;
     gpointer iterator;
@@ -67,6 +116,7 @@ struct TileStream
   };
 typedef struct TileStream TileStream;
 
+
 
 // +---------+---------------------------------------------------------
 // | Globals |
@@ -78,12 +128,23 @@ typedef struct TileStream TileStream;
  */
 TileStream *streams[MAX_TILE_STREAMS];
 
+/**
+ * The number of tiles we've asked the plug-in tile cache to hold.
+ */
+static gulong cache_ntiles = 0;
+
+/**
+ * The number of bytes that we transfer at once when getting or setting
+ * a region.
+ */
+static gsize region_chunk_size = DEFAULT_REGION_CHUNK_SIZE;
+
 
 // +-----------------+-------------------------------------------------
 // | Predeclarations |
 // +-----------------+
 
-static void invert_pixels (GimpPixelRgn *rgn);
+static gboolean tile_stream_prefetch (gpointer data);
 
 
 // +-----------------+-------------------------------------------------
@@ -106,25 +167,6 @@ copy_pixels (GimpPixelRgn *rgn, int size, guchar *data)
   return 1;
 } // copy_pixels
 
-/**
- * Invert pixels in a region.  (Intended mostly for testing.)
- */
-static void
-invert_pixels (GimpPixelRgn *rgn)
-{
-  guchar *data = rgn->data;
-  int r;
-  for (r = 0; r < rgn->h; r++)
-    {
-      int c;
-      for (c = 0; c < rgn->rowstride; c++)
-        { 
-          data[c] = (guchar) (255 - data[c]);
-        } // for c
-      data += rgn->rowstride;
-    } // for r
-} // invert_pixels
-
 /**
  * Get the next available iterator id.
  */
@@ -140,6 +182,371 @@ next_iterator_id (void)
   return -1;
 } // next_iterator_id
 
+/**
+ * Allocate a tile buffer with a tight rowstride.  Returns NULL if
+ * there is not enough memory.
+ */
+static TileBuffer *
+tile_buffer_new (int x, int y, int width, int height, int bpp)
+{
+  TileBuffer *buffer = g_try_new0 (TileBuffer, 1);
+  if (buffer == NULL)
+    return NULL;
+  buffer->x = x;
+  buffer->y = y;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->bpp = bpp;
+  buffer->rowstride = width * bpp;
+  buffer->layout = TILE_LAYOUT_INTERLEAVED;
+  buffer->data = g_try_malloc ((gsize) buffer->rowstride * height);
+  if (buffer->data == NULL)
+    {
+      g_free (buffer);
+      return NULL;
+    } // if we could not allocate the data
+  return buffer;
+} // tile_buffer_new
+
+/**
+ * Find the tile in column tx and row ty of a drawable.  Returns NULL
+ * if the coordinates are outside of the tile grid.
+ */
+static GimpTile *
+drawable_find_tile (GimpDrawable *drawable, int tx, int ty)
+{
+  if ((tx < 0) || (tx >= drawable->ntile_cols)
+      || (ty < 0) || (ty >= drawable->ntile_rows))
+    return NULL;
+  return gimp_drawable_get_tile (drawable, FALSE, ty, tx);
+} // drawable_find_tile
+
+/**
+ * Determine if a rectangle lies entirely within a drawable.
+ */
+static gboolean
+drawable_contains (GimpDrawable *drawable, 
+                   int x, int y, int width, int height)
+{
+  return ((x >= 0) && (y >= 0) && (width > 0) && (height > 0)
+          && ((gint64) x + width <= drawable->width)
+          && ((gint64) y + height <= drawable->height));
+} // drawable_contains
+
+/**
+ * Determine if all of the given points lie within a drawable.
+ */
+static gboolean
+drawable_contains_points (GimpDrawable *drawable, int n, 
+                          const gint32 *xs, const gint32 *ys)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      if ((xs[i] < 0) || (xs[i] >= drawable->width)
+          || (ys[i] < 0) || (ys[i] >= drawable->height))
+        return FALSE;
+    } // for each point
+  return TRUE;
+} // drawable_contains_points
+
+/**
+ * Determine how many rows of a region to transfer at once.
+ */
+static int
+region_chunk_rows (int rowstride, int height)
+{
+  gsize rows = region_chunk_size / rowstride;
+  if (rows < 1)
+    return 1;
+  if (rows > height)
+    return height;
+  return (int) rows;
+} // region_chunk_rows
+
+/**
+ * Count the channels selected by a channel mask.
+ */
+static int
+channel_count (int channels)
+{
+  int count = 0;
+  for ( ; channels != 0; channels >>= 1)
+    count += channels & 1;
+  return count;
+} // channel_count
+
+/**
+ * Copy one channel (or the luminance, for channel TILE_CHANNEL_LUMINANCE)
+ * of n pixels to every step'th byte of dst.
+ */
+static void
+extract_channel (const guchar *pixels, int bpp, int channel,
+                 guchar *dst, int step, gsize n)
+{
+  gsize i;
+  if (channel == TILE_CHANNEL_LUMINANCE)
+    {
+      for (i = 0; i < n; i++)
+        dst[i * step] = irgb_luminance (irgb_from_pixel (pixels + i * bpp, 
+                                                         bpp));
+    } // if we're computing the luminance
+  else
+    {
+      pixels += channel;
+      for (i = 0; i < n; i++)
+        dst[i * step] = pixels[i * bpp];
+    } // if we're copying a channel
+} // extract_channel
+
+/**
+ * Copy every step'th byte of src into one channel of n pixels.
+ */
+static void
+insert_channel (const guchar *src, int step, 
+                guchar *pixels, int bpp, int channel, gsize n)
+{
+  gsize i;
+  pixels += channel;
+  for (i = 0; i < n; i++)
+    pixels[i * bpp] = src[i * step];
+} // insert_channel
+
+/**
+ * Determine the most pixels in one tile that a stream delivers,
+ * counting its halo.
+ */
+static gsize
+tile_stream_max_pixels (TileStream *stream)
+{
+  return (gsize) (gimp_tile_width () + 2 * stream->halo) 
+         * (gimp_tile_height () + 2 * stream->halo);
+} // tile_stream_max_pixels
+
+/**
+ * Find the coordinate whose pixel stands in for coordinate i of a
+ * line of n pixels, when i may lie past either end.  Returns -1 if
+ * the pixel should be zero.
+ */
+static int
+halo_coordinate (int i, int n, int mode)
+{
+  if ((i >= 0) && (i < n))
+    return i;
+  if (mode == TILE_HALO_ZERO)
+    return -1;
+  if ((mode == TILE_HALO_CLAMP) || (n == 1))
+    return CLAMP (i, 0, n - 1);
+
+  // Mirrored coordinates repeat with period 2(n-1)
+  int period = 2 * (n - 1);
+  i %= period;
+  if (i < 0)
+    i += period;
+  return (i < n) ? i : period - i;
+} // halo_coordinate
+
+/**
+ * Fill in the halo region of a stream for the current tile: fetch the
+ * part that lies within the drawable and make up the rest.
+ */
+static void
+tile_stream_fetch_halo (TileStream *stream)
+{
+  GimpPixelRgn *tile = &(stream->source_region);
+  GimpPixelRgn *padded = &(stream->halo_region);
+  int bpp = tile->bpp;
+  int halo = stream->halo;
+  int dw = stream->source->width;
+  int dh = stream->source->height;
+
+  padded->bpp = bpp;
+  padded->x = tile->x - halo;
+  padded->y = tile->y - halo;
+  padded->w = tile->w + 2 * halo;
+  padded->h = tile->h + 2 * halo;
+  padded->rowstride = padded->w * bpp;
+
+  // Fetch what we can.  get_rect packs the rows, so spread them out
+  // (last first) if we fetched narrower rows than we store.
+  int left = MAX (0, padded->x);
+  int top = MAX (0, padded->y);
+  int right = MIN (dw, padded->x + padded->w);
+  int bottom = MIN (dh, padded->y + padded->h);
+  guchar *base = padded->data + (top - padded->y) * padded->rowstride
+                 + (left - padded->x) * bpp;
+  int packed = (right - left) * bpp;
+  int r, c;
+  gimp_pixel_rgn_get_rect (&(stream->context_region), base,
+                           left, top, right - left, bottom - top);
+  if (packed != padded->rowstride)
+    for (r = bottom - top - 1; r > 0; r--)
+      memmove (base + r * padded->rowstride, base + r * packed, packed);
+
+  // Fill in the columns past the left and right edges
+  for (r = top - padded->y; r < bottom - padded->y; r++)
+    {
+      guchar *row = padded->data + r * padded->rowstride;
+      for (c = 0; c < padded->w; c++)
+        {
+          int x = padded->x + c;
+          if ((x >= left) && (x < right))
+            {
+              c = right - padded->x - 1;
+              continue;
+            } // if we fetched this column
+          int source = halo_coordinate (x, dw, stream->halo_mode);
+          if (source < 0)
+            memset (row + c * bpp, 0, bpp);
+          else
+            memcpy (row + c * bpp, row + (source - padded->x) * bpp, bpp);
+        } // for each column
+    } // for each fetched row
+
+  // And then the rows past the top and bottom
+  for (r = 0; r < padded->h; r++)
+    {
+      int y = padded->y + r;
+      if ((y >= top) && (y < bottom))
+        continue;
+      guchar *row = padded->data + r * padded->rowstride;
+      int source = halo_coordinate (y, dh, stream->halo_mode);
+      if (source < 0)
+        memset (row, 0, padded->rowstride);
+      else
+        memcpy (row, padded->data + (source - padded->y) * padded->rowstride,
+                padded->rowstride);
+    } // for each row
+} // tile_stream_fetch_halo
+
+/**
+ * Determine the number of tile columns that a stream covers.
+ */
+static int
+tile_stream_cols (TileStream *stream)
+{
+  int tw = gimp_tile_width ();
+  return (stream->left + stream->width - 1) / tw - stream->left / tw + 1;
+} // tile_stream_cols
+
+/**
+ * Determine the number of tile rows that a stream covers.
+ */
+static int
+tile_stream_rows (TileStream *stream)
+{
+  int th = gimp_tile_height ();
+  return (stream->top + stream->height - 1) / th - stream->top / th + 1;
+} // tile_stream_rows
+
+/**
+ * Make sure that the plug-in tile cache can hold at least ntiles
+ * tiles.  We only ever grow the cache, since other streams may
+ * still be relying on it.
+ */
+static void
+reserve_tile_cache (gulong ntiles)
+{
+  if (ntiles > cache_ntiles)
+    {
+      cache_ntiles = ntiles;
+      gimp_tile_cache_ntiles (cache_ntiles);
+    } // if we need more room
+} // reserve_tile_cache
+
+/**
+ * Make sure that the idle prefetcher is running if the stream has
+ * tiles left to prefetch.
+ */
+static void
+tile_stream_schedule_prefetch (int id)
+{
+  TileStream *stream = streams[id];
+  if (stream->prefetched <= stream->n)
+    stream->prefetched = stream->n + 1;
+  if ((stream->prefetcher == 0)
+      && (stream->iterator != NULL)
+      && (stream->prefetched <= stream->n + stream->lookahead)
+      && (stream->prefetched < stream->ntiles))
+    {
+      stream->prefetcher = g_idle_add (tile_stream_prefetch, 
+                                       GINT_TO_POINTER (id));
+    } // if there is work to do
+} // tile_stream_schedule_prefetch
+
+/**
+ * Pull one upcoming source tile into the plug-in tile cache.  Runs as
+ * an idle callback, so it only happens while the server has nothing
+ * better to do (typically, while the client is working on the
+ * current tile).  We do one tile per call so that incoming messages
+ * are not held up.  Returns TRUE if there are more tiles to prefetch.
+ */
+static gboolean
+tile_stream_prefetch (gpointer data)
+{
+  int id = GPOINTER_TO_INT (data);
+  TileStream *stream = streams[id];
+
+  // Sanity check.  (Closing the stream should remove the source, but
+  // it doesn't hurt to be careful.)
+  if (stream == NULL)
+    return FALSE;
+
+  // Have we already gotten far enough ahead?
+  if ((stream->iterator == NULL)
+      || (stream->prefetched > stream->n + stream->lookahead)
+      || (stream->prefetched >= stream->ntiles))
+    {
+      stream->prefetcher = 0;
+      return FALSE;
+    } // if we're done
+
+  // Tiles are processed left to right, top to bottom
+  int cols = tile_stream_cols (stream);
+  int x = (stream->left / gimp_tile_width () + stream->prefetched % cols)
+          * gimp_tile_width ();
+  int y = (stream->top / gimp_tile_height () + stream->prefetched / cols)
+          * gimp_tile_height ();
+
+  // Referencing the tile fetches it from the core and puts it in the
+  // cache.  Unreferencing it (without dirtying it) leaves it there.
+  GimpTile *tile = gimp_drawable_get_tile2 (stream->source, FALSE, x, y);
+  if (tile != NULL)
+    {
+      gimp_tile_ref (tile);
+      gimp_tile_unref (tile, FALSE);
+    } // if we found the tile
+
+  ++(stream->prefetched);
+  return TRUE;
+} // tile_stream_prefetch
+
+/**
+ * Split the rows of a region into planes of width * height bytes.
+ */
+static void
+region_to_planes (GimpPixelRgn *rgn, guchar *planes)
+{
+  gsize plane_stride = (gsize) rgn->w * rgn->h;
+  int r;
+  for (r = 0; r < rgn->h; r++)
+    tile_kernel_deinterleave (rgn->data + r * rgn->rowstride, rgn->bpp,
+                              planes + r * rgn->w, plane_stride, rgn->w);
+} // region_to_planes
+
+/**
+ * Merge planes of width * height bytes into the rows of a region.
+ */
+static void
+planes_to_region (const guchar *planes, GimpPixelRgn *rgn)
+{
+  gsize plane_stride = (gsize) rgn->w * rgn->h;
+  int r;
+  for (r = 0; r < rgn->h; r++)
+    tile_kernel_interleave (planes + r * rgn->w, plane_stride, rgn->bpp,
+                            rgn->data + r * rgn->rowstride, rgn->w);
+} // planes_to_region
+
 
 // +--------------+----------------------------------------------------
 // | Constructors |
@@ -176,6 +583,19 @@ rectangle_new_tile_stream (int image, int drawable,
   stream->width = width;
   stream->height = height;
   stream->n = 0;
+  stream->ntiles = tile_stream_cols (stream) * tile_stream_rows (stream);
+  stream->lookahead = DEFAULT_LOOKAHEAD;
+  stream->prefetched = 0;
+  stream->prefetcher = 0;
+  stream->format = IRGB_FORMAT_IRGB;
+  stream->packed = NULL;
+  stream->layout = TILE_LAYOUT_INTERLEAVED;
+  stream->planes = NULL;
+  stream->channels = TILE_CHANNELS_ALL;
+  stream->selected = NULL;
+  stream->halo = 0;
+  stream->halo_mode = TILE_HALO_CLAMP;
+  stream->halo_n = -1;
   stream->source = gimp_drawable_get (drawable);
   if (stream->source == NULL)
     {
@@ -199,6 +619,7 @@ rectangle_new_tile_stream (int image, int drawable,
                        stream->target,
                        left, top, width, height,
                        TRUE, TRUE);
+  reserve_tile_cache (2 * (tile_stream_cols (stream) + MAX_LOOKAHEAD + 1));
   stream->iterator = gimp_pixel_rgns_register (2, &(stream->source_region),
                                                   &(stream->target_region));
 
@@ -212,6 +633,7 @@ rectangle_new_tile_stream (int image, int drawable,
 
   // And we're done
   streams[id] = stream;
+  tile_stream_schedule_prefetch (id);
   return id;
 } // rectangle_new_tile_stream
 
@@ -265,6 +687,9 @@ tile_stream_advance (int id)
                    stream->source_region.data);
     } // if we're not at the end
 
+  // Get ready for the next few tiles while the client works on this one
+  tile_stream_schedule_prefetch (id);
+
   // Did we succeed?
   return (stream->iterator != NULL);
 } //  tile_stream_advance
@@ -284,16 +709,30 @@ tile_stream_close (int id)
   while (tile_stream_advance (id))
     ;
 
-  // And update!
+  // Stop prefetching
   TileStream *stream = streams[id];
+  if (stream->prefetcher != 0)
+    g_source_remove (stream->prefetcher);
+
+  // And update!
   gimp_drawable_flush (stream->target);
+  drawable_shadow_fill (stream->drawable, 
+                        stream->left, stream->top,
+                        stream->width, stream->height);
   gimp_drawable_merge_shadow (stream->drawable, TRUE);
   gimp_drawable_update (stream->drawable,
                         stream->left, stream->top,
                         stream->width, stream->height);
+  mipmap_invalidate (stream->drawable, 
+                     stream->left, stream->top,
+                     stream->width, stream->height);
   gimp_displays_flush ();
   gimp_drawable_detach (stream->source);
   gimp_drawable_detach (stream->target);
+  g_free (stream->packed);
+  g_free (stream->planes);
+  g_free (stream->selected);
+  g_free (stream->halo_region.data);
   g_free (stream);
   streams[id] = NULL;
 #ifdef DEBUG
@@ -315,6 +754,19 @@ tile_stream_get (int id)
   return &(streams[id]->source_region);
 } // tile_stream_get
 
+/**
+ * Set the number of tiles to prefetch beyond the current tile.
+ */
+int
+tile_stream_set_lookahead (int id, int lookahead)
+{
+  if (! tile_stream_is_valid (id))
+    return -1;
+  streams[id]->lookahead = CLAMP (lookahead, 0, MAX_LOOKAHEAD);
+  tile_stream_schedule_prefetch (id);
+  return streams[id]->lookahead;
+} // tile_stream_set_lookahead
+
 int
 tile_stream_is_valid (int id)
 {
@@ -334,3 +786,829 @@ tile_update (int id, int size, guchar *data)
   copy_pixels (&(streams[id]->target_region), size, data);
   return 0;
 } // tile__update
+
+
+// +---------------+---------------------------------------------------
+// | Packed Pixels |
+// +---------------+
+
+/**
+ * Choose the packing used for the packed versions of get and update.
+ */
+int
+tile_stream_set_format (int id, int format)
+{
+  if (! tile_stream_is_valid (id))
+    return -1;
+  if ((format != IRGB_FORMAT_IRGB) && (format != IRGB_FORMAT_RGBA32))
+    return -1;
+  streams[id]->format = format;
+  return format;
+} // tile_stream_set_format
+
+/**
+ * Get the current tile as packed integers.  We convert a row at a
+ * time, since the region's rowstride need not be tight.
+ */
+const guint32 *
+tile_stream_get_packed (int id, int *n)
+{
+  GimpPixelRgn *region = tile_stream_get_padded (id);
+  if (region == NULL)
+    return NULL;
+
+  // Make room.  Every tile fits in the space for a full tile, so we
+  // only ever need one buffer per stream.
+  TileStream *stream = streams[id];
+  if (stream->packed == NULL)
+    {
+      stream->packed = g_try_new (guint32, tile_stream_max_pixels (stream));
+      if (stream->packed == NULL)
+        return NULL;
+    } // if we have not yet allocated the buffer
+
+  // Convert
+  int r;
+  for (r = 0; r < region->h; r++)
+    irgb_pixels_to_ints (region->data + r * region->rowstride, region->bpp,
+                         stream->packed + r * region->w, region->w,
+                         stream->format);
+
+  *n = region->w * region->h;
+  return stream->packed;
+} // tile_stream_get_packed
+
+/**
+ * Update the pixels in the current tile from packed integers.
+ */
+int
+tile_update_packed (int id, int n, const guint32 *colors)
+{
+  if (tile_stream_get (id) == NULL)
+    return -1;
+  TileStream *stream = streams[id];
+  GimpPixelRgn *region = &(stream->target_region);
+  if (n != region->w * region->h)
+    {
+      fprintf (stderr, "Sizes don't match: %d != %d\n", 
+               n, region->w * region->h);
+      return -1;
+    } // if the sizes don't match
+
+  int r;
+  for (r = 0; r < region->h; r++)
+    irgb_ints_to_pixels (colors + r * region->w, stream->format,
+                         region->data + r * region->rowstride, region->bpp,
+                         region->w);
+  return 0;
+} // tile_update_packed
+
+
+// +---------+---------------------------------------------------------
+// | Layouts |
+// +---------+
+
+int
+tile_stream_set_layout (int id, int layout)
+{
+  if (! tile_stream_is_valid (id))
+    return -1;
+  if ((layout != TILE_LAYOUT_INTERLEAVED) && (layout != TILE_LAYOUT_PLANAR))
+    return -1;
+  streams[id]->layout = layout;
+  return layout;
+} // tile_stream_set_layout
+
+int
+tile_stream_get_layout (int id)
+{
+  if (! tile_stream_is_valid (id))
+    return -1;
+  return streams[id]->layout;
+} // tile_stream_get_layout
+
+/**
+ * Get the current tile as planes.
+ */
+const guchar *
+tile_stream_get_planes (int id)
+{
+  GimpPixelRgn *region = tile_stream_get_padded (id);
+  if (region == NULL)
+    return NULL;
+
+  // Make room.  As with packed pixels, one full tile's worth of space
+  // suffices for every tile in the stream.
+  TileStream *stream = streams[id];
+  if (stream->planes == NULL)
+    {
+      stream->planes = g_try_malloc (tile_stream_max_pixels (stream) 
+                                     * region->bpp);
+      if (stream->planes == NULL)
+        return NULL;
+    } // if we have not yet allocated the buffer
+
+  region_to_planes (region, stream->planes);
+  return stream->planes;
+} // tile_stream_get_planes
+
+/**
+ * Update the pixels in the current tile from planes.
+ */
+int
+tile_update_planes (int id, int size, const guchar *data)
+{
+  if (tile_stream_get (id) == NULL)
+    return -1;
+  GimpPixelRgn *region = &(streams[id]->target_region);
+  int expected_size = region->w * region->h * region->bpp;
+  if (size != expected_size)
+    {
+      fprintf (stderr, "Sizes don't match: %d != %d\n", size, expected_size);
+      return -1;
+    } // if the sizes don't match
+  planes_to_region (data, region);
+  return 0;
+} // tile_update_planes
+
+
+
+// +----------+--------------------------------------------------------
+// | Channels |
+// +----------+
+
+int
+tile_stream_set_channels (int id, int channels)
+{
+  if (! tile_stream_is_valid (id))
+    return -1;
+  int all = (1 << streams[id]->source->bpp) - 1;
+  if ((channels & ~(all | (1 << TILE_CHANNEL_LUMINANCE))) != 0)
+    return -1;
+  if ((channels == 0) || (channels == all))
+    channels = TILE_CHANNELS_ALL;
+  streams[id]->channels = channels;
+  return channels;
+} // tile_stream_set_channels
+
+/**
+ * Get the bytes of the current tile that the client asked for.  We
+ * build a subset of channels directly from the source region, so a
+ * planar subset never needs the full set of planes.
+ */
+const guchar *
+tile_stream_get_bytes (int id, int *size, int *bpp, int *rowstride)
+{
+  GimpPixelRgn *region = tile_stream_get_padded (id);
+  if (region == NULL)
+    return NULL;
+  TileStream *stream = streams[id];
+  gboolean planar = (stream->layout == TILE_LAYOUT_PLANAR);
+
+  // The common case: everything
+  if (stream->channels == TILE_CHANNELS_ALL)
+    {
+      *bpp = region->bpp;
+      *rowstride = planar ? region->w : region->rowstride;
+      *size = planar ? region->w * region->h * region->bpp
+                     : region->h * region->rowstride;
+      return planar ? tile_stream_get_planes (id) : region->data;
+    } // if the client wants all of the channels
+
+  // Make room
+  if (stream->selected == NULL)
+    {
+      // One byte per channel, plus the luminance
+      stream->selected = g_try_malloc (tile_stream_max_pixels (stream)
+                                       * (region->bpp + 1));
+      if (stream->selected == NULL)
+        return NULL;
+    } // if we have not yet allocated the buffer
+
+  // Pull out the channels one at a time
+  int nchannels = channel_count (stream->channels);
+  gsize plane_size = (gsize) region->w * region->h;
+  int channel;
+  int j = 0;
+  for (channel = 0; channel <= TILE_CHANNEL_LUMINANCE; channel++)
+    {
+      if (! (stream->channels & (1 << channel)))
+        continue;
+      int r;
+      for (r = 0; r < region->h; r++)
+        {
+          guchar *dst = planar 
+                        ? stream->selected + j * plane_size + r * region->w
+                        : stream->selected + r * region->w * nchannels + j;
+          extract_channel (region->data + r * region->rowstride, 
+                           region->bpp, channel,
+                           dst, planar ? 1 : nchannels, region->w);
+        } // for each row
+      ++j;
+    } // for each channel
+
+  *bpp = nchannels;
+  *rowstride = planar ? region->w : region->w * nchannels;
+  *size = region->w * region->h * nchannels;
+  return stream->selected;
+} // tile_stream_get_bytes
+
+/**
+ * Update the current tile from bytes in the form that 
+ * tile_stream_get_bytes provides.  Channels that the client did not
+ * ask for keep the values they got from the source.
+ */
+int
+tile_update_bytes (int id, int size, const guchar *data)
+{
+  if (tile_stream_get (id) == NULL)
+    return -1;
+  TileStream *stream = streams[id];
+  gboolean planar = (stream->layout == TILE_LAYOUT_PLANAR);
+
+  // The common case: everything
+  if (stream->channels == TILE_CHANNELS_ALL)
+    return planar ? tile_update_planes (id, size, data)
+                  : tile_update (id, size, (guchar *) data);
+
+  // We can't write back a computed channel
+  if (stream->channels & (1 << TILE_CHANNEL_LUMINANCE))
+    return -1;
+
+  // Make sure that we have the right number of bytes
+  GimpPixelRgn *region = &(stream->target_region);
+  int nchannels = channel_count (stream->channels);
+  gsize plane_size = (gsize) region->w * region->h;
+  if (size != plane_size * nchannels)
+    {
+      fprintf (stderr, "Sizes don't match: %d != %lu\n", 
+               size, (unsigned long) (plane_size * nchannels));
+      return -1;
+    } // if the sizes don't match
+
+  // Merge the channels one at a time
+  int channel;
+  int j = 0;
+  for (channel = 0; channel < region->bpp; channel++)
+    {
+      if (! (stream->channels & (1 << channel)))
+        continue;
+      int r;
+      for (r = 0; r < region->h; r++)
+        {
+          const guchar *src = planar 
+                              ? data + j * plane_size + r * region->w
+                              : data + r * region->w * nchannels + j;
+          insert_channel (src, planar ? 1 : nchannels,
+                          region->data + r * region->rowstride, 
+                          region->bpp, channel, region->w);
+        } // for each row
+      ++j;
+    } // for each channel
+  return 0;
+} // tile_update_bytes
+
+
+// +-------+-----------------------------------------------------------
+// | Halos |
+// +-------+
+
+int
+tile_stream_set_halo (int id, int halo, int mode)
+{
+  if (! tile_stream_is_valid (id))
+    return -1;
+  if ((halo < 0) || (halo > MAX_HALO)
+      || ((mode != TILE_HALO_CLAMP) && (mode != TILE_HALO_MIRROR)
+          && (mode != TILE_HALO_ZERO)))
+    return -1;
+  TileStream *stream = streams[id];
+
+  // Make room for the padded tiles.  The other buffers are sized for
+  // the old halo, so we let them be reallocated when next needed.
+  guchar *data = NULL;
+  if (halo > 0)
+    {
+      data = g_try_malloc ((gsize) (gimp_tile_width () + 2 * halo)
+                           * (gimp_tile_height () + 2 * halo)
+                           * stream->source->bpp);
+      if (data == NULL)
+        return -1;
+    } // if we need a buffer
+  g_free (stream->halo_region.data);
+  g_free (stream->packed);
+  g_free (stream->planes);
+  g_free (stream->selected);
+  stream->packed = NULL;
+  stream->planes = NULL;
+  stream->selected = NULL;
+  stream->halo_region.data = data;
+  stream->halo = halo;
+  stream->halo_mode = mode;
+  stream->halo_n = -1;
+
+  // The halos come from anywhere in the drawable.  They mostly reach
+  // into the row of tiles above and the row below, so keep those in
+  // the cache too.
+  gimp_pixel_rgn_init (&(stream->context_region), stream->source,
+                       0, 0, stream->source->width, stream->source->height,
+                       FALSE, FALSE);
+  if (halo > 0)
+    reserve_tile_cache (2 * (3 * tile_stream_cols (stream) 
+                             + MAX_LOOKAHEAD + 1));
+  return halo;
+} // tile_stream_set_halo
+
+GimpPixelRgn *
+tile_stream_get_padded (int id)
+{
+  GimpPixelRgn *region = tile_stream_get (id);
+  if ((region == NULL) || (streams[id]->halo == 0))
+    return region;
+  TileStream *stream = streams[id];
+  if (stream->halo_n != stream->n)
+    {
+      tile_stream_fetch_halo (stream);
+      stream->halo_n = stream->n;
+    } // if we have not yet fetched this tile's halo
+  return &(stream->halo_region);
+} // tile_stream_get_padded
+
+
+// +---------------+---------------------------------------------------
+// | Random Access |
+// +---------------+
+
+/**
+ * Get a copy of one tile of a drawable.
+ */
+TileBuffer *
+drawable_tile_get (int drawable, int tx, int ty)
+{
+  GimpDrawable *source = gimp_drawable_get (drawable);
+  if (source == NULL)
+    return NULL;
+
+  // Find the tile
+  GimpTile *tile = drawable_find_tile (source, tx, ty);
+  if (tile == NULL)
+    {
+      gimp_drawable_detach (source);
+      return NULL;
+    } // if there is no such tile
+
+  // Copy out the pixels.  (Referencing the tile is what actually
+  // fetches the data from the core.)
+  gimp_tile_ref (tile);
+  TileBuffer *buffer = tile_buffer_new (tx * gimp_tile_width (),
+                                        ty * gimp_tile_height (),
+                                        tile->ewidth, tile->eheight,
+                                        tile->bpp);
+  if (buffer != NULL)
+    memcpy (buffer->data, tile->data, buffer->rowstride * buffer->height);
+  gimp_tile_unref (tile, FALSE);
+
+  // And we're done
+  gimp_drawable_detach (source);
+  return buffer;
+} // drawable_tile_get
+
+/**
+ * Replace the pixels in one tile of a drawable.
+ */
+int
+drawable_tile_put (int drawable, int tx, int ty, int size, guchar *data)
+{
+  GimpDrawable *target = gimp_drawable_get (drawable);
+  if (target == NULL)
+    return -1;
+
+  // Find the tile
+  GimpTile *tile = drawable_find_tile (target, tx, ty);
+  if (tile == NULL)
+    {
+      gimp_drawable_detach (target);
+      return -1;
+    } // if there is no such tile
+
+  // Make sure that we have the right number of bytes
+  int expected_size = tile->ewidth * tile->eheight * tile->bpp;
+  if (expected_size != size)
+    {
+      fprintf (stderr, "Sizes don't match: %d != %d\n", size, expected_size);
+      gimp_drawable_detach (target);
+      return -1;
+    } // if the sizes don't match
+
+  // Copy in the pixels and mark the tile as dirty so that it gets
+  // sent back to the core
+  gimp_tile_ref (tile);
+  memcpy (tile->data, data, size);
+  int width = tile->ewidth;
+  int height = tile->eheight;
+  gimp_tile_unref (tile, TRUE);
+
+  // And update!
+  gimp_drawable_flush (target);
+  gimp_drawable_update (drawable,
+                        tx * gimp_tile_width (), ty * gimp_tile_height (),
+                        width, height);
+  mipmap_invalidate (drawable, 
+                     tx * gimp_tile_width (), ty * gimp_tile_height (),
+                     width, height);
+  gimp_displays_flush ();
+  gimp_drawable_detach (target);
+  return 0;
+} // drawable_tile_put
+
+
+// +---------+---------------------------------------------------------
+// | Regions |
+// +---------+
+
+/**
+ * Get a copy of a rectangle of a drawable.
+ */
+TileBuffer *
+drawable_region_get (int drawable, int x, int y, int width, int height)
+{
+  GimpDrawable *source = gimp_drawable_get (drawable);
+  if (source == NULL)
+    return NULL;
+  if (! drawable_contains (source, x, y, width, height))
+    {
+      gimp_drawable_detach (source);
+      return NULL;
+    } // if the rectangle is out of bounds
+
+  TileBuffer *buffer = tile_buffer_new (x, y, width, height, source->bpp);
+  if (buffer == NULL)
+    {
+      gimp_drawable_detach (source);
+      return NULL;
+    } // if we could not allocate the buffer
+
+  // Copy the pixels a band of rows at a time, so that we never ask
+  // the GIMP for too much at once.
+  GimpPixelRgn region;
+  gimp_pixel_rgn_init (&region, source, x, y, width, height, FALSE, FALSE);
+  int rows = region_chunk_rows (buffer->rowstride, height);
+  int r;
+  for (r = 0; r < height; r += rows)
+    {
+      gimp_pixel_rgn_get_rect (&region, 
+                               buffer->data + (gsize) r * buffer->rowstride,
+                               x, y + r, width, MIN (rows, height - r));
+    } // for each band
+
+  // And we're done
+  gimp_drawable_detach (source);
+  return buffer;
+} // drawable_region_get
+
+/**
+ * Replace the pixels in a rectangle of a drawable.
+ */
+int
+drawable_region_put (int drawable, int x, int y, int width, int height,
+                     gsize size, guchar *data)
+{
+  GimpDrawable *target = gimp_drawable_get (drawable);
+  if (target == NULL)
+    return -1;
+  if (! drawable_contains (target, x, y, width, height))
+    {
+      gimp_drawable_detach (target);
+      return -1;
+    } // if the rectangle is out of bounds
+
+  // Make sure that we have the right number of bytes
+  int rowstride = width * target->bpp;
+  gsize expected_size = (gsize) rowstride * height;
+  if (expected_size != size)
+    {
+      fprintf (stderr, "Sizes don't match: %lu != %lu\n", 
+               (unsigned long) size, (unsigned long) expected_size);
+      gimp_drawable_detach (target);
+      return -1;
+    } // if the sizes don't match
+
+  // Copy the pixels a band of rows at a time
+  GimpPixelRgn region;
+  gimp_pixel_rgn_init (&region, target, x, y, width, height, TRUE, FALSE);
+  int rows = region_chunk_rows (rowstride, height);
+  int r;
+  for (r = 0; r < height; r += rows)
+    {
+      gimp_pixel_rgn_set_rect (&region, data + (gsize) r * rowstride,
+                               x, y + r, width, MIN (rows, height - r));
+    } // for each band
+
+  // And update!
+  gimp_drawable_flush (target);
+  gimp_drawable_update (drawable, x, y, width, height);
+  mipmap_invalidate (drawable, x, y, width, height);
+  gimp_displays_flush ();
+  gimp_drawable_detach (target);
+  return 0;
+} // drawable_region_put
+
+/**
+ * Get a copy of a rectangle of a drawable in a particular layout.  We
+ * fetch the pixels interleaved (since that's what the GIMP gives us)
+ * and then split them.
+ */
+TileBuffer *
+drawable_region_get_layout (int drawable, int x, int y, 
+                            int width, int height, int layout)
+{
+  if ((layout != TILE_LAYOUT_INTERLEAVED) && (layout != TILE_LAYOUT_PLANAR))
+    return NULL;
+  TileBuffer *buffer = drawable_region_get (drawable, x, y, width, height);
+  if ((buffer == NULL) || (layout == TILE_LAYOUT_INTERLEAVED))
+    return buffer;
+
+  gsize size = tile_buffer_size (buffer);
+  guchar *planes = g_try_malloc (size);
+  if (planes == NULL)
+    {
+      tile_buffer_free (buffer);
+      return NULL;
+    } // if we could not allocate the planes
+  tile_kernel_deinterleave (buffer->data, buffer->bpp,
+                            planes, (gsize) width * height,
+                            (gsize) width * height);
+  g_free (buffer->data);
+  buffer->data = planes;
+  buffer->layout = TILE_LAYOUT_PLANAR;
+  buffer->rowstride = width;
+  return buffer;
+} // drawable_region_get_layout
+
+/**
+ * Replace the pixels in a rectangle of a drawable using data in a 
+ * particular layout.
+ */
+int
+drawable_region_put_layout (int drawable, int x, int y, 
+                            int width, int height, int layout,
+                            gsize size, guchar *data)
+{
+  if (layout == TILE_LAYOUT_INTERLEAVED)
+    return drawable_region_put (drawable, x, y, width, height, size, data);
+  if ((layout != TILE_LAYOUT_PLANAR) || (width <= 0) || (height <= 0))
+    return -1;
+
+  // Check the size before interleaving, so that we don't read past
+  // the end of the data
+  gsize npixels = (gsize) width * height;
+  gsize expected_size = npixels * gimp_drawable_bpp (drawable);
+  if (expected_size != size)
+    {
+      fprintf (stderr, "Sizes don't match: %lu != %lu\n", 
+               (unsigned long) size, (unsigned long) expected_size);
+      return -1;
+    } // if the sizes don't match
+
+  guchar *pixels = g_try_malloc (size);
+  if (pixels == NULL)
+    return -1;
+  tile_kernel_interleave (data, npixels, gimp_drawable_bpp (drawable),
+                          pixels, npixels);
+  int result = drawable_region_put (drawable, x, y, width, height, 
+                                    size, pixels);
+  g_free (pixels);
+  return result;
+} // drawable_region_put_layout
+
+/**
+ * Set the number of bytes transferred at a time.
+ */
+gsize
+region_set_chunk_size (gsize size)
+{
+  region_chunk_size = MAX (size, gimp_tile_width () * 4);
+  return region_chunk_size;
+} // region_set_chunk_size
+
+
+// +--------+----------------------------------------------------------
+// | Pixels |
+// +--------+
+
+/**
+ * Get the colors of scattered pixels.
+ */
+int
+drawable_pixels_get (int drawable, int n, 
+                     const gint32 *xs, const gint32 *ys, gint32 *colors)
+{
+  GimpDrawable *source = gimp_drawable_get (drawable);
+  if (source == NULL)
+    return -1;
+  if (! drawable_contains_points (source, n, xs, ys))
+    {
+      gimp_drawable_detach (source);
+      return -1;
+    } // if some point is out of bounds
+
+  // The pixel fetcher keeps the most recent tile referenced, and the
+  // tile cache keeps the others around, so nearby pixels are cheap.
+  reserve_tile_cache (MIN (source->ntile_cols * source->ntile_rows,
+                           MAX_PIXEL_CACHE_TILES));
+  GimpPixelFetcher *fetcher = gimp_pixel_fetcher_new (source, FALSE);
+  guchar pixel[4];
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      gimp_pixel_fetcher_get_pixel (fetcher, xs[i], ys[i], pixel);
+      colors[i] = irgb_from_pixel (pixel, source->bpp);
+    } // for each pixel
+
+  // And we're done
+  gimp_pixel_fetcher_destroy (fetcher);
+  gimp_drawable_detach (source);
+  return n;
+} // drawable_pixels_get
+
+/**
+ * Set the colors of scattered pixels.
+ */
+int
+drawable_pixels_set (int drawable, int n, 
+                     const gint32 *xs, const gint32 *ys, 
+                     const gint32 *colors)
+{
+  GimpDrawable *target = gimp_drawable_get (drawable);
+  if (target == NULL)
+    return -1;
+  if (! drawable_contains_points (target, n, xs, ys))
+    {
+      gimp_drawable_detach (target);
+      return -1;
+    } // if some point is out of bounds
+  if (n == 0)
+    {
+      gimp_drawable_detach (target);
+      return 0;
+    } // if there's nothing to do
+
+  // Set the pixels, keeping track of the bounding box so that we
+  // know what to update.
+  reserve_tile_cache (MIN (target->ntile_cols * target->ntile_rows,
+                           MAX_PIXEL_CACHE_TILES));
+  GimpPixelFetcher *fetcher = gimp_pixel_fetcher_new (target, FALSE);
+  int left = xs[0];
+  int top = ys[0];
+  int right = xs[0];
+  int bottom = ys[0];
+  guchar pixel[4];
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      irgb_to_pixel (colors[i], pixel, target->bpp);
+      gimp_pixel_fetcher_put_pixel (fetcher, xs[i], ys[i], pixel);
+      left = MIN (left, xs[i]);
+      top = MIN (top, ys[i]);
+      right = MAX (right, xs[i]);
+      bottom = MAX (bottom, ys[i]);
+    } // for each pixel
+
+  // And update!
+  gimp_pixel_fetcher_destroy (fetcher);
+  gimp_drawable_flush (target);
+  gimp_drawable_update (drawable, left, top, 
+                        right - left + 1, bottom - top + 1);
+  mipmap_invalidate (drawable, left, top, 
+                     right - left + 1, bottom - top + 1);
+  gimp_displays_flush ();
+  gimp_drawable_detach (target);
+  return n;
+} // drawable_pixels_set
+
+
+
+// +------------------+------------------------------------------------
+// | Point Operations |
+// +------------------+
+
+/**
+ * The tables for a lookup-table job.
+ */
+struct LutJob
+  {
+    guchar luts[4][256];
+  };
+typedef struct LutJob LutJob;
+
+/**
+ * Run lookup tables over one tile.  (Runs on a worker thread.)
+ */
+static void
+lut_job (guchar *pixels, int bpp, int rowstride,
+         int x, int y, int width, int height, gpointer data)
+{
+  LutJob *job = (LutJob *) data;
+  const TileRowKernels *kernels = tile_row_kernels (bpp);
+  int r;
+  for (r = 0; r < height; r++)
+    kernels->lut (pixels + r * rowstride, pixels + r * rowstride,
+                  width, job->luts);
+} // lut_job
+
+/**
+ * Run a pixel program over one tile.  (Runs on a worker thread.)
+ */
+static void
+pixel_map_job (guchar *pixels, int bpp, int rowstride,
+               int x, int y, int width, int height, gpointer data)
+{
+  const PixelProgram *program = (const PixelProgram *) data;
+  int r;
+  for (r = 0; r < height; r++)
+    pixel_program_run (program, 
+                       pixels + r * rowstride, pixels + r * rowstride,
+                       bpp, width, x, y + r);
+} // pixel_map_job
+
+/**
+ * Run lookup tables over a rectangle of a drawable.  The tiles are
+ * spread over the worker pool, and the results go through the shadow,
+ * so the change can be undone.
+ */
+int
+drawable_apply_lut (int drawable, int x, int y, int width, int height,
+                    int ntables, const guchar *tables)
+{
+  // Validate
+  GimpDrawable *target = gimp_drawable_get (drawable);
+  if (target == NULL)
+    return -1;
+  int bpp = target->bpp;
+  gboolean contained = drawable_contains (target, x, y, width, height);
+  gimp_drawable_detach (target);
+  if ((! contained) || (ntables < 1) || (ntables > bpp))
+    return -1;
+
+  // Build one table per channel, leaving the channels without tables
+  // alone
+  LutJob job;
+  int c, v;
+  for (c = 0; c < 4; c++)
+    for (v = 0; v < 256; v++)
+      job.luts[c][v] = (c < ntables) ? tables[c * 256 + v] : v;
+
+  // Run them over every tile
+  return drawable_map_tiles (drawable, x, y, width, height, lut_job, &job);
+} // drawable_apply_lut
+
+/**
+ * Run a pixel program over a rectangle.  Like drawable_apply_lut, we
+ * spread the tiles over the worker pool and work through the shadow.
+ */
+int
+drawable_pixel_map (int drawable, int x, int y, int width, int height,
+                    const PixelProgram *program)
+{
+  // Validate
+  GimpDrawable *target = gimp_drawable_get (drawable);
+  if (target == NULL)
+    return -1;
+  gboolean contained = drawable_contains (target, x, y, width, height);
+  gimp_drawable_detach (target);
+  if ((! contained) || (program == NULL))
+    return -1;
+
+  // Run it over every tile
+  return drawable_map_tiles (drawable, x, y, width, height, 
+                             pixel_map_job, (gpointer) program);
+} // drawable_pixel_map
+
+
+// +---------+---------------------------------------------------------
+// | Buffers |
+// +---------+
+
+/**
+ * Determine the number of bytes in a buffer.
+ */
+gsize
+tile_buffer_size (TileBuffer *buffer)
+{
+  gsize size = (gsize) buffer->rowstride * buffer->height;
+  if (buffer->layout == TILE_LAYOUT_PLANAR)
+    size *= buffer->bpp;
+  return size;
+} // tile_buffer_size
+
+/**
+ * Free a tile buffer.
+ */
+void
+tile_buffer_free (TileBuffer *buffer)
+{
+  if (buffer == NULL)
+    return;
+  g_free (buffer->data);
+  g_free (buffer);
+} // tile_buffer_free
@@ -39,6 +39,15 @@
       tile_stream_advance (stream);
     } // while
   tile_stream_close (stream);
+
+  // Sample usage: a 3x3 neighborhood filter in one pass
+  tile_stream_set_halo (stream, 1, TILE_HALO_CLAMP);
+  while ((padded = tile_stream_get_padded (stream)) != NULL)
+    {
+      ... compute the padded->w - 2 by padded->h - 2 interior ...
+      tile_update (stream, size, interior);
+      tile_stream_advance (stream);
+    } // while
  */
 
 
@@ -48,6 +57,64 @@
 
 #include <libgimp/gimp.h>
 
+#include "irgb.h"
+#include "pixel-vm.h"
+
+
+// +-----------+-------------------------------------------------------
+// | Constants |
+// +-----------+
+
+/**
+ * The ways in which the bytes of a tile or region can be arranged.
+ * Interleaved pixels store all of the channels of a pixel together
+ * (as the GIMP does).  Planar pixels store all of the first channel,
+ * then all of the second channel, and so on.
+ */
+#define TILE_LAYOUT_INTERLEAVED 0
+#define TILE_LAYOUT_PLANAR 1
+
+/**
+ * Channel masks select channels of a tile: bit c selects channel c,
+ * and the TILE_CHANNEL_LUMINANCE bit selects a computed luminance.
+ * TILE_CHANNELS_ALL means every channel, as stored.
+ */
+#define TILE_CHANNELS_ALL 0
+#define TILE_CHANNEL_LUMINANCE 4
+
+/**
+ * How a tile's halo is filled in where it reaches past the edge of the
+ * drawable.  Clamped halos repeat the edge pixels, mirrored halos
+ * reflect the drawable about its edge pixels (so column -k looks like
+ * column k), and zero halos are all zero bytes (transparent black).
+ */
+#define TILE_HALO_CLAMP 0
+#define TILE_HALO_MIRROR 1
+#define TILE_HALO_ZERO 2
+
+
+// +-------+-----------------------------------------------------------
+// | Types |
+// +-------+
+
+/**
+ * A copy of a rectangle of pixels from a drawable.  Rows are stored
+ * one after another, rowstride bytes apart.  For planar buffers, each
+ * of the bpp planes is rowstride * height bytes.
+ */
+struct TileBuffer
+  {
+    int x;
+    int y;
+    int width;
+    int height;
+    int bpp;
+    int rowstride;
+    int layout;
+    guchar *data;
+  };
+typedef struct TileBuffer TileBuffer;
+
 
 // +--------------+----------------------------------------------------
 // | Constructors |
@@ -80,6 +147,14 @@ void tile_stream_close (int id);
  */
 GimpPixelRgn *tile_stream_get (int id);
 
+/**
+ * Set the number of tiles past the current one that the stream should
+ * fetch from the GIMP core while the server is otherwise idle.  Returns
+ * the lookahead actually used (which may be clamped) or a negative
+ * number if the stream is invalid.
+ */
+int tile_stream_set_lookahead (int id, int lookahead);
+
 /**
  * Update the pixels in the current tile.
  */
@@ -90,4 +165,244 @@ int tile_update (int id, int size, guchar *data);
  */
 int tile_stream_is_valid (int id);
 
+
+// +---------------+---------------------------------------------------
+// | Packed Pixels |
+// +---------------+
+
+/**
+ * Set how the packed methods pack each pixel into an integer
+ * (IRGB_FORMAT_IRGB, the default, or IRGB_FORMAT_RGBA32).  Returns
+ * the format or a negative number if the stream or format is invalid.
+ */
+int tile_stream_set_format (int id, int format);
+
+/**
+ * Get the current tile with each pixel packed into one integer, rows
+ * one after another with no padding.  Sets *n to the number of pixels.
+ * The result belongs to the stream and is only valid until the next
+ * call.  Returns NULL if no tiles remain.
+ */
+const guint32 *tile_stream_get_packed (int id, int *n);
+
+/**
+ * Update the pixels in the current tile from n packed integers (in the
+ * stream's format).  n must be the number of pixels in the tile.
+ * Returns 0 on success and a negative number on failure.
+ */
+int tile_update_packed (int id, int n, const guint32 *colors);
+
+
+// +---------+---------------------------------------------------------
+// | Layouts |
+// +---------+
+
+/**
+ * Set the layout (TILE_LAYOUT_INTERLEAVED, the default, or
+ * TILE_LAYOUT_PLANAR) that clients of the stream expect.  Returns the
+ * layout or a negative number if the stream or layout is invalid.
+ */
+int tile_stream_set_layout (int id, int layout);
+
+/**
+ * Get the layout that clients of the stream expect.
+ */
+int tile_stream_get_layout (int id);
+
+/**
+ * Get the current tile as bpp planes of width * height bytes each.
+ * The result belongs to the stream and is only valid until the next
+ * call.  Returns NULL if no tiles remain.
+ */
+const guchar *tile_stream_get_planes (int id);
+
+/**
+ * Update the pixels in the current tile from bpp planes of 
+ * width * height bytes each.  Returns 0 on success and a negative
+ * number on failure.
+ */
+int tile_update_planes (int id, int size, const guchar *data);
+
+
+
+// +----------+--------------------------------------------------------
+// | Channels |
+// +----------+
+
+/**
+ * Limit the stream to the channels in a channel mask (e.g., 
+ * 1 << 3 for the alpha of an RGBA drawable, or 
+ * 1 << TILE_CHANNEL_LUMINANCE for the luminance).  Returns the mask
+ * actually used or a negative number if the stream or mask is invalid.
+ */
+int tile_stream_set_channels (int id, int channels);
+
+/**
+ * Get the bytes of the current tile in the stream's layout, limited to
+ * the stream's channels.  Sets *size, *bpp (the number of channels
+ * provided), and *rowstride.  The result belongs to the stream and is
+ * only valid until the next call.  Returns NULL if no tiles remain.
+ */
+const guchar *tile_stream_get_bytes (int id, 
+                                     int *size, int *bpp, int *rowstride);
+
+/**
+ * Update the current tile from bytes in the form provided by
+ * tile_stream_get_bytes, leaving the other channels alone.  Streams
+ * that include the luminance cannot be updated.  Returns 0 on success
+ * and a negative number on failure.
+ */
+int tile_update_bytes (int id, int size, const guchar *data);
+
+
+// +-------+-----------------------------------------------------------
+// | Halos |
+// +-------+
+
+/**
+ * Pad each tile that the stream delivers with halo pixels of context
+ * on every side, read from the neighboring tiles (or made up using
+ * mode, one of the TILE_HALO constants, past the edge of the
+ * drawable).  The padding applies to tile_stream_get_packed,
+ * tile_stream_get_planes, and tile_stream_get_bytes, but the update
+ * functions still take just the tile itself.  A halo of 0 turns
+ * padding off.  Returns the halo or a negative number if the stream,
+ * halo, or mode is invalid.
+ */
+int tile_stream_set_halo (int id, int halo, int mode);
+
+/**
+ * Get the pixels of the current tile together with its halo, as a
+ * region whose position and size include the halo.  (Without a halo,
+ * this is the same as tile_stream_get.)  Returns NULL if no tiles
+ * remain or we cannot fetch the halo.
+ */
+GimpPixelRgn *tile_stream_get_padded (int id);
+
+
+// +---------------+---------------------------------------------------
+// | Random Access |
+// +---------------+
+
+/**
+ * Get a copy of the tile in column tx and row ty of the drawable's
+ * tile grid.  Returns NULL if there is no such tile.  The caller
+ * should free the result with tile_buffer_free.
+ */
+TileBuffer *drawable_tile_get (int drawable, int tx, int ty);
+
+/**
+ * Replace the pixels of the tile in column tx and row ty of the
+ * drawable's tile grid.  size must match the size of the tile.
+ * Returns 0 on success and a negative number on failure.
+ */
+int drawable_tile_put (int drawable, int tx, int ty, int size, guchar *data);
+
+
+// +---------+---------------------------------------------------------
+// | Regions |
+// +---------+
+
+/**
+ * Get a copy of an arbitrary rectangle of a drawable, packed with a
+ * rowstride of width * bpp.  Returns NULL if the rectangle does not
+ * fit within the drawable or if we run out of memory.  The caller
+ * should free the result with tile_buffer_free.
+ */
+TileBuffer *drawable_region_get (int drawable, 
+                                 int x, int y, int width, int height);
+
+/**
+ * Replace the pixels in a rectangle of a drawable.  The data must be
+ * packed with a rowstride of width * bpp.  Returns 0 on success and a
+ * negative number on failure.
+ */
+int drawable_region_put (int drawable, 
+                         int x, int y, int width, int height,
+                         gsize size, guchar *data);
+
+/**
+ * Get a copy of a rectangle of a drawable in the given layout.  For
+ * TILE_LAYOUT_PLANAR, the result has a rowstride of width.
+ */
+TileBuffer *drawable_region_get_layout (int drawable, 
+                                        int x, int y, int width, int height,
+                                        int layout);
+
+/**
+ * Replace the pixels in a rectangle of a drawable with data in the
+ * given layout.
+ */
+int drawable_region_put_layout (int drawable, 
+                                int x, int y, int width, int height,
+                                int layout, gsize size, guchar *data);
+
+/**
+ * Set the number of bytes that the region functions transfer to or
+ * from the GIMP core at a time.  Returns the chunk size actually used.
+ */
+gsize region_set_chunk_size (gsize size);
+
+
+// +--------+----------------------------------------------------------
+// | Pixels |
+// +--------+
+
+/**
+ * Get the irgb colors of n scattered pixels, whose coordinates are
+ * given by xs and ys.  Returns n on success and a negative number if
+ * any of the pixels lies outside the drawable.
+ */
+int drawable_pixels_get (int drawable, int n, 
+                         const gint32 *xs, const gint32 *ys, 
+                         gint32 *colors);
+
+/**
+ * Set n scattered pixels to the given irgb colors.  Returns n on
+ * success and a negative number if any of the pixels lies outside the
+ * drawable (in which case nothing is changed).
+ */
+int drawable_pixels_set (int drawable, int n, 
+                         const gint32 *xs, const gint32 *ys, 
+                         const gint32 *colors);
+
+
+
+// +------------------+------------------------------------------------
+// | Point Operations |
+// +------------------+
+
+/**
+ * Replace every byte in a rectangle of a drawable by looking it up in
+ * a table.  tables holds ntables tables of 256 bytes, one per channel
+ * starting with the first; channels beyond ntables are left alone.
+ * The change can be undone.  Returns 0 on success and a negative 
+ * number on failure.
+ */
+int drawable_apply_lut (int drawable, int x, int y, int width, int height,
+                        int ntables, const guchar *tables);
+
+/**
+ * Run a pixel program (see pixel-vm.h) over every pixel in a rectangle
+ * of a drawable.  The change can be undone.  Returns 0 on success and 
+ * a negative number on failure.
+ */
+int drawable_pixel_map (int drawable, int x, int y, int width, int height,
+                        const PixelProgram *program);
+
+
+// +---------+---------------------------------------------------------
+// | Buffers |
+// +---------+
+
+/**
+ * Determine the number of bytes in a buffer.
+ */
+gsize tile_buffer_size (TileBuffer *buffer);
+
+/**
+ * Free a buffer returned by one of the functions above.
+ */
+void tile_buffer_free (TileBuffer *buffer);
+
 #endif // __TILE_STREAM_H__